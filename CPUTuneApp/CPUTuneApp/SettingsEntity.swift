@@ -15,6 +15,8 @@ class SettingsEntity {
     private var _hwpRequest: String = ""
     private var _turboRatioLimit: String = ""
     private var _procHot: Bool = false
+    // file contents as last read or written, unchanged settings are not written again
+    private var _persisted: [String: String] = [:]
     
     var turboBoost: Bool {
         get {
@@ -102,54 +104,53 @@ class SettingsEntity {
             throw ErrorWithMessage(errorMessages.joined(separator: "\n"))
         }
 
+        self._persisted = [
+            pathCPUTuneTurboBoostRT: turboBoost,
+            pathHWPRequest: hwpRequest,
+            pathTurboRatioLimit: turboRatioLimit,
+            pathCPUTuneProcHotRT: procHot,
+        ]
         self._turboBoost = turboBoost == "1"
         self._hwpRequest = subString(hwpRequest, 2)
         self._turboRatioLimit = subString(turboRatioLimit, 2)
         self._procHot = procHot == "1"
     }
     
+    private func writeIfChanged(_ content: String, _ path: String) throws {
+        if self._persisted[path] == content {
+            return
+        }
+        try content.write(
+            toFile: path,
+            atomically: false,
+            encoding: .ascii
+        )
+        self._persisted[path] = content
+    }
+    
     func persist() throws {
         var errorMessages: Array<String> = []
         
         do {
-            let stringContent = self._turboBoost ? "1" : "0"
-            try stringContent.write(
-                toFile: pathCPUTuneTurboBoostRT,
-                atomically: false,
-                encoding: .ascii
-            )
+            try writeIfChanged(self._turboBoost ? "1" : "0", pathCPUTuneTurboBoostRT)
         } catch {
             errorMessages.append(error.localizedDescription)
         }
 
         do {
-            try "0x\(self._hwpRequest)".write(
-                toFile: pathHWPRequest,
-                atomically: false,
-                encoding: .ascii
-            )
+            try writeIfChanged("0x\(self._hwpRequest)", pathHWPRequest)
         } catch {
             errorMessages.append(error.localizedDescription)
         }
 
         do {
-
-            try "0x\(self._turboRatioLimit)".write(
-                toFile: pathTurboRatioLimit,
-                atomically: false,
-                encoding: .ascii
-            )
+            try writeIfChanged("0x\(self._turboRatioLimit)", pathTurboRatioLimit)
         } catch {
             errorMessages.append(error.localizedDescription)
         }
 
         do {
-            let stringContent = self._procHot ? "1" : "0"
-            try stringContent.write(
-                toFile: pathCPUTuneProcHotRT,
-                atomically: false,
-                encoding: .ascii
-            )
+            try writeIfChanged(self._procHot ? "1" : "0", pathCPUTuneProcHotRT)
         } catch {
             errorMessages.append(error.localizedDescription)
         }
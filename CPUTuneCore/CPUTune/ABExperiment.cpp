@@ -0,0 +1,307 @@
+//
+//  ABExperiment.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "ABExperiment.hpp"
+#include <kern/clock.h>
+#include <libkern/libkern.h>
+
+// observations are clamped to this, so kMaxPairs squares fit into 128 bits
+static constexpr int64_t kMaxObservation = 1LL << 52;
+
+// z^2 * 10^4 of a two-sided 95% interval, and of one of kLooks looks at 1.25% (z = 2.4977)
+static constexpr int64_t kZ95Squared = 38416;
+static constexpr int64_t kZLookSquared = 62385;
+static_assert(ABExperiment::kLooks == 4, "kZLookSquared is for 5% spent over 4 looks");
+
+static bool tokenEquals(const char *str, const size_t begin, const size_t end, const char *name) {
+    const size_t len = strlen(name);
+    return end - begin == len && strncmp(str + begin, name, len) == 0;
+}
+
+static uint64_t isqrt(unsigned __int128 x) {
+    unsigned __int128 result = 0;
+    unsigned __int128 one = static_cast<unsigned __int128>(1) << 126;
+    while (one > x) {
+        one >>= 2;
+    }
+    while (one != 0) {
+        if (x >= result + one) {
+            x -= result + one;
+            result = (result >> 1) + one;
+        } else {
+            result >>= 1;
+        }
+        one >>= 2;
+    }
+    return static_cast<uint64_t>(result);
+}
+
+void ABExperiment::Stat::add(const int64_t x) {
+    n++;
+    sum += x;
+    sumSquares += static_cast<__int128>(x) * x;
+}
+
+int64_t ABExperiment::Stat::halfWidth(const int64_t zSquared) const {
+    if (n < 2) {
+        return 0;
+    }
+    // sample variance of the differences, then z * sqrt(variance / n)
+    const __int128 variance = (sumSquares - static_cast<__int128>(sum) * sum / n) / (n - 1);
+    if (variance <= 0) {
+        return 0;
+    }
+    return static_cast<int64_t>(isqrt(static_cast<unsigned __int128>(variance) * zSquared / n) / 100);
+}
+
+ABExperiment::~ABExperiment() {
+    free();
+}
+
+bool ABExperiment::parse(const char *content, const size_t length, Plan *plan) {
+    *plan = {};
+    plan->periodTicks = 10;
+    plan->pairs = 100;
+    bool given[2] {};
+
+    uint16_t line = 0;
+    size_t i = 0;
+    while (i < length) {
+        line++;
+        size_t end = i;
+        while (end < length && content[end] != '\n') {
+            end++;
+        }
+        const size_t next = end + 1;
+        while (i < end && (content[i] == ' ' || content[i] == '\t' || content[i] == '\r')) {
+            i++;
+        }
+        if (i == end || content[i] == '#') {
+            i = next;
+            continue;
+        }
+        const size_t keyBegin = i;
+        while (i < end && content[i] != ' ' && content[i] != '\t' && content[i] != '\r') {
+            i++;
+        }
+
+        ParseResult result {};
+        uint64_t value = 0;
+        if (tokenEquals(content, keyBegin, i, "a") || tokenEquals(content, keyBegin, i, "b")) {
+            const size_t arm = content[keyBegin] - 'a';
+            result = parseRegisterConfig(content + i, end - i, kHWPRequestFields, arrsize(kHWPRequestFields),
+                                         &plan->value[arm], &plan->mask[arm]);
+            given[arm] = result.status == kParseOK;
+        } else if (tokenEquals(content, keyBegin, i, "period")) {
+            result = parseUInt64(content + i, end - i, 10, &value);
+            plan->periodTicks = static_cast<uint32_t>(min<uint64_t>(value, UINT32_MAX));
+        } else if (tokenEquals(content, keyBegin, i, "pairs")) {
+            result = parseUInt64(content + i, end - i, 10, &value);
+            plan->pairs = static_cast<uint32_t>(min<uint64_t>(value, kMaxPairs));
+        } else {
+            result.status = kParseUnknownKey;
+        }
+        if (result.status != kParseOK) {
+            LOG("experiment line %u: %s", line, parseStatusToString(result.status));
+            return false;
+        }
+        i = next;
+    }
+
+    if (!given[0] || !given[1] || plan->periodTicks == 0 || plan->pairs == 0) {
+        LOG("experiment needs arms a and b, a period and pairs above 0");
+        return false;
+    }
+    return true;
+}
+
+bool ABExperiment::init(const uint32_t cpus) {
+    if (cpus == 0) {
+        return false;
+    }
+    this->cpus = cpus < kMaxCPUs ? cpus : kMaxCPUs;
+    allCPUs = this->cpus == kMaxCPUs ? ~0ULL : (1ULL << this->cpus) - 1;
+    dict = OSDictionary::withCapacity(13);
+    if (!dict) {
+        return false;
+    }
+    phaseNumber = addNumberToDictionary(dict, "Phase");
+    pairsNumber = addNumberToDictionary(dict, "Pairs");
+    usesCounterNumber = addNumberToDictionary(dict, "UsesCounter");
+    throughputNumber[0] = addNumberToDictionary(dict, "ThroughputA");
+    throughputNumber[1] = addNumberToDictionary(dict, "ThroughputB");
+    powerNumber[0] = addNumberToDictionary(dict, "PackagePowerMilliwattsA");
+    powerNumber[1] = addNumberToDictionary(dict, "PackagePowerMilliwattsB");
+    throughputDiffNumber = addNumberToDictionary(dict, "ThroughputDifference");
+    throughputNegativeNumber = addNumberToDictionary(dict, "ThroughputDifferenceNegative");
+    throughputHalfWidthNumber = addNumberToDictionary(dict, "ThroughputHalfWidth");
+    powerDiffNumber = addNumberToDictionary(dict, "PowerDifference");
+    powerNegativeNumber = addNumberToDictionary(dict, "PowerDifferenceNegative");
+    powerHalfWidthNumber = addNumberToDictionary(dict, "PowerHalfWidth");
+    if (!phaseNumber || !pairsNumber || !usesCounterNumber || !throughputNumber[0] || !throughputNumber[1] ||
+        !powerNumber[0] || !powerNumber[1] || !throughputDiffNumber || !throughputNegativeNumber ||
+        !throughputHalfWidthNumber || !powerDiffNumber || !powerNegativeNumber || !powerHalfWidthNumber) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+void ABExperiment::free() {
+    // the OSNumber objects are owned by the dictionary
+    OSSafeReleaseNULL(dict);
+    phase = kIdle;
+}
+
+void ABExperiment::start(MSRBackend *backend, const Plan &plan, const bool useCounter) {
+    if (!dict || !backend) {
+        return;
+    }
+    stop();
+    this->backend = backend;
+    const uint32_t msr = MSR_IA32_HWP_REQUEST;
+    backend->readAllCPUs(&msr, 1, originals, cpus);
+    for (size_t i = 0; i < 2; i++) {
+        value[i] = plan.value[i] & plan.mask[i];
+        mask[i] = plan.mask[i];
+    }
+    periodTicks = plan.periodTicks;
+    maxPairs = plan.pairs;
+    looks = 0;
+    throughput = {};
+    power = {};
+    memset(sumThroughput, 0, sizeof(sumThroughput));
+    memset(sumPower, 0, sizeof(sumPower));
+    armsDone = 0;
+    usesCounter = useCounter;
+    phase = kRunning;
+    phaseNumber->setValue(phase);
+    pairsNumber->setValue(0ULL);
+    usesCounterNumber->setValue(usesCounter);
+    LOG("experiment 0x%llx (fields 0x%llx) against 0x%llx (fields 0x%llx), %u ticks per arm, up to %u pairs",
+        value[0], mask[0], value[1], mask[1], periodTicks, maxPairs);
+    switchTo(random() & 1);
+}
+
+void ABExperiment::stop() {
+    if (phase == kRunning) {
+        finish(kStopped, allCPUs);
+    }
+}
+
+void ABExperiment::switchTo(const uint8_t next) {
+    arm = next;
+    // the fields of the other arm go back to the original of the cpu
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        requests[cpu] = (originals[cpu] & ~mask[arm]) | value[arm];
+    }
+    backend->updateCPUs(MSR_IA32_HWP_REQUEST, mask[0] | mask[1], requests, allCPUs);
+    period = {};
+    settle = true;
+}
+
+void ABExperiment::tick(const Telemetry &telemetry, const bool hasCounter, const uint64_t counter, const uint64_t reserved) {
+    if (phase != kRunning) {
+        return;
+    }
+    if (reserved) {
+        // the sets keep their own requests, only the other cpus are restored
+        LOG("experiment stopped: core sets manage IA32_HWP_REQUEST of cpus 0x%llx", reserved);
+        finish(kStopped, allCPUs & ~reserved);
+        return;
+    }
+    if (settle) {
+        // the sample of this tick spans the switch, measure from here on
+        settle = false;
+        period.counted = hasCounter;
+        period.counterBegin = counter;
+        period.timeBegin = mach_absolute_time();
+        return;
+    }
+
+    // delivered frequency: effective MHz of the time in C0, summed over all cpus
+    uint64_t delivered = 0;
+    for (uint32_t cpu = 0; cpu < telemetry.getCPUCount(); cpu++) {
+        delivered += static_cast<uint64_t>(telemetry.getEffectiveFrequencyMHz(cpu)) * telemetry.getBusyPercent(cpu) / 100;
+    }
+    period.throughputSum += delivered;
+    period.powerSum += telemetry.getPackagePowerMilliwatts();
+    if (++period.ticks == periodTicks) {
+        endPeriod(hasCounter, counter);
+    }
+}
+
+void ABExperiment::endPeriod(const bool hasCounter, const uint64_t counter) {
+    int64_t rate = static_cast<int64_t>(period.throughputSum / period.ticks);
+    if (usesCounter) {
+        // counter increments per second over the measured ticks
+        uint64_t elapsedNs = 0;
+        absolutetime_to_nanoseconds(mach_absolute_time() - period.timeBegin, &elapsedNs);
+        const uint64_t elapsedMs = elapsedNs / 1000000;
+        if (!period.counted || !hasCounter || counter < period.counterBegin || elapsedMs == 0) {
+            // counter missing or reset, run this arm again rather than mixing units
+            switchTo(arm);
+            return;
+        }
+        rate = static_cast<int64_t>(min<uint64_t>((counter - period.counterBegin) * 1000 / elapsedMs, kMaxObservation));
+    }
+    result[arm][0] = rate;
+    result[arm][1] = static_cast<int64_t>(period.powerSum / period.ticks);
+
+    if (++armsDone < 2) {
+        switchTo(arm ^ 1);
+        return;
+    }
+    armsDone = 0;
+    endPair();
+    if (phase == kRunning) {
+        switchTo(random() & 1);
+    }
+}
+
+void ABExperiment::endPair() {
+    throughput.add(result[1][0] - result[0][0]);
+    power.add(result[1][1] - result[0][1]);
+    for (size_t i = 0; i < 2; i++) {
+        sumThroughput[i] += result[i][0];
+        sumPower[i] += result[i][1];
+        throughputNumber[i]->setValue(static_cast<uint64_t>(sumThroughput[i] / throughput.n));
+        powerNumber[i]->setValue(static_cast<uint64_t>(sumPower[i] / power.n));
+    }
+    const int64_t diff = throughput.mean();
+    const int64_t halfWidth = throughput.halfWidth(kZLookSquared);
+    pairsNumber->setValue(static_cast<uint64_t>(throughput.n));
+    // OSNumber has no sign, a negative difference would read as close to 2^64
+    const int64_t powerDiff = power.mean();
+    throughputDiffNumber->setValue(static_cast<uint64_t>(diff < 0 ? -diff : diff));
+    throughputNegativeNumber->setValue(diff < 0);
+    throughputHalfWidthNumber->setValue(static_cast<uint64_t>(halfWidth));
+    powerDiffNumber->setValue(static_cast<uint64_t>(powerDiff < 0 ? -powerDiff : powerDiff));
+    powerNegativeNumber->setValue(powerDiff < 0);
+    powerHalfWidthNumber->setValue(static_cast<uint64_t>(power.halfWidth(kZ95Squared)));
+
+    // testing after every pair would inflate the false positive rate, only the
+    // looks are tested; looks before kMinPairs are skipped but their alpha is spent
+    bool significant = false;
+    if (looks < kLooks && throughput.n * kLooks >= static_cast<int64_t>(maxPairs) * (looks + 1)) {
+        looks++;
+        significant = throughput.n >= kMinPairs && (diff > halfWidth || diff < -halfWidth);
+    }
+    if (significant) {
+        finish(kSignificant, allCPUs);
+    } else if (throughput.n >= maxPairs) {
+        finish(kExhausted, allCPUs);
+    }
+}
+
+void ABExperiment::finish(const Phase outcome, const uint64_t restored) {
+    backend->updateCPUs(MSR_IA32_HWP_REQUEST, ~0ULL, originals, restored);
+    phase = outcome;
+    phaseNumber->setValue(phase);
+    LOG("experiment ended (phase %u) after %lld pairs: throughput B-A %lld +- %lld, power B-A %lld +- %lld mW",
+        phase, throughput.n, throughput.mean(), throughput.halfWidth(kZLookSquared), power.mean(), power.halfWidth(kZ95Squared));
+}
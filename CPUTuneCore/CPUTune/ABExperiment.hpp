@@ -0,0 +1,190 @@
+//
+//  ABExperiment.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef ABExperiment_hpp
+#define ABExperiment_hpp
+
+#include "Telemetry.hpp"
+#include "ConfigParser.hpp"
+
+/**
+ *  A/B experiment between two HWP requests, described by a config file
+ *  (e.g. /tmp/CPUTuneExperiment.conf):
+ *
+ *      a max=30
+ *      b max=40 epp=128
+ *      period 10
+ *      pairs 200
+ *
+ *  a and b take the fields of the HWP request config and are written to every
+ *  cpu, the bits not given keep the value each cpu had when the experiment
+ *  started. Each pair runs both arms for
+ *  period ticks (default 10) in random order, the first tick after a switch is
+ *  not measured. Throughput is the rate of a counter the workload writes to a
+ *  file if one is configured, otherwise the delivered frequency (effective
+ *  frequency times busy time summed over all cpus). The per pair differences
+ *  B - A of throughput and package power give confidence intervals which are
+ *  updated after every pair. The throughput difference is tested at kLooks
+ *  evenly spaced looks over the planned pairs, each at 5% / kLooks (Bonferroni
+ *  alpha spending), so stopping early keeps the false positive rate at 5% or
+ *  below. The experiment stops at the first look whose interval excludes 0
+ *  (from kMinPairs pairs on) or after pairs pairs (default 100), and restores
+ *  the requests it started from. ThroughputHalfWidth is the half width of the
+ *  interval a look uses, PowerHalfWidth that of the 95% interval. It is refused,
+ *  or stopped, while core sets manage the HWP request of any cpu.
+ *  Published as the "Experiment" dictionary, updating it never allocates. The
+ *  B - A differences are published as their magnitude, with a Negative key
+ *  set to 1 when B is below A.
+ */
+class ABExperiment {
+public:
+    ~ABExperiment();
+
+    enum Phase : uint8_t {
+        kIdle,
+        kRunning,
+        kSignificant,   // throughput differs, at most 5% false positives over all looks
+        kExhausted,     // all pairs run without a significant difference
+        kStopped,       // config removed or replaced while running
+    };
+
+    // differences before the first confidence check
+    static constexpr uint32_t kMinPairs = 8;
+    // significance tests over the planned pairs, the last one after all of them
+    static constexpr uint32_t kLooks = 4;
+    // keeps the sums of squares of clamped observations in range
+    static constexpr uint32_t kMaxPairs = 1000;
+    static constexpr uint32_t kMaxCPUs = 64;
+
+    struct Plan {
+        uint64_t value[2];
+        uint64_t mask[2];
+        uint32_t periodTicks;
+        uint32_t pairs;
+    };
+
+    /**
+     *  Parse an experiment config
+     *
+     *  @param content  config text
+     *  @param length   length of content
+     *  @param plan     parsed plan
+     *
+     *  @return true if both arms are given and every line parsed
+     */
+    static bool parse(const char *content, const size_t length, Plan *plan);
+
+    /**
+     *  Create the published dictionary
+     *
+     *  @param cpus  number of logical cpus to write the arms to
+     *
+     *  @return true on success
+     */
+    bool init(const uint32_t cpus);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    bool isRunning(void) const { return phase == kRunning; }
+
+    /**
+     *  Start alternating between the HWP fields of two arms on every cpu
+     *
+     *  @param backend     MSR backend to read and write IA32_HWP_REQUEST through
+     *  @param plan        validated arms, period and number of pairs
+     *  @param useCounter  measure throughput with the workload counter
+     */
+    void start(MSRBackend *backend, const Plan &plan, const bool useCounter);
+
+    /**
+     *  End a running experiment early and restore the original requests
+     */
+    void stop(void);
+
+    /**
+     *  Account the current telemetry sample, must be called once per tick
+     *  after Telemetry::sample()
+     *
+     *  @param telemetry   sampled telemetry
+     *  @param hasCounter  counter is valid
+     *  @param counter     current value of the workload throughput counter
+     *  @param reserved    cpus whose HWP request belongs to a core set, any stops the experiment
+     */
+    void tick(const Telemetry &telemetry, const bool hasCounter, const uint64_t counter, const uint64_t reserved);
+
+private:
+    /**
+     *  Running sum of one paired difference
+     */
+    struct Stat {
+        int64_t n;
+        int64_t sum;
+        __int128 sumSquares;
+
+        void add(const int64_t x);
+        int64_t mean(void) const { return n ? sum / n : 0; }
+        // half width of the confidence interval of the mean for z^2 in units of 10^-4 (normal approximation)
+        int64_t halfWidth(const int64_t zSquared) const;
+    };
+
+    struct Period {
+        uint32_t ticks;
+        uint64_t throughputSum;
+        uint64_t powerSum;
+        uint64_t counterBegin;
+        uint64_t timeBegin;
+        bool counted;
+    };
+
+    MSRBackend *backend = nullptr;
+    Phase phase = kIdle;
+    uint32_t cpus = 0;
+    uint64_t allCPUs = 0;
+    // IA32_HWP_REQUEST of every cpu before the experiment, the arms change the given fields
+    uint64_t originals[kMaxCPUs] {};
+    uint64_t requests[kMaxCPUs] {};
+    uint64_t value[2] {};
+    uint64_t mask[2] {};
+    uint32_t periodTicks = 0;
+    uint32_t maxPairs = 0;
+    uint32_t looks = 0;
+
+    // arm of the current period, the other arm runs next within the pair
+    uint8_t arm = 0;
+    uint8_t armsDone = 0;
+    bool settle = false;
+    Period period {};
+    int64_t result[2][2] {};    // [arm][throughput, power] of the current pair
+
+    Stat throughput {};
+    Stat power {};
+    int64_t sumThroughput[2] {};
+    int64_t sumPower[2] {};
+    bool usesCounter = false;
+
+    OSDictionary *dict = nullptr;
+    OSNumber *phaseNumber = nullptr;
+    OSNumber *pairsNumber = nullptr;
+    OSNumber *usesCounterNumber = nullptr;
+    OSNumber *throughputNumber[2] {};
+    OSNumber *powerNumber[2] {};
+    OSNumber *throughputDiffNumber = nullptr;
+    OSNumber *throughputNegativeNumber = nullptr;
+    OSNumber *throughputHalfWidthNumber = nullptr;
+    OSNumber *powerDiffNumber = nullptr;
+    OSNumber *powerNegativeNumber = nullptr;
+    OSNumber *powerHalfWidthNumber = nullptr;
+
+    void switchTo(const uint8_t next);
+    void endPeriod(const bool hasCounter, const uint64_t counter);
+    void endPair(void);
+    void finish(const Phase outcome, const uint64_t restored);
+};
+
+#endif /* ABExperiment_hpp */
@@ -6,7 +6,34 @@
 //
 
 #include "CPUInfo.hpp"
-#include <i386/proc_reg.h>
+
+// Typed registers checked against the SDM at compile time
+static_assert(msr::TurboModeDisable::mask == 0x4000000000ULL, "IA32_MISC_ENABLE[38] turbo mode disable");
+static_assert(msr::TurboModeDisable::set<0>().apply(~0ULL) == ~0x4000000000ULL, "enabling turbo only clears bit 38");
+static_assert(msr::BiDirectionalProcHot::set<0>().apply(~0ULL) == ~1ULL, "disabling BD PROCHOT keeps MSR_POWER_CTL[63:1]");
+static_assert(msr::HWPEnable::set<1>().apply(0) == 1, "IA32_PM_ENABLE[0] HWP enable");
+static_assert(msr::TurboRatioLimitWritable::mask == MSR_TURBO_RATIO_LIMIT_RW, "MSR_PLATFORM_INFO[28]");
+static_assert(msr::HWPRequestReserved::mask == ~((1ULL << 43) - 1), "IA32_HWP_REQUEST[63:43] reserved");
+static_assert(msr::HWPActivityWindow::mask == 0x3FFULL << 32, "IA32_HWP_REQUEST[41:32] activity window");
+static_assert(msr::TurboRatioActiveCores<8>::mask == 0xFF00000000000000ULL, "MSR_TURBO_RATIO_LIMIT[63:56] 8 cores");
+static_assert(Field<msr::TimeStampCounter, 63, 0>::mask == ~0ULL, "a field may span the whole register");
+static_assert(msr::DigitalReadout::extract(0x88390000ULL) == 0x39, "IA32_THERM_STATUS[22:16] digital readout");
+static_assert(msr::HWPMaximum::insert(0x80002a08ULL, 0x30) == 0x80003008ULL, "insert only touches its field");
+static_assert(msr::HWPMinimum::set(0x1ff).value == 0xff, "runtime values are cut to the field");
+// multi field updates fold into one mask and value
+static_assert((msr::HWPMinimum::set<8>() | msr::HWPMaximum::set<42>()).mask == 0xFFFF, "combined mask");
+static_assert((msr::HWPMinimum::set<8>() | msr::HWPMaximum::set<42>()).apply(0x80002010ULL) == 0x80002a08ULL, "combined update");
+static_assert((msr::HWPMaximum::set<42>() | msr::HWPMaximum::set<40>()).apply(0) == 40 << 8, "the later update of a field wins");
+
+// model lookups resolved at compile time
+static_assert(findModel(6, CPUInfo::CPU_MODEL_SANDYBRIDGE, 7)->quirks & kQuirkTimerSender, "Sandy Bridge timer quirk");
+static_assert(findModel(6, CPUInfo::CPU_MODEL_SKYLAKE_W, 4)->stepping == 0, "Skylake-SP below stepping 5");
+static_assert(findModel(6, CPUInfo::CPU_MODEL_SKYLAKE_W, 7)->stepping == 5, "Cascade Lake-SP from stepping 5");
+static_assert(findModel(6, CPUInfo::CPU_MODEL_PENRYN, 0) == &kModelTable[0], "first row");
+static_assert(findModel(6, CPUInfo::CPU_MODEL_COMETLAKE_U, 0xF) == &kModelTable[kModelTableSize - 1], "last row");
+static_assert(findModel(6, 0x50, 0) == nullptr, "unknown model between rows");
+static_assert(findModel(6, 0x10, 0) == nullptr && findModel(6, 0xFF, 0) == nullptr, "unknown model outside the table");
+static_assert(findModel(0xF, CPUInfo::CPU_MODEL_HASWELL, 0) == nullptr, "other family");
 
 const uint8_t CPUInfo::getCPUModel() const {
     uint32_t cpuid_reg[4];
@@ -14,16 +41,98 @@ const uint8_t CPUInfo::getCPUModel() const {
     return bitfield32(cpuid_reg[eax], 7,  4) + (bitfield32(cpuid_reg[eax], 19, 16) << 4);
 }
 
+const uint8_t CPUInfo::getCPUFamily() const {
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000001, cpuid_reg);
+    const uint32_t family = bitfield32(cpuid_reg[eax], 11, 8);
+    // the extended family only counts for family 0xF
+    return family == 0xF ? family + bitfield32(cpuid_reg[eax], 27, 20) : family;
+}
+
+const uint8_t CPUInfo::getCPUStepping() const {
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000001, cpuid_reg);
+    return bitfield32(cpuid_reg[eax], 3, 0);
+}
+
+// models newer than the table fall back to the checks by model number below
+
 const bool CPUInfo::supportedSpeedShift() const {
+    if (descriptor) {
+        return descriptor->registers & kModelRegHWP;
+    }
     return model >= CPU_MODEL_SKYLAKE;
 }
 
+const uint32_t CPUInfo::getPowerManagementFeatures() const {
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000006, cpuid_reg);
+    return cpuid_reg[eax];
+}
+
 const uint8_t CPUInfo::getCoreCount() const {
-    return bitfield32(rdmsr64(MSR_CORE_THREAD_COUNT), 31, 16);
+    return msr::CoreCount::extract(rdmsr64(msr::CoreThreadCount::address));
 }
 
 const bool CPUInfo::getTurboRatioLimitRW() const {
     // RO if MSR_PLATFORM_INFO.[28] = 0
     // RW if MSR_PLATFORM_INFO.[28] = 1
-    return rdmsr64(MSR_PLATFORM_INFO) & MSR_TURBO_RATIO_LIMIT_RW;
+    return msr::TurboRatioLimitWritable::extract(rdmsr64(msr::PlatformInfo::address));
+}
+
+const uint16_t CPUInfo::getThreadCount() const {
+    return msr::ThreadCount::extract(rdmsr64(msr::CoreThreadCount::address));
+}
+
+const bool CPUInfo::supportedPowerLimit() const {
+    if (descriptor) {
+        return descriptor->registers & kModelRegRAPL;
+    }
+    return model >= CPU_MODEL_SANDYBRIDGE;
+}
+
+const bool CPUInfo::supportedEffectiveFrequency() const {
+    // CPUID.06H:ECX[0] Hardware Coordination Feedback Capability (IA32_APERF/IA32_MPERF)
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000006, cpuid_reg);
+    return bitfield32(cpuid_reg[ecx], 0, 0);
+}
+
+const uint8_t CPUInfo::getBaseRatio() const {
+    return msr::MaxNonTurboRatio::extract(rdmsr64(msr::PlatformInfo::address));
+}
+
+const uint32_t CPUInfo::getPerfLimitReasonsMSR() const {
+    // client parts only, the server parts use a different layout
+    if (!descriptor) {
+        return 0;
+    }
+    if (descriptor->registers & kModelRegLimitHSW) {
+        return msr::CorePerfLimitReasonsHSW::address;
+    }
+    if (descriptor->registers & kModelRegLimit) {
+        return msr::CorePerfLimitReasons::address;
+    }
+    return 0;
+}
+
+const uint8_t CPUInfo::getTurboRatioBins() const {
+    const uint8_t bins = coreCount < 8 ? coreCount : 8;
+    if (!descriptor) {
+        return bins;
+    }
+    if (!(descriptor->registers & kModelRegTurboRatio)) {
+        return 0;
+    }
+    switch (descriptor->turboRatio) {
+        case kTurboRatioNone:
+            return 0;
+        case kTurboRatioPerCore:
+            return bins;
+        case kTurboRatioGroups:
+            // one limit per core group rather than per active core count, and
+            // unused groups may be 0, so only the first group is known to be set
+            return 1;
+    }
+    return bins;
 }
@@ -9,42 +9,47 @@
 #define CPUInfo_hpp
 
 #include "kern_util.hpp"
+#include "CPUModelTable.hpp"
 #include <i386/cpuid.h>
+#include <i386/proc_reg.h>
+#include "MSRRegisters.hpp"
+
 /* Copied from xnu/osfmk/cpuid.c (modified for 64-bit values) */
 #define bit(n)                 (1UL << (n))
 #define bitmask64(h, l)        ((bit(h) | (bit(h) - 1)) & ~ (bit(l) - 1))
 #define bitfield32(x, h, l)    (((x) & bitmask64(h, l)) >> l)
 
-// As per xnu/osfmk/proc_reg.h
-#define MSR_CORE_THREAD_COUNT       0x35
-
-// Intel SpeedShift MSRs
-#define MSR_IA32_PM_ENABLE          0x770
-#define MSR_IA32_HWP_REQUEST        0x774
-
-// Intel Power MSRs
-#define MSR_IA32_POWER_CTL          0x1FC
-
-// Maximum Ratio Limit of Turbo Mode
-// RW or RO stores in MSR_PLATFORM_INFO.[28]
-// Refer Software Developer's Manual Volume 4: Model-Specific Registers
-#define MSR_TURBO_RATIO_LIMIT_RW    (1 << 28)
-#define MSR_TURBO_RATIO_LIMIT       0x1AD
-#define MSR_TURBO_RATIO_LIMIT1      0x1AE
-#define MSR_TURBO_RATIO_LIMIT2      0x1AF
+// CPUID.06H:EAX
+#define CPUID_PM_DIGITAL_THERMAL_SENSOR bit(0)
+#define CPUID_PM_PACKAGE_THERMAL        bit(6)
 
 class CPUInfo {
 public:
     CPUInfo() :
         model(getCPUModel()),
+        family(getCPUFamily()),
+        stepping(getCPUStepping()),
+        descriptor(findModel(family, model, stepping)),
         supportedHWP(supportedSpeedShift()),
+        powerManagementFeatures(getPowerManagementFeatures()),
         coreCount(getCoreCount()),
-        turboRatioLimitRW(getTurboRatioLimitRW()) {
-        LOG("cpu model: 0x%x, %s HWP, number of cores: %d, turbo ratio limit permission: %s",
+        threadCount(getThreadCount()),
+        turboRatioLimitRW(getTurboRatioLimitRW()),
+        supportedRAPL(supportedPowerLimit()),
+        supportedAPERFMPERF(supportedEffectiveFrequency()),
+        baseRatio(getBaseRatio()),
+        perfLimitReasonsMSR(getPerfLimitReasonsMSR()),
+        turboRatioBins(getTurboRatioBins()) {
+        LOG("cpu family 0x%x model 0x%x stepping %u: %s, quirks 0x%x", family, model, stepping,
+            descriptor ? descriptor->name : "unknown, using defaults", descriptor ? descriptor->quirks : 0);
+        LOG("cpu model: 0x%x, %s HWP, number of cores: %d, threads: %d, turbo ratio limit permission: %s, %s RAPL, base ratio: %d",
               model,
               (supportedHWP ? "supported" : "unsupported"),
               coreCount,
-              (turboRatioLimitRW ? "RW" : "RO"));
+              threadCount,
+              (turboRatioLimitRW ? "RW" : "RO"),
+              (supportedRAPL ? "supported" : "unsupported"),
+              baseRatio);
     };
     
     /**
@@ -52,18 +57,85 @@ public:
      */
     const uint8_t model;
     
+    /**
+     *  Display family and stepping, with model the key of descriptor
+     */
+    const uint8_t family;
+    const uint8_t stepping;
+    
+    /**
+     *  Defaults and quirks of this model from CPUModels.def, nullptr if unknown
+     */
+    const ModelDescriptor *descriptor;
+    
     /**
      *  CPU support HWP
      */
     const bool supportedHWP;
     
+    /**
+     *  Thermal and power management features (CPUID.06H:EAX): digital thermal
+     *  sensor (0), package thermal management (6), HWP feature bits 7-11
+     */
+    const uint32_t powerManagementFeatures;
+    
     /**
      * CPU Cores Count
      */
     const uint8_t coreCount;
     
+    /**
+     * CPU Threads (logical processors) Count
+     */
+    const uint16_t threadCount;
+    
     const bool turboRatioLimitRW;
     
+    /**
+     *  CPU support RAPL energy counters
+     */
+    const bool supportedRAPL;
+    
+    /**
+     *  CPU support IA32_APERF/IA32_MPERF
+     */
+    const bool supportedAPERFMPERF;
+    
+    /**
+     *  Maximum non-turbo ratio (MSR_PLATFORM_INFO[15:8])
+     */
+    const uint8_t baseRatio;
+    
+    /**
+     *  Core perf limit reasons register of this model, 0 if unknown
+     */
+    const uint32_t perfLimitReasonsMSR;
+    
+    /**
+     *  Number of ratio limits in MSR_TURBO_RATIO_LIMIT in use, 0 if there is none
+     */
+    const uint8_t turboRatioBins;
+    
+    /**
+     *  @return true if the model has quirk
+     */
+    bool hasQuirk(const ModelQuirk quirk) const { return descriptor && (descriptor->quirks & quirk); }
+    
+    /**
+     *  @return true if the model has reg, unknown models are assumed to and left to the probe
+     */
+    bool hasModelRegister(const ModelRegister reg) const { return !descriptor || (descriptor->registers & reg); }
+    
+    /**
+     *  @return true if the model is known to have MSR_UNCORE_RATIO_LIMIT
+     */
+    bool hasUncoreRatioLimit(void) const { return descriptor && descriptor->uncoreRatio; }
+    
+    /**
+     *  @return true if the model is known to have the overclocking mailbox
+     */
+    bool hasOCMailbox(void) const { return descriptor && descriptor->ocMailbox; }
+    
     /**
      *  Get current CPU model.
      *
@@ -71,12 +143,30 @@ public:
      */
     const uint8_t getCPUModel(void) const;
     
+    const uint8_t getCPUFamily(void) const;
+    
+    const uint8_t getCPUStepping(void) const;
+    
     const bool supportedSpeedShift(void) const;
     
+    const uint32_t getPowerManagementFeatures(void) const;
+    
     const uint8_t getCoreCount(void) const;
     
+    const uint16_t getThreadCount(void) const;
+    
     const bool getTurboRatioLimitRW(void) const;
     
+    const bool supportedPowerLimit(void) const;
+    
+    const bool supportedEffectiveFrequency(void) const;
+    
+    const uint8_t getBaseRatio(void) const;
+    
+    const uint32_t getPerfLimitReasonsMSR(void) const;
+    
+    const uint8_t getTurboRatioBins(void) const;
+    
     /**
     *  Intel CPU models as returned by CPUID
     *  The list is synchronised and updated with XNU source code (osfmk/i386/cpuid.h).
@@ -0,0 +1,117 @@
+//
+//  CPUModelTable.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef CPUModelTable_hpp
+#define CPUModelTable_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  Model specific registers a model has beyond the architectural ones
+ */
+enum ModelRegister : uint16_t {
+    kModelRegNone       = 0,
+    kModelRegTurboRatio = 1 << 0,   // MSR_TURBO_RATIO_LIMIT
+    kModelRegPowerCtl   = 1 << 1,   // MSR_POWER_CTL
+    kModelRegRAPL       = 1 << 2,   // RAPL energy counters
+    kModelRegHWP        = 1 << 3,   // IA32_PM_ENABLE and the HWP registers
+    kModelRegLimit      = 1 << 4,   // MSR_CORE_PERF_LIMIT_REASONS (0x64F)
+    kModelRegLimitHSW   = 1 << 5,   // MSR_CORE_PERF_LIMIT_REASONS (0x690)
+};
+
+/**
+ *  What the bytes of MSR_TURBO_RATIO_LIMIT stand for
+ */
+enum TurboRatioEncoding : uint8_t {
+    kTurboRatioNone,
+    kTurboRatioPerCore, // byte n is the limit with n + 1 active cores
+    kTurboRatioGroups,  // byte n is the limit of group n, group sizes in MSR_TURBO_RATIO_LIMIT1
+};
+
+/**
+ *  Known misbehaviour of a model
+ */
+enum ModelQuirk : uint16_t {
+    kQuirkNone          = 0,
+    // rearming the timer through the sender of the timer action panics (MacBookPro8,2)
+    kQuirkTimerSender   = 1 << 0,
+};
+
+struct ModelDescriptor {
+    uint8_t family;
+    uint8_t model;
+    // first stepping the descriptor applies to
+    uint8_t stepping;
+    const char *name;
+    uint16_t registers;
+    TurboRatioEncoding turboRatio;
+    // MSR_UNCORE_RATIO_LIMIT (0x620)
+    bool uncoreRatio;
+    // overclocking mailbox (0x150)
+    bool ocMailbox;
+    const char *defaultProfile;
+    uint16_t quirks;
+
+    constexpr uint32_t key() const {
+        return (static_cast<uint32_t>(family) << 16) | (static_cast<uint32_t>(model) << 8) | stepping;
+    }
+};
+
+/**
+ *  Descriptors of the known models, generated from CPUModels.def
+ */
+static constexpr ModelDescriptor kModelTable[] {
+#define CPU_MODEL(family, model, stepping, name, registers, turboRatio, uncoreRatio, ocMailbox, profile, quirks) \
+    { family, model, stepping, name, static_cast<uint16_t>(registers), turboRatio, uncoreRatio, ocMailbox, profile, static_cast<uint16_t>(quirks) },
+#include "CPUModels.def"
+#undef CPU_MODEL
+};
+
+static constexpr size_t kModelTableSize = sizeof(kModelTable) / sizeof(kModelTable[0]);
+
+constexpr bool isModelTableSorted() {
+    for (size_t i = 1; i < kModelTableSize; i++) {
+        if (kModelTable[i - 1].key() >= kModelTable[i].key()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(isModelTableSorted(), "CPUModels.def must be sorted by family, model and stepping");
+
+/**
+ *  Find the descriptor of a cpu by binary search
+ *
+ *  @param family    display family
+ *  @param model     display model
+ *  @param stepping  stepping
+ *
+ *  @return the row of the model with the highest stepping not above stepping, nullptr if the model is unknown
+ */
+constexpr const ModelDescriptor *findModel(const uint8_t family, const uint8_t model, const uint8_t stepping) {
+    const uint32_t key = (static_cast<uint32_t>(family) << 16) | (static_cast<uint32_t>(model) << 8) | stepping;
+    // first row with a larger key
+    size_t lo = 0;
+    size_t hi = kModelTableSize;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (kModelTable[mid].key() <= key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return nullptr;
+    }
+    const ModelDescriptor *row = &kModelTable[lo - 1];
+    return row->family == family && row->model == model ? row : nullptr;
+}
+
+#endif /* CPUModelTable_hpp */
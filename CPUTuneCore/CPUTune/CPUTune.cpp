@@ -9,10 +9,18 @@
 #include <CPUTune.hpp>
 #include <CPUInfo.hpp>
 #include <SIPTune.hpp>
+#include <MSRBackend.hpp>
 #include <kern_util.hpp>
 #include <IOKit/IOTimerEventSource.h>
 #include <sys/errno.h>
 
+constexpr MsrUpdate<msr::MiscEnable> CPUTune::kEnableTurboBoost;
+constexpr MsrUpdate<msr::MiscEnable> CPUTune::kDisableTurboBoost;
+constexpr MsrUpdate<msr::PMEnable> CPUTune::kEnableSpeedShift;
+constexpr MsrUpdate<msr::PMEnable> CPUTune::kDisableSpeedShift;
+constexpr MsrUpdate<msr::PowerCtl> CPUTune::kDisableProcHot;
+constexpr MsrUpdate<msr::PowerCtl> CPUTune::kEnableProcHot;
+
 OSDefineMetaClassAndStructors(CPUTune, IOService)
 
 IOService *CPUTune::probe(IOService *provider, SInt32 *score) {
@@ -47,31 +55,117 @@ bool CPUTune::init(OSDictionary *dict)
         return false;
     }
     
+    const bool simulate = checkKernelArgument(bootargSimulate);
+    if (simulate) {
+        uint32_t timeScale = 1;
+        if (OSNumber *scale = OSDynamicCast(OSNumber, getProperty("SimulatorTimeScale"))) {
+            timeScale = scale->unsigned32BitValue();
+        }
+        if (simulatedMSR.init(cpu_info, timeScale)) {
+            LOG("simulator enabled, MSR accesses will not reach the processor");
+            backend = &simulatedMSR;
+            simulating = true;
+            simulatorLoadSource.path = getStringPropertyOrElse("SimulatorLoadPath", nullptr);
+        } else {
+            LOG("failed to set up the simulator, fall back to the dry run");
+        }
+    }
+    if (!simulating && (simulate || checkKernelArgument(bootargDryRun))) {
+        LOG("dry run enabled, MSR writes will not reach the processor");
+        backend = &dryRunMSR;
+        dryRun = true;
+    }
+    
+    // below the probe, so that refused accesses never reach the published state
+    if (stateCache.init(backend)) {
+        backend = &stateCache;
+    } else {
+        LOG("failed to create state cache, continue without it");
+    }
+    
+    // find out which registers exist before the first one is read
+    if (msrProbe.init(backend, cpu_info)) {
+        backend = &msrProbe;
+    } else {
+        LOG("failed to publish the probed registers, continue without refusing accesses");
+    }
+    
     // get string properties
-    ProcHotPath = getStringPropertyOrElse("ProcHotAtRuntime", nullptr);
-    turboBoostPath = getStringPropertyOrElse("TurboBoostAtRuntime", nullptr);
-    speedShiftPath = getStringPropertyOrElse("SpeedShiftAtRuntime", nullptr);
-    hwpRequestConfigPath = getStringPropertyOrElse("HWPRequestConfigPath", nullptr);
-    turboRatioLimitConfigPath = getStringPropertyOrElse("TurboRatioLimitConfigPath", nullptr);
+    procHotSource.path = getStringPropertyOrElse("ProcHotAtRuntime", nullptr);
+    turboBoostSource.path = getStringPropertyOrElse("TurboBoostAtRuntime", nullptr);
+    speedShiftSource.path = getStringPropertyOrElse("SpeedShiftAtRuntime", nullptr);
+    hwpRequestSource.path = getStringPropertyOrElse("HWPRequestConfigPath", nullptr);
+    turboRatioLimitSource.path = getStringPropertyOrElse("TurboRatioLimitConfigPath", nullptr);
+    transactionSource.path = getStringPropertyOrElse("TransactionConfigPath", nullptr);
     // get boolean properties
     enableIntelTurboBoost = getBooleanOrElse("EnableTurboBoost", false);
     enableIntelProcHot = getBooleanOrElse("EnableProcHot", false);
     enableIntelSpeedShift = getBooleanOrElse("EnableSpeedShift", false);
     allowUnrestrictedFS = getBooleanOrElse("AllowUnrestrictedFS", false);
+    enableTelemetry = getBooleanOrElse("EnableTelemetry", true);
+    metricsPath = getStringPropertyOrElse("MetricsPath", nullptr);
+    telemetryLogPath = getStringPropertyOrElse("TelemetryLogPath", nullptr);
+    if (OSNumber *samples = OSDynamicCast(OSNumber, getProperty("TelemetryLogBlockSamples"))) {
+        telemetryLogBlockSamples = samples->unsigned32BitValue();
+    }
+    if (OSNumber *ticks = OSDynamicCast(OSNumber, getProperty("SweepDwellTicks"))) {
+        sweepDwellTicks = ticks->unsigned32BitValue();
+    }
+    sweepResultPath = getStringPropertyOrElse("SweepResultPath", nullptr);
+    experimentSource.path = getStringPropertyOrElse("ExperimentConfigPath", nullptr);
+    experimentCounterSource.path = getStringPropertyOrElse("ExperimentCounterPath", nullptr);
+    registerDumpPath = getStringPropertyOrElse("RegisterDumpPath", nullptr);
+    registerDumpTriggerSource.path = getStringPropertyOrElse("RegisterDumpTriggerPath", nullptr);
+    measureTransitionLatency = getBooleanOrElse("MeasureTransitionLatency", false);
+    if (OSNumber *timeout = OSDynamicCast(OSNumber, getProperty("TransitionTimeoutUs"))) {
+        transitionTimeoutUs = timeout->unsigned32BitValue();
+        // the busy wait runs with interrupts disabled
+        if (transitionTimeoutUs > TransitionLatency::kMaxTimeoutUs) {
+            LOG("TransitionTimeoutUs %u is too long, use %u", transitionTimeoutUs, TransitionLatency::kMaxTimeoutUs);
+            transitionTimeoutUs = TransitionLatency::kMaxTimeoutUs;
+        }
+    }
     
     if (OSNumber *timeout = OSDynamicCast(OSNumber, getProperty("UpdateInterval"))) {
         updateInterval = timeout->unsigned32BitValue();
         LOG("Update time interval %u ms per cycle", updateInterval);
     }
     
-    org_MSR_IA32_MISC_ENABLE = rdmsr64(MSR_IA32_MISC_ENABLE);
-    org_MSR_IA32_PERF_CTL = rdmsr64(MSR_IA32_PERF_CTL);
-    org_MSR_IA32_POWER_CTL = rdmsr64(MSR_IA32_POWER_CTL);
-    if (cpu_info.supportedHWP) {
-        // Do not read MSR_IA32_HWP_REQUEST on unsupported HWP's CPU (otherwise will cause panic)
-        org_HWPRequest = rdmsr64(MSR_IA32_HWP_REQUEST);
+    // record every MSR access from now on if a trace is requested
+    msrTracePath = getStringPropertyOrElse("MSRTracePath", nullptr);
+    chromeTracePath = getStringPropertyOrElse("ChromeTracePath", nullptr);
+    if (msrTracePath || chromeTracePath) {
+        if (OSNumber *capacity = OSDynamicCast(OSNumber, getProperty("MSRTraceCapacity"))) {
+            msrTraceCapacity = capacity->unsigned32BitValue();
+        }
+        if (msrTrace.init(backend, msrTraceCapacity)) {
+            backend = &msrTrace;
+            LOG("recording up to %u MSR accesses to %s%s%s", msrTraceCapacity,
+                msrTracePath ? msrTracePath : "", msrTracePath && chromeTracePath ? " and " : "",
+                chromeTracePath ? chromeTracePath : "");
+        } else {
+            LOG("failed to set up MSR trace, continue without recording");
+            msrTracePath = nullptr;
+            chromeTracePath = nullptr;
+        }
+    }
+    
+    // the reads below fill the state cache with the initial register values
+    org_MSR_IA32_MISC_ENABLE = backend->read(MSR_IA32_MISC_ENABLE);
+    org_MSR_IA32_PERF_CTL = backend->read(MSR_IA32_PERF_CTL);
+    org_MSR_IA32_POWER_CTL = backend->read(MSR_IA32_POWER_CTL);
+    if (msrProbe.isReadable(MSR_IA32_HWP_REQUEST)) {
+        // probed, reading MSR_IA32_HWP_REQUEST on a cpu without HWP would panic
+        org_HWPRequest = backend->read(MSR_IA32_HWP_REQUEST);
+        org_MSR_IA32_PM_ENABLE = backend->read(MSR_IA32_PM_ENABLE);
+    }
+    org_TurboRatioLimit = backend->read(MSR_TURBO_RATIO_LIMIT);
+    
+    if (OSArray *declarations = OSDynamicCast(OSArray, getProperty("Knobs"))) {
+        if (!knobs.init(declarations, backend, msrProbe, cpu_info.threadCount)) {
+            LOG("no usable knob declared, continue without declared knobs");
+        }
     }
-    org_TurboRatioLimit = rdmsr64(MSR_TURBO_RATIO_LIMIT);
     
     LOG("succeeded!");
     return true;
@@ -119,6 +213,92 @@ bool CPUTune::start(IOService *provider)
         return false;
     }
     
+    if (tickStats.init()) {
+        setProperty("TickStats", tickStats.getDictionary());
+    } else {
+        LOG("failed to create tick statistics, continue without them");
+    }
+    
+    if (msrProbe.getDictionary()) {
+        setProperty("Probe", msrProbe.getDictionary());
+    }
+    
+    if (simulating) {
+        setProperty("Simulator", simulatedMSR.getDictionary());
+    }
+    
+    if (stateCache.getDictionary()) {
+        setProperty("State", stateCache.getDictionary());
+    }
+    
+    if (knobs.getDictionary()) {
+        setProperty("Knobs", knobs.getDictionary());
+    }
+    
+    // a profile is applied and reported like a transaction
+    OSDictionary *profiles = OSDynamicCast(OSDictionary, getProperty("Profiles"));
+    if (transactionSource.path || profiles) {
+        if (transaction.init(&knobs)) {
+            setProperty("LastApply", transaction.getDictionary());
+        } else {
+            LOG("failed to create transaction status, continue without it");
+        }
+    }
+    
+    if (enableTelemetry) {
+        if (telemetry.init(backend, cpu_info)) {
+            setProperty("Telemetry", telemetry.getDictionary());
+            if (simulating) {
+                // a tick lasts as long as the simulator advances per tick
+                telemetry.setFixedInterval(static_cast<uint64_t>(updateInterval) * simulatedMSR.getTimeScale() * 1000000);
+            }
+            if (metricsPath && !metrics.init(telemetry.getCPUCount())) {
+                LOG("failed to allocate the metrics buffer, continue without exporting");
+                metricsPath = nullptr;
+            }
+            if (telemetryLogPath) {
+                if (telemetryLog.init(telemetryLogPath, telemetry, telemetryLogBlockSamples, updateInterval)) {
+                    LOG("logging telemetry to %s in blocks of %u samples", telemetryLogPath, telemetryLogBlockSamples);
+                } else {
+                    LOG("failed to set up the telemetry log, continue without it");
+                    telemetryLogPath = nullptr;
+                }
+            }
+            if (sweepDwellTicks && msrProbe.isWritable(MSR_IA32_HWP_REQUEST)) {
+                if (sweep.init(backend, decodeHWPCapabilities(backend->read(MSR_IA32_HWP_CAPABILITIES), cpu_info.powerManagementFeatures), sweepDwellTicks,
+                               cpu_info.threadCount)) {
+                    setProperty("Sweep", sweep.getDictionary());
+                } else {
+                    LOG("failed to set up the ratio sweep, continue without it");
+                    sweepDwellTicks = 0;
+                }
+            }
+            if (experimentSource.path && msrProbe.isWritable(MSR_IA32_HWP_REQUEST)) {
+                if (experiment.init(cpu_info.threadCount)) {
+                    setProperty("Experiment", experiment.getDictionary());
+                } else {
+                    LOG("failed to set up A/B experiments, continue without them");
+                    experimentSource.path = nullptr;
+                }
+            }
+        } else {
+            LOG("failed to set up telemetry, continue without it");
+        }
+    }
+    
+    // the ratio is polled from IA32_PERF_STATUS of the processor, which a request
+    // that does not reach it never moves
+    if (measureTransitionLatency && (dryRun || simulating)) {
+        LOG("transition latency is only measured on the hardware, continue without it");
+    } else if (measureTransitionLatency) {
+        if (transitionLatency.init(transitionTimeoutUs)) {
+            setProperty("TransitionLatency", transitionLatency.getDictionary());
+            LOG("measuring frequency transition latency, busy wait up to %u us per request", transitionTimeoutUs);
+        } else {
+            LOG("failed to set up transition latency measurement, continue without it");
+        }
+    }
+    
     timerSource->setTimeoutMS(updateInterval);
     
     // check if we need to enable Intel Turbo Boost
@@ -136,7 +316,7 @@ bool CPUTune::start(IOService *provider)
     }
     
     // check if we need to enable Intel Speed Shift on platform on Skylake+
-    if (cpu_info.supportedHWP) {
+    if (msrProbe.isWritable(MSR_IA32_PM_ENABLE)) {
         if (!hwpEnableOnceSet && enableIntelSpeedShift) {
             // Note this bit can only be enabled once from the default value.
             // Once set, writes to the HWP_ENABLE bit are ignored. Only RESET
@@ -148,6 +328,62 @@ bool CPUTune::start(IOService *provider)
         LOG("cpu model (0x%x) does not support Intel SpeedShift.", cpu_info.model);
     }
     
+    // turbo ratio limits are per package, the cap is written to the ratio ceiling instead
+    FrequencyCap::Mechanism mechanism = FrequencyCap::kMechanismNone;
+    if (msrProbe.isWritable(MSR_TURBO_RATIO_LIMIT)) {
+        mechanism = FrequencyCap::kMechanismTurboRatioLimit;
+    } else if (msrProbe.isReadable(MSR_TURBO_RATIO_LIMIT) && cpu_info.turboRatioBins > 0) {
+        if (msrProbe.isWritable(MSR_IA32_HWP_REQUEST) && msr::HWPEnable::extract(backend->read(MSR_IA32_PM_ENABLE))) {
+            mechanism = FrequencyCap::kMechanismHWPMaximum;
+        } else if (msrProbe.isWritable(MSR_IA32_PERF_CTL)) {
+            mechanism = FrequencyCap::kMechanismPerfCtl;
+        }
+    }
+    if (frequencyCap.init(backend, mechanism, backend->read(MSR_TURBO_RATIO_LIMIT), cpu_info.turboRatioBins, cpu_info.coreCount,
+                          cpu_info.threadCount)) {
+        setProperty("FrequencyCap", frequencyCap.getDictionary());
+    } else {
+        LOG("failed to set up the frequency cap, continue without it");
+    }
+    
+    if (OSArray *declarations = OSDynamicCast(OSArray, getProperty("CoreSets"))) {
+        const HWPCapabilities caps = decodeHWPCapabilities(backend->read(MSR_IA32_HWP_CAPABILITIES), cpu_info.powerManagementFeatures);
+        // SMT siblings with different requests are logged unless CoreSetSiblings is "merge"
+        const char *siblings = getStringPropertyOrElse("CoreSetSiblings", "warn");
+        if (topology.init(cpu_info) &&
+            coreSets.init(declarations, backend, msrProbe, topology, caps, strcmp(siblings, "merge") == 0)) {
+            setProperty("CoreSets", coreSets.getDictionary());
+            setProperty("Siblings", coreSets.getSiblingDictionary());
+            coreSets.apply();
+            if (coreSets.getHWPCPUs() && hwpRequestSource.path) {
+                LOG("ignore %s: core sets manage IA32_HWP_REQUEST", hwpRequestSource.path);
+            }
+        } else {
+            LOG("no usable core sets, continue without them");
+        }
+    }
+    
+    if (profiles && transaction.getDictionary()) {
+        // the default profile of the model (CPUModels.def) unless one is named
+        const char *name = getStringPropertyOrElse("Profile", cpu_info.descriptor ? cpu_info.descriptor->defaultProfile : nullptr);
+        if (profile.resolve(profiles, name, cpu_info, transaction)) {
+            setProperty("ActiveProfile", name);
+            transaction.load(profile.getOperations(), profile.getOperationCount(), 0);
+            applyOperations();
+        }
+    }
+    
+    if (registerDumpPath) {
+        if (registerDump.init(backend, cpu_info, msrProbe)) {
+            if (registerDump.capture()) {
+                registerDump.save(registerDumpPath);
+            }
+        } else {
+            LOG("failed to set up the register dump, continue without it");
+            registerDumpPath = nullptr;
+        }
+    }
+    
     LOG("registerService");
     registerService();
     return true;
@@ -155,149 +391,439 @@ bool CPUTune::start(IOService *provider)
 
 void CPUTune::readConfigAtRuntime(OSObject *owner, IOTimerEventSource *sender)
 {
-    // FIXME: As per Apple Document (https://developer.apple.com/library/archive/documentation/DeviceDrivers/Conceptual/IOKitFundamentals/HandlingEvents/HandlingEvents.html#//apple_ref/doc/uid/TP0000018-BAJFFJAD Listing 7-5):
+    // As per Apple Document (https://developer.apple.com/library/archive/documentation/DeviceDrivers/Conceptual/IOKitFundamentals/HandlingEvents/HandlingEvents.html#//apple_ref/doc/uid/TP0000018-BAJFFJAD Listing 7-5):
     // Events originating from timers are handled by the driver’s Action routine.
     // As with other event handlers, this routine should never block indefinitely.
     // This specifically means that timer handlers, and any function they invoke,
     // must not allocate memory or create objects, as allocation can block for unbounded periods of time.
-    // As for now, the reading procedure reads only one byte, which is fairly fast in our case, so we assume
-    // this routine will not cause infinite blocking. Let me know if you have some other good ideas.
-    if (turboBoostPath) {
-        if (uint8_t *buffer = readFileAsBytes(turboBoostPath, 0, 1)) {
-            if (*buffer == '1') {
-                enableTurboBoost();
-            } else {
-                disableTurboBoost();
+    // Config files are therefore read into the fixed buffers of their ConfigSource, and only when
+    // the file changed since the previous tick.
+    tickStats.beginTick();
+    if (simulating) {
+        if (simulatorLoadSource.path && simulatorLoadSource.refresh(ConfigSource::kMaxLength)) {
+            const char *content = simulatorLoadSource.getContent();
+            if (!content || !simulatedMSR.setLoadTrace(content, simulatorLoadSource.getLength())) {
+                LOG("simulator: use the synthetic load");
+                simulatedMSR.resetLoadTrace();
+            }
+        }
+        simulatedMSR.advance(updateInterval * simulatedMSR.getTimeScale());
+    }
+    telemetry.sample();
+    if (msrTrace.isRecording()) {
+        for (uint32_t cpu = 0; cpu < telemetry.getCPUCount(); cpu++) {
+            msrTrace.recordFrequency(static_cast<uint16_t>(cpu), telemetry.getEffectiveFrequencyMHz(cpu));
+        }
+    }
+    if (telemetryLogPath) {
+        telemetryLog.append(telemetry);
+    }
+    if (sweepDwellTicks) {
+        const bool wasRunning = sweep.isRunning();
+        sweep.tick(telemetry, coreSets.getHWPCPUs());
+        if (wasRunning && !sweep.isRunning() && sweepResultPath) {
+            sweep.save(sweepResultPath);
+        }
+    }
+    if (experimentSource.path) {
+        // the workload writes its progress as a decimal number
+        uint64_t counter = 0;
+        bool hasCounter = false;
+        if (experimentCounterSource.path) {
+            experimentCounterSource.refresh(32);
+            hasCounter = experimentCounterSource.getContent() &&
+                         parseUInt64(experimentCounterSource.getContent(), experimentCounterSource.getLength(), 10, &counter).status == kParseOK;
+        }
+        experiment.tick(telemetry, hasCounter, counter, coreSets.getHWPCPUs());
+    }
+    if (metricsPath && metrics.render(telemetry, stateCache.getWriteCount(), tickStats.getTicks())) {
+        metrics.save(metricsPath);
+    }
+    
+    uint32_t changedSources = 0;
+    uint32_t unchangedSources = 0;
+    // "0\n" plus room for a stray CR or spaces
+    constexpr size_t kSwitchLength = 16;
+    auto refresh = [&](ConfigSource &source, size_t bytes) -> const char * {
+        if (!source.path) {
+            return nullptr;
+        }
+        if (source.refresh(bytes)) {
+            changedSources++;
+        } else {
+            unchangedSources++;
+        }
+        return source.getContent();
+    };
+    
+    // a batch is applied once when it changes, the single knob files below on every tick
+    if (transactionSource.path) {
+        if (transactionSource.refresh(ConfigSource::kMaxLength)) {
+            changedSources++;
+            if (transactionSource.getContent()) {
+                applyTransaction();
             }
-            deleter(buffer);
+        } else {
+            unchangedSources++;
+        }
+    }
+    
+    if (experimentSource.path) {
+        if (experimentSource.refresh(ConfigSource::kMaxLength)) {
+            changedSources++;
+            startExperiment();
+        } else {
+            unchangedSources++;
+        }
+    }
+    
+    // like a batch, a declared knob is applied once when its file changes
+    knobs.refresh(changedSources, unchangedSources);
+    
+    // only the cpus of sets whose policy changed are written
+    coreSets.refresh(changedSources, unchangedSources);
+    coreSets.apply();
+    // the bandwidth feedback loop runs with the rest of the telemetry
+    if (enableTelemetry) {
+        coreSets.control();
+    }
+    
+    // new content in the trigger file (e.g. a timestamp) asks for a fresh dump
+    if (registerDumpPath && registerDumpTriggerSource.path) {
+        if (registerDumpTriggerSource.refresh(kSwitchLength)) {
+            changedSources++;
+            if (registerDumpTriggerSource.getContent() && registerDump.capture()) {
+                registerDump.save(registerDumpPath);
+            }
+        } else {
+            unchangedSources++;
+        }
+    }
+    
+    bool enable = false;
+    if (refresh(turboBoostSource, kSwitchLength) && parseSwitch(turboBoostSource, &enable)) {
+        if (enable) {
+            enableTurboBoost();
+        } else {
+            disableTurboBoost();
         }
     }
     
     // Turbo ratio limit
-    if ((rdmsr64(MSR_IA32_MISC_ENABLE) & kEnableTurboBoostBits) && cpu_info.turboRatioLimitRW && turboRatioLimitConfigPath) {
-        size_t valid_length = cpu_info.coreCount * 2 + 2; // +2 for '0x'/'0X'
-        if (uint8_t* config = readFileAsBytes(turboRatioLimitConfigPath, 0, valid_length)) {
-            long limit = hexToInt(reinterpret_cast<char*>(config));
-            deleter(config);
-            if (limit == ERANGE) {
-                LOG("Turbo ratio limit is not a valid hexadecimal constant at %s", limit, turboRatioLimitConfigPath);
-            } else {
-                uint64_t curLimit = rdmsr64(MSR_TURBO_RATIO_LIMIT);
-                uint64_t usrLimit = static_cast<uint64_t>(limit);
-                if (setIfNotEqual(curLimit, usrLimit, MSR_TURBO_RATIO_LIMIT)) {
-                    LOG("Change turbo ratio limit: 0x%llx -> 0x%llx", curLimit, usrLimit);
-                }
+    if (!msr::TurboModeDisable::extract(backend->read(msr::MiscEnable::address)) && msrProbe.isWritable(MSR_TURBO_RATIO_LIMIT)) {
+        if (refresh(turboRatioLimitSource, ConfigSource::kMaxLength)) {
+            uint64_t curLimit = backend->read(MSR_TURBO_RATIO_LIMIT);
+            uint64_t usrLimit = 0;
+            if (parseRegister(turboRatioLimitSource, kTurboRatioLimitFields, arrsize(kTurboRatioLimitFields), curLimit, &usrLimit) &&
+                usrLimit != curLimit &&
+                isValid(turboRatioLimitSource, usrLimit, validateTurboRatioLimit(usrLimit, cpu_info.turboRatioBins)) &&
+                setIfNotEqual(curLimit, usrLimit, MSR_TURBO_RATIO_LIMIT)) {
+                LOG("Change turbo ratio limit: 0x%llx -> 0x%llx", curLimit, usrLimit);
+            }
+        }
+    } else if (frequencyCap.isEmulating()) {
+        if (refresh(turboRatioLimitSource, ConfigSource::kMaxLength)) {
+            const uint64_t curLimit = frequencyCap.getLimits();
+            uint64_t usrLimit = 0;
+            if (parseRegister(turboRatioLimitSource, kTurboRatioLimitFields, arrsize(kTurboRatioLimitFields), curLimit, &usrLimit) &&
+                usrLimit != curLimit &&
+                isValid(turboRatioLimitSource, usrLimit, validateTurboRatioLimit(usrLimit, cpu_info.turboRatioBins))) {
+                frequencyCap.setLimits(usrLimit);
             }
         }
     }
 
-    if (ProcHotPath) {
-        if (uint8_t *buffer = readFileAsBytes(ProcHotPath, 0, 1)) {
-            if (*buffer == '1') {
-                enableProcHot();
-            } else {
-                disableProcHot();
-            }
-            deleter(buffer);
+    if (refresh(procHotSource, kSwitchLength) && parseSwitch(procHotSource, &enable)) {
+        if (enable) {
+            enableProcHot();
+        } else {
+            disableProcHot();
         }
     }
     
-    // set hwp request value if hwp is enable
-    if (cpu_info.supportedHWP && hwpRequestConfigPath) {
-        if (uint8_t *hex = readFileAsBytes(hwpRequestConfigPath, 0, 10)) {
-            // hex is not NULL means the hwp request config exist
-            // let's check if the hex is valid before writing to MSR
-            long req = hexToInt(reinterpret_cast<char*>(hex));
-            deleter(hex);
-            if (req == ERANGE) {
-                LOG("HWP Request %s is not a valid hexadecimal constant at %s", hex, hwpRequestConfigPath);
-            } else {
-                uint64_t curHWPRequest = rdmsr64(MSR_IA32_HWP_REQUEST);
-                uint64_t usrHWPRequest = static_cast<uint64_t>(req);
-                if (setIfNotEqual(curHWPRequest, usrHWPRequest, MSR_IA32_HWP_REQUEST)) {
-                    LOG("change MSR_IA32_HWP_REQUEST(0x%llx): 0x%llx -> 0x%llx", MSR_IA32_HWP_REQUEST, curHWPRequest, usrHWPRequest);
-                }
+    // set hwp request value if hwp is enable, a sweep or an experiment owns it while it runs,
+    // core sets for good once they wrote it (the timer may run on one of their cpus)
+    if (msrProbe.isWritable(MSR_IA32_HWP_REQUEST) && !sweep.isRunning() && !experiment.isRunning() && !coreSets.getHWPCPUs()) {
+        if (refresh(hwpRequestSource, ConfigSource::kMaxLength)) {
+            // the config exists, only write it to the MSR once it parsed
+            uint64_t curHWPRequest = backend->read(MSR_IA32_HWP_REQUEST);
+            uint64_t usrHWPRequest = 0;
+            const bool parsed = parseRegister(hwpRequestSource, kHWPRequestFields, arrsize(kHWPRequestFields), curHWPRequest, &usrHWPRequest);
+            const uint64_t givenHWPRequest = usrHWPRequest;
+            if (parsed) {
+                // the emulated turbo ratio limits cap the maximum of the config
+                usrHWPRequest = frequencyCap.capHWPRequest(usrHWPRequest);
+            }
+            if (parsed && curHWPRequest != usrHWPRequest &&
+                isValid(hwpRequestSource, usrHWPRequest,
+                        validateHWPRequest(usrHWPRequest, decodeHWPCapabilities(backend->read(MSR_IA32_HWP_CAPABILITIES), cpu_info.powerManagementFeatures)))) {
+                // IA32_HWP_REQUEST[31:24] Energy_Performance_Preference
+                transitionLatency.writeAndMeasure(backend, MSR_IA32_HWP_REQUEST, usrHWPRequest, static_cast<uint8_t>(usrHWPRequest >> 24));
+                frequencyCap.setUncapped(givenHWPRequest);
+                LOG("change MSR_IA32_HWP_REQUEST(0x%llx): 0x%llx -> 0x%llx", MSR_IA32_HWP_REQUEST, curHWPRequest, usrHWPRequest);
             }
         }
     }
     
-    if (!hwpEnableOnceSet && cpu_info.supportedHWP && speedShiftPath) {
-        if (uint8_t *buffer = readFileAsBytes(speedShiftPath, 0, 1)) {
-            if (*buffer == '1') {
+    if (!hwpEnableOnceSet && msrProbe.isWritable(MSR_IA32_PM_ENABLE)) {
+        if (refresh(speedShiftSource, kSwitchLength) && parseSwitch(speedShiftSource, &enable)) {
+            if (enable) {
                 enableSpeedShift();
             } else {
                 disableSpeedShift();
             }
-            deleter(buffer);
         }
     }
     
+    // after the HWP config, so the cap applies on top of it
+    frequencyCap.update(telemetry, sweep.isRunning() || experiment.isRunning(), coreSets.getHWPCPUs());
+    
+    tickStats.endTick(changedSources, unchangedSources);
+    if (msrTrace.isRecording()) {
+        msrTrace.recordTick(tickStats.getTickStart(), mach_absolute_time());
+    }
+    
     // restart the timer
     if (timerSource && !this->isInactive()) {
-        // Don't use sender here which will cause MBP8,2(SANDYBRIDGE) KP
-        timerSource->setTimeoutMS(updateInterval);
+        // Don't use sender on models with kQuirkTimerSender, it causes a MBP8,2(SANDYBRIDGE) KP
+        IOTimerEventSource *timer = cpu_info.hasQuirk(kQuirkTimerSender) || !sender ? timerSource : sender;
+        timer->setTimeoutMS(updateInterval);
     }
 }
 
 bool CPUTune::setIfNotEqual(const uint64_t current, const uint64_t expect, const uint32_t msr) const {
     bool needWrite = current != expect;
     if (needWrite) {
-        wrmsr64(msr, expect);
+        backend->write(msr, expect);
     }
     return needWrite;
 }
 
+bool CPUTune::parseSwitch(const ConfigSource &source, bool *enable) const {
+    uint64_t value = 0;
+    ParseResult result = parseUInt64(source.getContent(), source.getLength(), 10, &value);
+    if (result.status == kParseOK && value > 1) {
+        result.status = kParseInvalidDigit;
+        result.offset = 0;
+    }
+    if (source.isTruncated() || result.status != kParseOK) {
+        LOG("ignore %s: expect 0 or 1 (%s at offset %lu)", source.path,
+            source.isTruncated() ? "file too long" : parseStatusToString(result.status), result.offset);
+        return false;
+    }
+    *enable = value == 1;
+    return true;
+}
+
+bool CPUTune::parseRegister(const ConfigSource &source, const ConfigField *fields, const size_t fieldCount,
+                            const uint64_t current, uint64_t *value) const {
+    if (source.isTruncated()) {
+        LOG("ignore %s: longer than %lu bytes", source.path, ConfigSource::kMaxLength);
+        return false;
+    }
+    uint64_t given = 0;
+    uint64_t mask = 0;
+    const ParseResult result = parseRegisterConfig(source.getContent(), source.getLength(), fields, fieldCount, &given, &mask);
+    if (result.status != kParseOK) {
+        LOG("ignore %s: %s at offset %lu", source.path, parseStatusToString(result.status), result.offset);
+        return false;
+    }
+    // fields that are not given keep their current value
+    *value = (current & ~mask) | (given & mask);
+    return true;
+}
+
+bool CPUTune::isValid(const ConfigSource &source, const uint64_t value, const ValidateStatus status) const {
+    if (status != kValidateOK) {
+        LOG("refuse 0x%llx from %s: %s", value, source.path, validateStatusToString(status));
+        return false;
+    }
+    return true;
+}
+
+void CPUTune::applyTransaction() {
+    if (transaction.parse(transactionSource.getContent(), transactionSource.getLength(), transactionSource.isTruncated())) {
+        applyOperations();
+    }
+}
+
+void CPUTune::applyOperations() {
+    // resolve and validate every knob before the first write
+    const size_t count = transaction.getOperationCount();
+    uint64_t values[Transaction::kMaxOperations] {};
+    // the HWP request before the cap of the emulated turbo ratio limits
+    uint64_t givenHWPRequest = 0;
+    for (size_t i = 0; i < count; i++) {
+        const Transaction::Operation &op = transaction.getOperation(i);
+        ValidateStatus status = kValidateOK;
+        switch (op.knob) {
+            case Transaction::kHWPRequest: {
+                if (!msrProbe.isWritable(MSR_IA32_HWP_REQUEST) || sweep.isRunning() || experiment.isRunning() || coreSets.getHWPCPUs()) {
+                    transaction.reject(op.line, Transaction::kUnsupported);
+                    return;
+                }
+                givenHWPRequest = (backend->read(MSR_IA32_HWP_REQUEST) & ~op.mask) | op.value;
+                // like the HWP config, capped by the emulated turbo ratio limits
+                values[i] = frequencyCap.capHWPRequest(givenHWPRequest);
+                status = validateHWPRequest(values[i], decodeHWPCapabilities(backend->read(MSR_IA32_HWP_CAPABILITIES), cpu_info.powerManagementFeatures));
+                break;
+            }
+            case Transaction::kTurboRatioLimit: {
+                if (!msrProbe.isWritable(MSR_TURBO_RATIO_LIMIT) && !frequencyCap.isEmulating()) {
+                    transaction.reject(op.line, Transaction::kUnsupported);
+                    return;
+                }
+                const uint64_t cur = frequencyCap.isEmulating() ? frequencyCap.getLimits() : backend->read(MSR_TURBO_RATIO_LIMIT);
+                values[i] = (cur & ~op.mask) | op.value;
+                status = validateTurboRatioLimit(values[i], cpu_info.turboRatioBins);
+                break;
+            }
+            case Transaction::kSpeedShift:
+                if (!msrProbe.isWritable(MSR_IA32_PM_ENABLE)) {
+                    transaction.reject(op.line, Transaction::kUnsupported);
+                    return;
+                }
+                values[i] = op.value;
+                break;
+            case Transaction::kGenericKnob:
+                values[i] = op.value;
+                status = knobs.validate(op.index, values[i]);
+                break;
+            default:
+                values[i] = op.value;
+                break;
+        }
+        if (status != kValidateOK) {
+            transaction.reject(op.line, Transaction::kInvalidValue, status);
+            return;
+        }
+    }
+    
+    for (size_t i = 0; i < count; i++) {
+        const Transaction::Operation &op = transaction.getOperation(i);
+        switch (op.knob) {
+            case Transaction::kTurboBoost:
+                values[i] ? enableTurboBoost() : disableTurboBoost();
+                break;
+            case Transaction::kProcHot:
+                values[i] ? enableProcHot() : disableProcHot();
+                break;
+            case Transaction::kSpeedShift:
+                // HWP_ENABLE can only be set once, see start()
+                if (!hwpEnableOnceSet) {
+                    values[i] ? enableSpeedShift() : disableSpeedShift();
+                }
+                break;
+            case Transaction::kHWPRequest: {
+                const uint64_t cur = backend->read(MSR_IA32_HWP_REQUEST);
+                if (cur != values[i]) {
+                    transitionLatency.writeAndMeasure(backend, MSR_IA32_HWP_REQUEST, values[i], static_cast<uint8_t>(values[i] >> 24));
+                }
+                frequencyCap.setUncapped(givenHWPRequest);
+                break;
+            }
+            case Transaction::kTurboRatioLimit:
+                if (frequencyCap.isEmulating()) {
+                    frequencyCap.setLimits(values[i]);
+                } else {
+                    setIfNotEqual(backend->read(MSR_TURBO_RATIO_LIMIT), values[i], MSR_TURBO_RATIO_LIMIT);
+                }
+                break;
+            case Transaction::kGenericKnob:
+                knobs.apply(op.index, values[i]);
+                break;
+        }
+    }
+    transaction.commit();
+}
+
+void CPUTune::startExperiment() {
+    experiment.stop();
+    if (!experimentSource.getContent()) {
+        return;
+    }
+    if (experimentSource.isTruncated()) {
+        LOG("refuse %s: longer than %lu bytes", experimentSource.path, ConfigSource::kMaxLength);
+        return;
+    }
+    if (sweep.isRunning()) {
+        LOG("refuse %s: the ratio sweep is running", experimentSource.path);
+        return;
+    }
+    if (coreSets.getHWPCPUs()) {
+        LOG("refuse %s: core sets manage IA32_HWP_REQUEST", experimentSource.path);
+        return;
+    }
+    ABExperiment::Plan plan {};
+    if (!ABExperiment::parse(experimentSource.getContent(), experimentSource.getLength(), &plan)) {
+        return;
+    }
+    // the arms change the given fields of every cpu, validated against this one
+    const uint64_t cur = backend->read(MSR_IA32_HWP_REQUEST);
+    const HWPCapabilities caps = decodeHWPCapabilities(backend->read(MSR_IA32_HWP_CAPABILITIES), cpu_info.powerManagementFeatures);
+    uint64_t requests[2] {};
+    for (size_t i = 0; i < 2; i++) {
+        requests[i] = (cur & ~plan.mask[i]) | plan.value[i];
+        if (!isValid(experimentSource, requests[i], validateHWPRequest(requests[i], caps))) {
+            return;
+        }
+    }
+    experiment.start(backend, plan, experimentCounterSource.path != nullptr);
+}
+
 void CPUTune::enableTurboBoost()
 {
-    const uint64_t cur = rdmsr64(MSR_IA32_MISC_ENABLE);
+    const uint64_t cur = backend->read(msr::MiscEnable::address);
     // flip bit 38 to 0
-    const uint64_t val = cur & kEnableTurboBoostBits;
-    if (setIfNotEqual(cur, val, MSR_IA32_MISC_ENABLE)) {
-        LOG("change 0x%llx to 0x%llx in MSR_IA32_MISC_ENABLE(0x%llx)", cur, val, MSR_IA32_MISC_ENABLE);
+    const uint64_t val = kEnableTurboBoost.apply(cur);
+    if (setIfNotEqual(cur, val, msr::MiscEnable::address)) {
+        LOG("change 0x%llx to 0x%llx in MSR_IA32_MISC_ENABLE(0x%x)", cur, val, msr::MiscEnable::address);
     }
 }
 
 void CPUTune::disableTurboBoost()
 {
-    const uint64_t cur = rdmsr64(MSR_IA32_MISC_ENABLE);
+    const uint64_t cur = backend->read(msr::MiscEnable::address);
     // flip bit 38 to 1
-    const uint64_t val = cur | kDisableTurboBoostBits;
-    if (setIfNotEqual(cur, val, MSR_IA32_MISC_ENABLE)) {
-        LOG("change 0x%llx to 0x%llx in MSR_IA32_MISC_ENABLE(0x%llx)", cur, val, MSR_IA32_MISC_ENABLE);
+    const uint64_t val = kDisableTurboBoost.apply(cur);
+    if (setIfNotEqual(cur, val, msr::MiscEnable::address)) {
+        LOG("change 0x%llx to 0x%llx in MSR_IA32_MISC_ENABLE(0x%x)", cur, val, msr::MiscEnable::address);
     }
 }
 
 void CPUTune::disableProcHot()
 {
-    const uint64_t cur = rdmsr64(MSR_IA32_POWER_CTL);
-    const uint64_t val = cur & kDisableProcHotBit;
-    if (setIfNotEqual(cur, val, MSR_IA32_POWER_CTL)) {
-        LOG("change 0x%llx to 0x%llx in MSR_IA32_POWERCTL(0x%llx)", cur, val, MSR_IA32_POWER_CTL);
+    const uint64_t cur = backend->read(msr::PowerCtl::address);
+    const uint64_t val = kDisableProcHot.apply(cur);
+    if (setIfNotEqual(cur, val, msr::PowerCtl::address)) {
+        LOG("change 0x%llx to 0x%llx in MSR_IA32_POWERCTL(0x%x)", cur, val, msr::PowerCtl::address);
     }
 }
 
 void CPUTune::enableProcHot()
 {
-    const uint64_t cur = rdmsr64(MSR_IA32_POWER_CTL);
-    const uint64_t val = cur | kEnableProcHotBit;
-    if(setIfNotEqual(cur, val, MSR_IA32_POWER_CTL)) {
-        LOG("change 0x%llx to 0x%llx in MSR_IA32_POWERCTL(0x%llx)", cur, val, MSR_IA32_POWER_CTL);
+    const uint64_t cur = backend->read(msr::PowerCtl::address);
+    const uint64_t val = kEnableProcHot.apply(cur);
+    if(setIfNotEqual(cur, val, msr::PowerCtl::address)) {
+        LOG("change 0x%llx to 0x%llx in MSR_IA32_POWERCTL(0x%x)", cur, val, msr::PowerCtl::address);
     }
 }
 
 void CPUTune::enableSpeedShift()
 {
-    const uint64_t cur = rdmsr64(MSR_IA32_PM_ENABLE);
-    if (setIfNotEqual(cur, kEnableSpeedShiftBit, MSR_IA32_PM_ENABLE)) {
-        LOG("change 0x%llx to 0x%llx in MSR_IA32_PM_ENABLE(0x%llx)", cur, kEnableSpeedShiftBit, MSR_IA32_PM_ENABLE);
+    const uint64_t cur = backend->read(msr::PMEnable::address);
+    const uint64_t val = kEnableSpeedShift.apply(cur);
+    if (setIfNotEqual(cur, val, msr::PMEnable::address)) {
+        LOG("change 0x%llx to 0x%llx in MSR_IA32_PM_ENABLE(0x%x)", cur, val, msr::PMEnable::address);
     }
 }
 
 void CPUTune::disableSpeedShift()
 {
-    const uint64_t cur = rdmsr64(MSR_IA32_PM_ENABLE);
-    if (setIfNotEqual(cur, kDisableSpeedShiftBit, MSR_IA32_PM_ENABLE)) {
-        LOG("change 0x%llx to 0x%llx in MSR_IA32_PM_ENABLE(0x%llx)", cur, kEnableSpeedShiftBit, MSR_IA32_PM_ENABLE);
+    const uint64_t cur = backend->read(msr::PMEnable::address);
+    const uint64_t val = kDisableSpeedShift.apply(cur);
+    if (setIfNotEqual(cur, val, msr::PMEnable::address)) {
+        LOG("change 0x%llx to 0x%llx in MSR_IA32_PM_ENABLE(0x%x)", cur, val, msr::PMEnable::address);
     }
 }
 
@@ -311,33 +837,66 @@ void CPUTune::stop(IOService *provider)
         timerSource = 0;
     }
 
+    // the sweep, the experiment and the cap write every cpu, the global restore below only covers this one
+    sweep.stop();
+    experiment.stop();
+    frequencyCap.restore(coreSets.getHWPCPUs());
+
     // restore the previous MSR_IA32 state
-    const uint64_t cur_ctk = rdmsr64(MSR_IA32_POWER_CTL);
+    const uint64_t cur_ctk = backend->read(MSR_IA32_POWER_CTL);
     if (setIfNotEqual(cur_ctk, org_MSR_IA32_POWER_CTL, MSR_IA32_POWER_CTL)) {
         LOG("restore MSR_IA32_POWER_CTK from 0x%llx to 0x%llx", cur_ctk, org_MSR_IA32_POWER_CTL);
     }
-    const uint64_t cur_misc = rdmsr64(MSR_IA32_MISC_ENABLE);
+    const uint64_t cur_misc = backend->read(MSR_IA32_MISC_ENABLE);
     if (setIfNotEqual(cur_misc, org_MSR_IA32_MISC_ENABLE, MSR_IA32_MISC_ENABLE)) {
         LOG("restore MSR_IA32_MISC_ENABLE from 0x%llx to 0x%llx", cur_misc, org_MSR_IA32_MISC_ENABLE);
     }
-    const uint64_t cur_perf_ctl = rdmsr64(MSR_IA32_PERF_CTL);
+    const uint64_t cur_perf_ctl = backend->read(MSR_IA32_PERF_CTL);
     if (setIfNotEqual(cur_perf_ctl, org_MSR_IA32_PERF_CTL, MSR_IA32_PERF_CTL)) {
         LOG("restore MSR_IA32_PERF_CTL from 0x%llx to 0x%llx", cur_perf_ctl, org_MSR_IA32_PERF_CTL);
     }
-    if (cpu_info.supportedHWP) {
-        const uint64_t cur_pm_enable = rdmsr64(MSR_IA32_PM_ENABLE);
+    if (msrProbe.isWritable(MSR_IA32_HWP_REQUEST)) {
+        const uint64_t cur_pm_enable = backend->read(MSR_IA32_PM_ENABLE);
         if (setIfNotEqual(cur_pm_enable, org_MSR_IA32_PM_ENABLE, MSR_IA32_PM_ENABLE)) {
             LOG("restore MSR_IA32_PM_ENABLE from 0x%llx to 0x%llx", cur_pm_enable, org_MSR_IA32_PM_ENABLE);
         }
-        const uint64_t cur_hwp_req = rdmsr64(MSR_IA32_HWP_REQUEST);
+        const uint64_t cur_hwp_req = backend->read(MSR_IA32_HWP_REQUEST);
         if (setIfNotEqual(cur_hwp_req, org_HWPRequest, MSR_IA32_HWP_REQUEST)) {
             LOG("restore MSR_IA32_HWP_REQUEST(0x%llx) from 0x%llx to 0x%llx", cur_hwp_req, org_HWPRequest);
         }
     }
+    
+    knobs.restore();
+    coreSets.restore();
+    
+    if (telemetryLogPath) {
+        telemetryLog.flush();
+    }
+    if (msrTracePath) {
+        msrTrace.save(msrTracePath);
+    }
+    if (chromeTracePath) {
+        msrTrace.saveChromeTrace(chromeTracePath);
+    }
     super::stop(provider);
 }
 
 void CPUTune::free(void)
 {
+    tickStats.free();
+    telemetry.free();
+    metrics.free();
+    telemetryLog.free();
+    sweep.free();
+    experiment.free();
+    registerDump.free();
+    knobs.free();
+    frequencyCap.free();
+    coreSets.free();
+    transitionLatency.free();
+    transaction.free();
+    stateCache.free();
+    msrProbe.free();
+    simulatedMSR.free();
     super::free();
 }
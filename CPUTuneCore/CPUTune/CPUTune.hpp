@@ -12,6 +12,28 @@
 #include <CPUInfo.hpp>
 #include <SIPTune.hpp>
 #include <NVRAMUtils.hpp>
+#include <MSRBackend.hpp>
+#include <SimulatedMSRBackend.hpp>
+#include <MSRTrace.hpp>
+#include <MSRProbe.hpp>
+#include <ConfigSource.hpp>
+#include <ConfigParser.hpp>
+#include <ConfigValidator.hpp>
+#include <TickStats.hpp>
+#include <Telemetry.hpp>
+#include <TransitionLatency.hpp>
+#include <Transaction.hpp>
+#include <StateCache.hpp>
+#include <MetricsExporter.hpp>
+#include <TelemetryLog.hpp>
+#include <RatioSweep.hpp>
+#include <ABExperiment.hpp>
+#include <RegisterDump.hpp>
+#include <KnobTable.hpp>
+#include <ProfileBundle.hpp>
+#include <FrequencyCap.hpp>
+#include <CoreSets.hpp>
+#include <Topology.hpp>
 
 class CPUTune : public IOService
 {
@@ -26,11 +48,45 @@ public:
     virtual void free(void) override;
     
 private:
-    const char *turboBoostPath = nullptr;
-    const char *ProcHotPath = nullptr;
-    const char *speedShiftPath = nullptr;
-    const char *hwpRequestConfigPath = nullptr;
-    const char *turboRatioLimitConfigPath = nullptr;
+    ConfigSource turboBoostSource;
+    ConfigSource procHotSource;
+    ConfigSource speedShiftSource;
+    ConfigSource hwpRequestSource;
+    ConfigSource turboRatioLimitSource;
+    ConfigSource transactionSource;
+    Transaction transaction;
+    TickStats tickStats;
+    Telemetry telemetry;
+    bool enableTelemetry = true;
+    MetricsExporter metrics;
+    const char *metricsPath = nullptr;
+    TelemetryLog telemetryLog;
+    const char *telemetryLogPath = nullptr;
+    uint32_t telemetryLogBlockSamples = 600;
+    // HWP ratio sweep, off unless SweepDwellTicks is set
+    RatioSweep sweep;
+    uint32_t sweepDwellTicks = 0;
+    const char *sweepResultPath = nullptr;
+    // A/B experiment between two HWP requests, started when its config changes
+    ABExperiment experiment;
+    ConfigSource experimentSource;
+    ConfigSource experimentCounterSource;
+    // symbolic dump of all known registers, written on start and when the trigger file changes
+    RegisterDump registerDump;
+    const char *registerDumpPath = nullptr;
+    ConfigSource registerDumpTriggerSource;
+    // knobs declared in Info.plist ("Knobs"), restored on stop
+    KnobTable knobs;
+    // profile from "Profiles" resolved for this cpu on start, applied as a transaction
+    ProfileBundle profile;
+    // turbo ratio limits through the HWP maximum or PERF_CTL if the register is read-only
+    FrequencyCap frequencyCap;
+    // cpus with a policy of their own ("CoreSets"), restored on stop
+    CoreSets coreSets;
+    Topology topology;
+    TransitionLatency transitionLatency;
+    bool measureTransitionLatency = false;
+    uint32_t transitionTimeoutUs = 2000;
     uint32_t updateInterval = 2000;
     bool enableIntelTurboBoost = true;
     bool enableIntelProcHot = false;
@@ -40,14 +96,14 @@ private:
     bool enableIntelSpeedShift = true;
     bool hwpEnableOnceSet = false;
     
-    static constexpr uint64_t kEnableTurboBoostBits  = ((uint64_t)-1) ^ ((uint64_t)1) << 38;
-    static constexpr uint64_t kDisableTurboBoostBits = ~kEnableTurboBoostBits;
+    static constexpr MsrUpdate<msr::MiscEnable> kEnableTurboBoost  = msr::TurboModeDisable::set<0>();
+    static constexpr MsrUpdate<msr::MiscEnable> kDisableTurboBoost = msr::TurboModeDisable::set<1>();
     
-    static constexpr uint64_t kEnableSpeedShiftBit  = 0x1;
-    static constexpr uint64_t kDisableSpeedShiftBit = 0;
+    static constexpr MsrUpdate<msr::PMEnable> kEnableSpeedShift  = msr::HWPEnable::set<1>();
+    static constexpr MsrUpdate<msr::PMEnable> kDisableSpeedShift = msr::HWPEnable::set<0>();
     
-    static constexpr uint64_t kDisableProcHotBit = 0xFFFFFFFE;
-    static constexpr uint64_t kEnableProcHotBit = 0x1;
+    static constexpr MsrUpdate<msr::PowerCtl> kDisableProcHot = msr::BiDirectionalProcHot::set<0>();
+    static constexpr MsrUpdate<msr::PowerCtl> kEnableProcHot  = msr::BiDirectionalProcHot::set<1>();
     
 
     IOWorkLoop *myWorkLoop;
@@ -66,6 +122,58 @@ private:
     
     bool setIfNotEqual(const uint64_t, const uint64_t, const uint32_t) const;
     
+    /**
+     *  Parse an on/off config ("1" or "0")
+     *
+     *  @param source  config source with content
+     *  @param enable  receives the switch state
+     *
+     *  @return true if the config is valid
+     */
+    bool parseSwitch(const ConfigSource &source, bool *enable) const;
+    
+    /**
+     *  Parse a register config and merge the given fields into the current value
+     *
+     *  @param source      config source with content
+     *  @param fields      key=value fields of the register
+     *  @param fieldCount  number of fields
+     *  @param current     current register value
+     *  @param value       receives the value to write
+     *
+     *  @return true if the config is valid
+     */
+    bool parseRegister(const ConfigSource &source, const ConfigField *fields, const size_t fieldCount,
+                       const uint64_t current, uint64_t *value) const;
+    
+    /**
+     *  Log a register value the validator refused
+     *
+     *  @param source  config source the value came from
+     *  @param value   parsed value
+     *  @param status  validation status
+     *
+     *  @return true if the value may be written
+     */
+    bool isValid(const ConfigSource &source, const uint64_t value, const ValidateStatus status) const;
+    
+    /**
+     *  Validate every knob of the transaction in transactionSource, then
+     *  write all of them or none
+     */
+    void applyTransaction(void);
+    
+    /**
+     *  Validate the operations loaded into transaction, then write all of
+     *  them or none
+     */
+    void applyOperations(void);
+    
+    /**
+     *  Stop a running experiment and start the one in experimentSource
+     */
+    void startExperiment(void);
+    
     const char* getStringPropertyOrElse(const char*, const char*) const;
     const bool getBooleanOrElse(const char*, const bool) const;
     
@@ -77,6 +185,33 @@ private:
     SIPTune sip_tune;
     NVRAMUtils nvram;
     
+    // All MSR accesses go through backend, which is the hardware unless
+    // the dry run (-cputdry) or the simulator (-cputsim) has been requested
+    HardwareMSRBackend hardwareMSR;
+    DryRunMSRBackend dryRunMSR;
+    MSRBackend *backend = &hardwareMSR;
+    bool dryRun = false;
+    
+    // Simulated processor stepped once per tick, its load trace is read from
+    // simulatorLoadSource, published as "Simulator"
+    SimulatedMSRBackend simulatedMSR;
+    bool simulating = false;
+    ConfigSource simulatorLoadSource;
+    
+    // Registers this machine has, probed once by init(); accesses to the
+    // others are refused instead of faulting, published as "Probe"
+    MSRProbe msrProbe;
+    
+    // Optional recording of every MSR access, tick and frequency sample, saved
+    // to msrTracePath (binary) and/or chromeTracePath (trace-event JSON) on stop
+    RecordingMSRBackend msrTrace;
+    const char *msrTracePath = nullptr;
+    const char *chromeTracePath = nullptr;
+    uint32_t msrTraceCapacity = 16384;
+    
+    // Last known value of every controlled register, published as "State"
+    StateCache stateCache;
+    
     bool allowUnrestrictedFS = false;
     
     uint64_t org_MSR_IA32_MISC_ENABLE;
@@ -86,14 +221,6 @@ private:
     uint64_t org_TurboRatioLimit;
     
     uint64_t org_MSR_IA32_PM_ENABLE;
-    
-    template<typename T>
-    static void deleter(T *&p) {
-        if (p) {
-            kern_os_free(p);
-            p = nullptr;
-        }
-    }
 };
 
 #endif /* CPUTune_hpp */
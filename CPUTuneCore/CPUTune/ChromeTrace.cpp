@@ -0,0 +1,111 @@
+//
+//  ChromeTrace.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "ChromeTrace.hpp"
+#include <kern/clock.h>
+#include <stdarg.h>
+
+/**
+ *  Appends formatted events to a chunk and writes full chunks to the file
+ */
+class ChromeTraceStream {
+public:
+    ChromeTraceStream(const char *path, char *chunk, const size_t size) : path(path), chunk(chunk), size(size) {}
+
+    void append(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        for (int attempt = 0; attempt < 2 && !err; attempt++) {
+            va_list args;
+            va_start(args, format);
+            const int written = vsnprintf(chunk + length, size - length, format, args);
+            va_end(args);
+            if (written >= 0 && static_cast<size_t>(written) < size - length) {
+                length += static_cast<size_t>(written);
+                return;
+            }
+            if (length == 0) {
+                // does not even fit into an empty chunk
+                err = EOVERFLOW;
+                return;
+            }
+            flush();
+        }
+    }
+
+    errno_t flush(void) {
+        if (!err && length > 0) {
+            // the file is truncated by the first write at offset 0
+            err = writeBytesToFile(path, chunk, length, offset);
+            offset += length;
+            length = 0;
+        }
+        return err;
+    }
+
+private:
+    const char *path;
+    char *chunk;
+    const size_t size;
+    size_t length = 0;
+    off_t offset = 0;
+    errno_t err = 0;
+};
+
+static constexpr size_t kChunkSize = 16384;
+
+errno_t writeChromeTrace(const char *path, const MSRTraceRecord *records, const uint32_t count, const uint64_t dropped) {
+    char *chunk = static_cast<char *>(kern_os_malloc(kChunkSize));
+    if (!chunk) {
+        return ENOMEM;
+    }
+    ChromeTraceStream out(path, chunk, kChunkSize);
+
+    uint16_t cpus = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        cpus = max<uint16_t>(cpus, records[i].cpu + 1);
+    }
+    const uint64_t origin = count > 0 ? records[0].timestamp : 0;
+
+    out.append("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"records\":%u,\"dropped\":%llu},\"traceEvents\":[\n", count, dropped);
+    out.append("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPUTune\"}}");
+    for (uint16_t cpu = 0; cpu < cpus; cpu++) {
+        out.append(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"cpu %u\"}}", cpu, cpu);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const MSRTraceRecord &rec = records[i];
+        // timestamps are printed in microseconds with nanosecond precision
+        uint64_t ns = 0;
+        absolutetime_to_nanoseconds(rec.timestamp - origin, &ns);
+        switch (rec.op) {
+            case kMSRTraceWrite:
+                out.append(",\n{\"name\":\"wrmsr 0x%x\",\"cat\":\"msr\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%u,"
+                           "\"ts\":%llu.%03llu,\"args\":{\"value\":\"0x%llx\"}}",
+                           rec.msr, rec.cpu, ns / 1000, ns % 1000, rec.value);
+                break;
+            case kMSRTraceTick: {
+                uint64_t dur = 0;
+                absolutetime_to_nanoseconds(rec.value, &dur);
+                out.append(",\n{\"name\":\"tick\",\"cat\":\"tick\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                           "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu}",
+                           rec.cpu, ns / 1000, ns % 1000, dur / 1000, dur % 1000);
+                break;
+            }
+            case kMSRTraceFrequency:
+                out.append(",\n{\"name\":\"cpu %u MHz\",\"cat\":\"telemetry\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,"
+                           "\"ts\":%llu.%03llu,\"args\":{\"MHz\":%llu}}",
+                           rec.cpu, rec.cpu, ns / 1000, ns % 1000, rec.value);
+                break;
+            default:
+                break;
+        }
+    }
+    out.append("\n]}\n");
+
+    const errno_t err = out.flush();
+    kern_os_free(chunk);
+    return err;
+}
@@ -0,0 +1,29 @@
+//
+//  ChromeTrace.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef ChromeTrace_hpp
+#define ChromeTrace_hpp
+
+#include "MSRTrace.hpp"
+
+/**
+ *  Write trace records as Chrome trace-event JSON. The text is streamed to the
+ *  file through a small chunk buffer, the trace is never formatted in memory
+ *  as a whole. Every cpu gets its own track with its ticks (complete events),
+ *  MSR writes (instant events) and effective frequency (counter events).
+ *  MSR reads are only kept in the binary trace.
+ *
+ *  @param path     destination file
+ *  @param records  trace records
+ *  @param count    number of records
+ *  @param dropped  records that did not fit into the trace
+ *
+ *  @return 0 on success or errno on error
+ */
+errno_t writeChromeTrace(const char *path, const MSRTraceRecord *records, const uint32_t count, const uint64_t dropped);
+
+#endif /* ChromeTrace_hpp */
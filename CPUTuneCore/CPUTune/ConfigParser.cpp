@@ -0,0 +1,197 @@
+//
+//  ConfigParser.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "ConfigParser.hpp"
+
+static inline bool isSeparator(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',';
+}
+
+static inline bool isWhitespace(const char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ *  Value of a digit, or 0xFF if the character is not a digit
+ */
+static inline uint8_t digitValue(const char c) {
+    if (c >= '0' && c <= '9') {
+        return static_cast<uint8_t>(c - '0');
+    }
+    if (c >= 'a' && c <= 'f') {
+        return static_cast<uint8_t>(c - 'a' + 10);
+    }
+    if (c >= 'A' && c <= 'F') {
+        return static_cast<uint8_t>(c - 'A' + 10);
+    }
+    return 0xFF;
+}
+
+/**
+ *  Parse the number in [begin, end) that contains no separators
+ */
+static ParseResult parseToken(const char *str, size_t begin, const size_t end, uint32_t radix, uint64_t *value) {
+    if (begin == end) {
+        return { kParseEmpty, begin };
+    }
+    if (end - begin > 2 && str[begin] == '0') {
+        const char prefix = str[begin + 1];
+        if (prefix == 'x' || prefix == 'X') {
+            radix = 16;
+            begin += 2;
+        } else if ((prefix == 'b' || prefix == 'B') && radix != 16) {
+            radix = 2;
+            begin += 2;
+        }
+    }
+
+    const uint64_t limit = UINT64_MAX / radix;
+    uint64_t result = 0;
+    for (size_t i = begin; i < end; i++) {
+        const uint8_t digit = digitValue(str[i]);
+        if (digit >= radix) {
+            return { kParseInvalidDigit, i };
+        }
+        if (result > limit || (result == limit && digit > UINT64_MAX % radix)) {
+            return { kParseOverflow, i };
+        }
+        result = result * radix + digit;
+    }
+    *value = result;
+    return { kParseOK, end };
+}
+
+const char *parseStatusToString(const ParseStatus status) {
+    switch (status) {
+        case kParseOK:
+            return "ok";
+        case kParseEmpty:
+            return "empty value";
+        case kParseInvalidDigit:
+            return "invalid digit";
+        case kParseOverflow:
+            return "value exceeds 64 bits";
+        case kParseTrailingCharacters:
+            return "trailing characters";
+        case kParseUnknownKey:
+            return "unknown key";
+        case kParseDuplicateKey:
+            return "duplicate key";
+        case kParseFieldOverflow:
+            return "value exceeds field width";
+        case kParseMissingValue:
+            return "missing value";
+        case kParseStatusCount:
+            break;
+    }
+    return "unknown error";
+}
+
+ParseResult parseUInt64(const char *str, const size_t length, const uint32_t defaultRadix, uint64_t *value) {
+    size_t begin = 0;
+    size_t end = length;
+    while (begin < end && isWhitespace(str[begin])) {
+        begin++;
+    }
+    while (end > begin && isWhitespace(str[end - 1])) {
+        end--;
+    }
+    for (size_t i = begin; i < end; i++) {
+        if (isWhitespace(str[i])) {
+            return { kParseTrailingCharacters, i };
+        }
+    }
+    return parseToken(str, begin, end, defaultRadix, value);
+}
+
+ParseResult parseRegisterConfig(const char *str, const size_t length,
+                                const ConfigField *fields, const size_t fieldCount,
+                                uint64_t *value, uint64_t *mask) {
+    uint64_t result = 0;
+    uint64_t given = 0;
+    size_t tokens = 0;
+    size_t i = 0;
+
+    for (;;) {
+        while (i < length && isSeparator(str[i])) {
+            i++;
+        }
+        if (i == length) {
+            break;
+        }
+        const size_t begin = i;
+        while (i < length && !isSeparator(str[i]) && str[i] != '=') {
+            i++;
+        }
+        tokens++;
+
+        if (i == length || str[i] != '=') {
+            // a whole register value, only valid on its own
+            if (tokens > 1 || given) {
+                return { kParseTrailingCharacters, begin };
+            }
+            const ParseResult parsed = parseToken(str, begin, i, 16, &result);
+            if (parsed.status != kParseOK) {
+                return parsed;
+            }
+            while (i < length && isWhitespace(str[i])) {
+                i++;
+            }
+            if (i != length) {
+                return { kParseTrailingCharacters, i };
+            }
+            *value = result;
+            *mask = UINT64_MAX;
+            return { kParseOK, length };
+        }
+
+        // key=value
+        const ConfigField *field = nullptr;
+        for (size_t f = 0; f < fieldCount && !field; f++) {
+            const char *key = fields[f].key;
+            size_t k = 0;
+            while (begin + k < i && key[k] == str[begin + k]) {
+                k++;
+            }
+            if (begin + k == i && key[k] == '\0') {
+                field = &fields[f];
+            }
+        }
+        if (!field) {
+            return { kParseUnknownKey, begin };
+        }
+        const size_t valueBegin = ++i;
+        while (i < length && !isSeparator(str[i])) {
+            i++;
+        }
+        if (valueBegin == i) {
+            return { kParseMissingValue, valueBegin };
+        }
+        uint64_t fieldValue = 0;
+        const ParseResult parsed = parseToken(str, valueBegin, i, 10, &fieldValue);
+        if (parsed.status != kParseOK) {
+            return parsed;
+        }
+        const uint32_t width = field->hi - field->lo + 1;
+        const uint64_t fieldMask = (width >= 64 ? UINT64_MAX : ((1ULL << width) - 1)) << field->lo;
+        if (width < 64 && fieldValue >> width) {
+            return { kParseFieldOverflow, valueBegin };
+        }
+        if (given & fieldMask) {
+            return { kParseDuplicateKey, begin };
+        }
+        given |= fieldMask;
+        result |= fieldValue << field->lo;
+    }
+
+    if (tokens == 0) {
+        return { kParseEmpty, length };
+    }
+    *value = result;
+    *mask = given;
+    return { kParseOK, length };
+}
@@ -0,0 +1,113 @@
+//
+//  ConfigParser.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef ConfigParser_hpp
+#define ConfigParser_hpp
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ *  Outcome of parsing a config value
+ */
+enum ParseStatus : uint8_t {
+    kParseOK = 0,
+    kParseEmpty,                // nothing but whitespace
+    kParseInvalidDigit,         // character is not a digit of the radix
+    kParseOverflow,             // value does not fit into 64 bits
+    kParseTrailingCharacters,   // garbage after a complete value
+    kParseUnknownKey,           // key=value with a key not in the field table
+    kParseDuplicateKey,         // the same field given twice
+    kParseFieldOverflow,        // value does not fit into the bits of its field
+    kParseMissingValue,         // key= without a value
+    kParseStatusCount
+};
+
+/**
+ *  Result of a parse: status and the offset of the offending character
+ *  (or the end of input on success)
+ */
+struct ParseResult {
+    ParseStatus status;
+    size_t offset;
+};
+
+/**
+ *  A named bit field of a register for key=value configs, bits [hi:lo]
+ */
+struct ConfigField {
+    const char *key;
+    uint8_t hi;
+    uint8_t lo;
+};
+
+/**
+ *  key=value fields of IA32_HWP_REQUEST
+ */
+static constexpr ConfigField kHWPRequestFields[] {
+    { "min",     7,  0 },
+    { "max",     15, 8 },
+    { "desired", 23, 16 },
+    { "epp",     31, 24 },
+    { "window",  41, 32 },
+    { "pkg",     42, 42 },
+};
+
+/**
+ *  key=value fields of MSR_TURBO_RATIO_LIMIT, ratio limit by number of active cores
+ */
+static constexpr ConfigField kTurboRatioLimitFields[] {
+    { "1c", 7,  0 },
+    { "2c", 15, 8 },
+    { "3c", 23, 16 },
+    { "4c", 31, 24 },
+    { "5c", 39, 32 },
+    { "6c", 47, 40 },
+    { "7c", 55, 48 },
+    { "8c", 63, 56 },
+};
+
+/**
+ *  Human readable description of a parse status
+ */
+const char *parseStatusToString(const ParseStatus status);
+
+/**
+ *  Parse an unsigned 64-bit integer in a single pass without allocating.
+ *  Leading/trailing whitespace (including the newline from echo) is ignored.
+ *  A 0x/0X prefix selects hexadecimal; 0b/0B selects binary unless the default
+ *  radix is 16, where it is a valid hexadecimal number.
+ *
+ *  @param str           input, need not be null terminated
+ *  @param length        number of bytes of input
+ *  @param defaultRadix  radix without prefix: 2, 10 or 16
+ *  @param value         receives the value on success
+ *
+ *  @return parse result
+ */
+ParseResult parseUInt64(const char *str, const size_t length, const uint32_t defaultRadix, uint64_t *value);
+
+/**
+ *  Parse a register config, either a whole value in hexadecimal (with or
+ *  without 0x, as in v2.0.2) or a list of key=value fields separated by
+ *  whitespace or commas, e.g. "min=8 max=0x30 epp=128". Field values are
+ *  decimal unless prefixed.
+ *
+ *  @param str         input, need not be null terminated
+ *  @param length      number of bytes of input
+ *  @param fields      field table for key=value configs
+ *  @param fieldCount  number of fields
+ *  @param value       receives the bits of the given fields (the whole value)
+ *  @param mask        receives the bits given (all ones for a whole value)
+ *
+ *  @return parse result
+ */
+ParseResult parseRegisterConfig(const char *str, const size_t length,
+                                const ConfigField *fields, const size_t fieldCount,
+                                uint64_t *value, uint64_t *mask);
+
+#endif /* ConfigParser_hpp */
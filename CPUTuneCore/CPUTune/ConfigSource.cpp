@@ -0,0 +1,50 @@
+//
+//  ConfigSource.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "ConfigSource.hpp"
+#include <kern/clock.h>
+
+bool ConfigSource::refresh(size_t bytes) {
+    if (!path) {
+        return false;
+    }
+
+    FileStamp now {};
+    if (getFileStamp(path, &now)) {
+        // file does not exist (anymore)
+        const bool changed = loaded;
+        loaded = false;
+        length = 0;
+        content[0] = 0;
+        return changed;
+    }
+
+    clock_sec_t secs = 0;
+    clock_usec_t usecs = 0;
+    clock_get_calendar_microtime(&secs, &usecs);
+
+    // A file modified within the second we read it may change again without
+    // a visible stamp change on filesystems with 1s granularity (HFS+), so
+    // only trust the stamp once it is strictly older than the read.
+    if (loaded &&
+        now.modifySeconds == stamp.modifySeconds &&
+        now.modifyNanoseconds == stamp.modifyNanoseconds &&
+        now.size == stamp.size &&
+        now.modifySeconds < static_cast<int64_t>(loadedAt)) {
+        return false;
+    }
+
+    char previous[kMaxLength + 1];
+    const size_t previousLength = length;
+    memcpy(previous, content, previousLength + 1);
+
+    length = readFileToBuffer(path, 0, reinterpret_cast<uint8_t *>(content), min(bytes, kMaxLength));
+    stamp = now;
+    loadedAt = secs;
+    loaded = true;
+    return length != previousLength || memcmp(previous, content, length) != 0;
+}
@@ -0,0 +1,55 @@
+//
+//  ConfigSource.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef ConfigSource_hpp
+#define ConfigSource_hpp
+
+#include "kern_util.hpp"
+
+/**
+ *  A runtime configuration file (e.g. /tmp/HWPRequest.conf).
+ *  The content is cached in a fixed buffer and the file is only read again
+ *  when its modification stamp changes, so an unchanged source costs a single
+ *  lookup per tick and never allocates.
+ */
+class ConfigSource {
+public:
+    static constexpr size_t kMaxLength = 512;
+
+    const char *path = nullptr;
+
+    /**
+     *  Reload the cached content if the file changed since the last refresh
+     *
+     *  @param bytes  maximum bytes to read, capped at kMaxLength
+     *
+     *  @return true if the content changed (or the file disappeared)
+     */
+    bool refresh(size_t bytes);
+
+    /**
+     *  @return cached content, nullptr if the file is missing or empty
+     */
+    const char *getContent() const { return length ? content : nullptr; }
+
+    size_t getLength() const { return length; }
+
+    /**
+     *  @return true if the file is longer than what was read into the cache
+     */
+    bool isTruncated() const { return length && stamp.size > length; }
+
+private:
+    FileStamp stamp {};
+    bool loaded = false;
+    // calendar second the content was read at, see refresh()
+    uint64_t loadedAt = 0;
+    size_t length = 0;
+    char content[kMaxLength + 1] {};
+};
+
+#endif /* ConfigSource_hpp */
@@ -0,0 +1,91 @@
+//
+//  ConfigValidator.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "ConfigValidator.hpp"
+#include "MSRRegisters.hpp"
+
+// CPUID.06H:EAX
+static constexpr uint32_t kCPUIDActivityWindow  = 1U << 9;
+static constexpr uint32_t kCPUIDEnergyPerfPref  = 1U << 10;
+static constexpr uint32_t kCPUIDPackageRequest  = 1U << 11;
+
+const char *validateStatusToString(const ValidateStatus status) {
+    switch (status) {
+        case kValidateOK:
+            return "ok";
+        case kValidateReservedBits:
+            return "reserved bits set";
+        case kValidateUnsupportedField:
+            return "field not supported by this cpu";
+        case kValidateRatioOutOfRange:
+            return "ratio out of range";
+        case kValidateMinAboveMax:
+            return "minimum above maximum";
+        case kValidateZeroRatio:
+            return "zero ratio limit";
+        case kValidateIncreasingRatio:
+            return "ratio limit increases with active cores";
+        case kValidateOutOfRange:
+            return "value out of range";
+        case kValidateStatusCount:
+            break;
+    }
+    return "unknown error";
+}
+
+HWPCapabilities decodeHWPCapabilities(const uint64_t capabilities, const uint32_t features) {
+    HWPCapabilities caps {};
+    caps.highest = static_cast<uint8_t>(msr::HighestPerformance::extract(capabilities));
+    caps.guaranteed = static_cast<uint8_t>(msr::GuaranteedPerformance::extract(capabilities));
+    caps.efficient = static_cast<uint8_t>(msr::EfficientPerformance::extract(capabilities));
+    caps.lowest = static_cast<uint8_t>(msr::LowestPerformance::extract(capabilities));
+    caps.activityWindow = features & kCPUIDActivityWindow;
+    caps.energyPerformancePreference = features & kCPUIDEnergyPerfPref;
+    caps.packageRequest = features & kCPUIDPackageRequest;
+    return caps;
+}
+
+ValidateStatus validateHWPRequest(const uint64_t request, const HWPCapabilities &caps) {
+    if (msr::HWPRequestReserved::extract(request)) {
+        return kValidateReservedBits;
+    }
+    const uint8_t minimum = static_cast<uint8_t>(msr::HWPMinimum::extract(request));
+    const uint8_t maximum = static_cast<uint8_t>(msr::HWPMaximum::extract(request));
+    const uint8_t desired = static_cast<uint8_t>(msr::HWPDesired::extract(request));
+    const uint8_t epp = static_cast<uint8_t>(msr::HWPEnergyPerfPreference::extract(request));
+    if ((msr::HWPPackageControl::extract(request) && !caps.packageRequest) ||
+        (msr::HWPActivityWindow::extract(request) && !caps.activityWindow) ||
+        (epp && !caps.energyPerformancePreference)) {
+        return kValidateUnsupportedField;
+    }
+    auto inRange = [&](const uint8_t ratio) {
+        return ratio >= caps.lowest && ratio <= caps.highest;
+    };
+    if (!inRange(minimum) || !inRange(maximum) || (desired && !inRange(desired))) {
+        return kValidateRatioOutOfRange;
+    }
+    if (minimum > maximum) {
+        return kValidateMinAboveMax;
+    }
+    return kValidateOK;
+}
+
+ValidateStatus validateTurboRatioLimit(const uint64_t limit, const uint8_t bins) {
+    // one byte per limit, the first one in bits 7:0
+    uint8_t previous = 0xFF;
+    for (uint8_t i = 0; i < bins; i++) {
+        const uint8_t ratio = static_cast<uint8_t>(limit >> (i * 8));
+        if (ratio == 0) {
+            return kValidateZeroRatio;
+        }
+        if (ratio > previous) {
+            return kValidateIncreasingRatio;
+        }
+        previous = ratio;
+    }
+    return kValidateOK;
+}
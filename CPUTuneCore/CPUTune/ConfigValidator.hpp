@@ -0,0 +1,79 @@
+//
+//  ConfigValidator.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef ConfigValidator_hpp
+#define ConfigValidator_hpp
+
+#include <stdint.h>
+
+/**
+ *  Outcome of checking a register value before it is written
+ */
+enum ValidateStatus : uint8_t {
+    kValidateOK = 0,
+    kValidateReservedBits,      // a reserved bit is set
+    kValidateUnsupportedField,  // field of a feature the cpu does not have
+    kValidateRatioOutOfRange,   // ratio outside the range the cpu reports
+    kValidateMinAboveMax,       // minimum ratio above maximum ratio
+    kValidateZeroRatio,         // ratio limit of an existing core count is 0
+    kValidateIncreasingRatio,   // more active cores get a higher ratio limit
+    kValidateOutOfRange,        // value outside the declared range of a knob
+    kValidateStatusCount
+};
+
+/**
+ *  HWP features and ratio range of the cpu
+ */
+struct HWPCapabilities {
+    uint8_t highest;
+    uint8_t guaranteed;
+    uint8_t efficient;
+    uint8_t lowest;
+    bool activityWindow;
+    bool energyPerformancePreference;
+    bool packageRequest;
+};
+
+/**
+ *  Human readable description of a validation status
+ */
+const char *validateStatusToString(const ValidateStatus status);
+
+/**
+ *  Decode the HWP capabilities
+ *
+ *  @param capabilities  IA32_HWP_CAPABILITIES
+ *  @param features      CPUID.06H:EAX
+ *
+ *  @return decoded capabilities
+ */
+HWPCapabilities decodeHWPCapabilities(const uint64_t capabilities, const uint32_t features);
+
+/**
+ *  Check an IA32_HWP_REQUEST value: no reserved bits, no fields of missing
+ *  features, lowest <= min <= max <= highest and desired 0 (autonomous) or
+ *  within the same range.
+ *
+ *  @param request  value to write
+ *  @param caps     capabilities of the cpu
+ *
+ *  @return validation status
+ */
+ValidateStatus validateHWPRequest(const uint64_t request, const HWPCapabilities &caps);
+
+/**
+ *  Check a MSR_TURBO_RATIO_LIMIT value: every limit in use is nonzero and not
+ *  above the limit before it (fewer active cores).
+ *
+ *  @param limit  value to write
+ *  @param bins   number of limits in use, see CPUInfo::turboRatioBins
+ *
+ *  @return validation status
+ */
+ValidateStatus validateTurboRatioLimit(const uint64_t limit, const uint8_t bins);
+
+#endif /* ConfigValidator_hpp */
@@ -0,0 +1,654 @@
+//
+//  CoreSets.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "CoreSets.hpp"
+#include "CPUInfo.hpp"
+
+const uint32_t CoreSets::kPolicyMSRs[kPolicyRegisterCount] {
+    msr::HWPRequest::address,
+    msr::MiscFeatureControl::address,
+    msr::ClockModulation::address,
+    msr::PQRAssoc::address,
+};
+
+// where the fields of kCoreSetPolicyFields lie in a policy
+static constexpr uint64_t kHWPBits = 0xFFFFFFFFULL;
+static constexpr uint8_t kPrefetchShift = 32;
+static constexpr uint64_t kPrefetchBits = 0xFULL << kPrefetchShift;
+static constexpr uint8_t kDutyShift = 36;
+static constexpr uint64_t kDutyBits = 0x7ULL << kDutyShift;
+static constexpr uint8_t kL3Shift = 40;
+static constexpr uint64_t kL3Bits = 0xFFFFFULL << kL3Shift;
+static constexpr uint8_t kMBAShift = 60;
+static constexpr uint64_t kMBABits = 0xFULL << kMBAShift;
+static constexpr uint64_t kPolicyBits = kHWPBits | kPrefetchBits | kDutyBits | kL3Bits | kMBABits;
+
+static const char *kRegisterNames[] {
+    "IA32_HWP_REQUEST",
+    "MSR_MISC_FEATURE_CONTROL",
+    "IA32_CLOCK_MODULATION",
+    "IA32_PQR_ASSOC",
+};
+
+/**
+ *  Parse a cpu list such as "0-3,8", whitespace is ignored
+ *
+ *  @return false on anything but numbers, ranges and commas or a cpu beyond limit
+ */
+static bool parseCPUList(const char *str, const size_t length, const uint32_t limit, uint64_t *cpus) {
+    uint64_t mask = 0;
+    size_t i = 0;
+    auto skipSpaces = [&]() {
+        while (i < length && (str[i] == ' ' || str[i] == '\t')) {
+            i++;
+        }
+    };
+    auto number = [&](uint32_t *value) -> bool {
+        skipSpaces();
+        if (i == length || str[i] < '0' || str[i] > '9') {
+            return false;
+        }
+        uint32_t n = 0;
+        while (i < length && str[i] >= '0' && str[i] <= '9') {
+            n = n * 10 + static_cast<uint32_t>(str[i++] - '0');
+            if (n >= limit) {
+                return false;
+            }
+        }
+        skipSpaces();
+        *value = n;
+        return true;
+    };
+    while (true) {
+        uint32_t first = 0;
+        uint32_t last = 0;
+        if (!number(&first)) {
+            return false;
+        }
+        last = first;
+        if (i < length && str[i] == '-') {
+            i++;
+            if (!number(&last) || last < first) {
+                return false;
+            }
+        }
+        for (uint32_t cpu = first; cpu <= last; cpu++) {
+            mask |= 1ULL << cpu;
+        }
+        if (i == length) {
+            break;
+        }
+        if (str[i++] != ',') {
+            return false;
+        }
+    }
+    *cpus = mask;
+    return true;
+}
+
+void CoreSets::split(const uint64_t value, const uint64_t mask, const PolicyRegister reg, const size_t set, uint64_t *bits, uint64_t *bitsMask) const {
+    *bits = 0;
+    *bitsMask = 0;
+    switch (reg) {
+        case kHWPRequest:
+            *bits = value & mask & kHWPBits;
+            *bitsMask = mask & kHWPBits;
+            break;
+        case kPrefetcher:
+            if (mask & kPrefetchBits) {
+                *bits = msr::PrefetcherDisable::insert(0, (value & kPrefetchBits) >> kPrefetchShift);
+                *bitsMask = msr::PrefetcherDisable::mask;
+            }
+            break;
+        case kClockModulation:
+            if (mask & kDutyBits) {
+                const uint64_t duty = (value & kDutyBits) >> kDutyShift;
+                // duty 0 is reserved, it stands for no modulation
+                *bits = duty ? msr::ClockModulationEnable::insert(msr::ClockModulationDuty::insert(0, duty), 1) : 0;
+                *bitsMask = msr::ClockModulationEnable::mask | msr::ClockModulationDuty::mask;
+            }
+            break;
+        case kCacheClass:
+            if ((mask & (kL3Bits | kMBABits)) || sets[set].targetShare) {
+                *bits = msr::ClassOfService::insert(0, set + 1);
+                *bitsMask = msr::ClassOfService::mask;
+            }
+            if (sets[set].targetShare) {
+                *bits = msr::ResourceMonitoringID::insert(*bits, set + 1);
+                *bitsMask |= msr::ResourceMonitoringID::mask;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void CoreSets::detectCacheAllocation(MSRProbe &probe) {
+    cbmLength = 0;
+    l3Classes = 0;
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000000, cpuid_reg);
+    if (cpuid_reg[eax] < 0x10) {
+        return;
+    }
+    // CPUID.(EAX=07H, ECX=0):EBX[15] resource director technology allocation
+    do_cpuid(0x00000007, cpuid_reg);
+    if (!bitfield32(cpuid_reg[ebx], 15, 15)) {
+        return;
+    }
+    // CPUID.(EAX=10H, ECX=0):EBX[1] L3 cache allocation
+    do_cpuid(0x00000010, cpuid_reg);
+    if (!bitfield32(cpuid_reg[ebx], 1, 1)) {
+        return;
+    }
+    cpuid_reg[eax] = 0x00000010;
+    cpuid_reg[ecx] = 1;
+    cpuid(cpuid_reg);
+    const uint8_t length = static_cast<uint8_t>(bitfield32(cpuid_reg[eax], 4, 0) + 1);
+    const uint32_t classes = bitfield32(cpuid_reg[edx], 15, 0);
+    if (!probe.probe(msr::PQRAssoc::address)) {
+        return;
+    }
+    // classes the sets can use, one per set
+    uint32_t usable = 0;
+    while (usable < classes && usable < kMaxSets && probe.probe(msr::L3QOSMask0::address + usable + 1)) {
+        usable++;
+    }
+    if (usable == 0) {
+        return;
+    }
+    cbmLength = length;
+    l3Classes = usable;
+    LOG("L3 cache allocation: %u way bit mask, classes 1 to %u of %u for core sets", cbmLength, l3Classes, classes);
+}
+
+bool CoreSets::merge(CoreSet &set, const char *str, const size_t length, const char *where) {
+    uint64_t value = 0;
+    uint64_t mask = 0;
+    const ParseResult result = parseRegisterConfig(str, length, kCoreSetPolicyFields, arrsize(kCoreSetPolicyFields), &value, &mask);
+    if (result.status != kParseOK) {
+        LOG("core set %s: ignore %s: %s at offset %lu", set.name, where, parseStatusToString(result.status), result.offset);
+        return false;
+    }
+    // a whole value may only set policy bits
+    if (value & ~kPolicyBits) {
+        LOG("core set %s: ignore %s: bits beyond the policy fields", set.name, where);
+        return false;
+    }
+    mask &= kPolicyBits;
+    const uint64_t newValue = (set.value & ~mask) | value;
+    const uint64_t newMask = set.mask | mask;
+
+    for (size_t r = 0; r < kPolicyRegisterCount; r++) {
+        uint64_t bits = 0;
+        uint64_t bitsMask = 0;
+        split(newValue, newMask, static_cast<PolicyRegister>(r), static_cast<size_t>(&set - sets), &bits, &bitsMask);
+        if (bitsMask && !writable[r]) {
+            LOG("core set %s: ignore %s: %s is not writable on this cpu", set.name, where, kRegisterNames[r]);
+            return false;
+        }
+        const size_t index = static_cast<size_t>(&set - sets);
+        if (r == kCacheClass && (newMask & kMBABits)) {
+            const uint64_t delay = ((newValue & kMBABits) >> kMBAShift) * MemoryBandwidth::kDelayStep;
+            if (index + 1 > bandwidth.getClasses()) {
+                LOG("core set %s: ignore %s: no class of service left for mba", set.name, where);
+                return false;
+            }
+            if (delay > bandwidth.getMaxDelay()) {
+                LOG("core set %s: ignore %s: mba %llu%% is above the highest delay %u%%", set.name, where, delay, bandwidth.getMaxDelay());
+                return false;
+            }
+        }
+        if (r == kCacheClass && (newMask & kL3Bits)) {
+            const uint64_t l3 = (newValue & kL3Bits) >> kL3Shift;
+            if (index + 1 > l3Classes) {
+                LOG("core set %s: ignore %s: no class of service left for l3_mask", set.name, where);
+                return false;
+            }
+            // a nonzero run of ones within the capacity bit mask
+            const uint64_t run = l3 ? l3 >> __builtin_ctzll(l3) : 0;
+            if (!l3 || (run & (run + 1)) || l3 >= (1ULL << cbmLength)) {
+                LOG("core set %s: ignore %s: l3_mask 0x%llx is not a contiguous mask of %u bits", set.name, where, l3, cbmLength);
+                return false;
+            }
+        }
+        if (r == kHWPRequest && bitsMask) {
+            const ValidateStatus status = validateHWPRequest((backend->read(kPolicyMSRs[r]) & ~bitsMask) | bits, caps);
+            if (status != kValidateOK) {
+                LOG("core set %s: refuse %s: %s", set.name, where, validateStatusToString(status));
+                return false;
+            }
+        }
+    }
+    if (newValue == set.value && newMask == set.mask) {
+        return true;
+    }
+    set.value = newValue;
+    set.mask = newMask;
+    for (size_t r = 0; r < kPolicyRegisterCount; r++) {
+        uint64_t bits = 0;
+        uint64_t bitsMask = 0;
+        split(newValue, newMask, static_cast<PolicyRegister>(r), static_cast<size_t>(&set - sets), &bits, &bitsMask);
+        touched[r] |= bitsMask;
+    }
+    dirty |= 1U << static_cast<uint32_t>(&set - sets);
+    if (set.policyNumber) {
+        set.policyNumber->setValue(set.value);
+        set.maskNumber->setValue(set.mask);
+    }
+    return true;
+}
+
+bool CoreSets::compile(OSDictionary *declaration, CoreSet &set, const uint64_t taken) {
+    OSString *name = OSDynamicCast(OSString, declaration->getObject("Name"));
+    if (!name || name->getLength() == 0 || name->getLength() > kMaxNameLength) {
+        LOG("refuse core set: Name must have 1 to %lu characters", kMaxNameLength);
+        return false;
+    }
+    strlcpy(set.name, name->getCStringNoCopy(), sizeof(set.name));
+
+    OSObject *list = declaration->getObject("CPUs");
+    const uint64_t present = cpus == kMaxCPUs ? ~0ULL : (1ULL << cpus) - 1;
+    set.cpus = 0;
+    if (OSString *str = OSDynamicCast(OSString, list)) {
+        if (!parseCPUList(str->getCStringNoCopy(), str->getLength(), cpus, &set.cpus)) {
+            LOG("refuse core set %s: CPUs is a list such as 0-3,8 of the %u cpus", set.name, cpus);
+            return false;
+        }
+    } else if (OSNumber *number = OSDynamicCast(OSNumber, list)) {
+        set.cpus = number->unsigned64BitValue();
+    }
+    if (set.cpus == 0 || (set.cpus & ~present)) {
+        LOG("refuse core set %s: CPUs must select some of the %u cpus", set.name, cpus);
+        return false;
+    }
+    if (set.cpus & taken) {
+        LOG("refuse core set %s: cpus 0x%llx belong to another set", set.name, set.cpus & taken);
+        return false;
+    }
+
+    set.value = 0;
+    set.mask = 0;
+    set.applies = 0;
+    set.targetShare = 0;
+    set.delay = 0;
+    set.policyNumber = nullptr;
+    set.maskNumber = nullptr;
+    set.appliesNumber = nullptr;
+    set.delayNumber = nullptr;
+    set.shareNumber = nullptr;
+    const size_t index = static_cast<size_t>(&set - sets);
+    if (OSNumber *share = OSDynamicCast(OSNumber, declaration->getObject("BandwidthShare"))) {
+        if (share->unsigned32BitValue() == 0 || share->unsigned32BitValue() >= 100) {
+            LOG("refuse core set %s: BandwidthShare is a percentage from 1 to 99", set.name);
+            return false;
+        }
+        if (!writable[kCacheClass] || index + 1 > bandwidth.getClasses() || index + 1 >= bandwidth.getRMIDs()) {
+            LOG("refuse core set %s: BandwidthShare needs memory bandwidth allocation and monitoring", set.name);
+            return false;
+        }
+        // the feedback loop moves the delay in kDelayStep steps, which only works if each step throttles
+        if (!bandwidth.isLinear()) {
+            LOG("refuse core set %s: BandwidthShare needs linear memory bandwidth throttling", set.name);
+            return false;
+        }
+        set.targetShare = share->unsigned32BitValue();
+    }
+    if (OSString *policy = OSDynamicCast(OSString, declaration->getObject("Policy"))) {
+        if (!merge(set, policy->getCStringNoCopy(), policy->getLength(), "Policy")) {
+            return false;
+        }
+    }
+    if (set.targetShare) {
+        // the class and monitoring ID are needed even without a policy
+        uint64_t bits = 0;
+        uint64_t bitsMask = 0;
+        split(set.value, set.mask, kCacheClass, index, &bits, &bitsMask);
+        touched[kCacheClass] |= bitsMask;
+        dirty |= 1U << static_cast<uint32_t>(index);
+    }
+    set.source.path = nullptr;
+    if (OSString *path = OSDynamicCast(OSString, declaration->getObject("ConfigPath"))) {
+        set.source.path = path->getCStringNoCopy();
+    }
+    return true;
+}
+
+bool CoreSets::init(OSArray *declarations, MSRBackend *backend, MSRProbe &probe, const Topology &topology,
+                    const HWPCapabilities &caps, const bool mergeSiblings) {
+    this->backend = backend;
+    this->topology = &topology;
+    this->caps = caps;
+    this->mergeSiblings = mergeSiblings;
+    cpus = topology.getCPUCount();
+    count = 0;
+    dirty = 0;
+    written = 0;
+    hwpCPUs = 0;
+    conflicts = 0;
+    feedback = false;
+    if (!declarations || !backend || cpus == 0) {
+        return false;
+    }
+    detectCacheAllocation(probe);
+    touchedClasses = 0;
+    for (size_t i = 0; i < l3Classes; i++) {
+        originalL3Masks[i] = backend->read(msr::L3QOSMask0::address + i + 1);
+    }
+    bandwidth.init(backend, probe);
+    // a class of service is only of use with cache or bandwidth allocation
+    const bool classes = probe.probe(msr::PQRAssoc::address) && (l3Classes > 0 || bandwidth.getClasses() > 0);
+    for (size_t r = 0; r < kPolicyRegisterCount; r++) {
+        writable[r] = probe.isWritable(kPolicyMSRs[r]) && (r != kCacheClass || classes);
+        touched[r] = 0;
+        // the values of every cpu before any policy, for restore()
+        if (writable[r]) {
+            backend->readAllCPUs(&kPolicyMSRs[r], 1, &original[r * kMaxCPUs], cpus);
+        }
+    }
+    if (declarations->getCount() > kMaxSets) {
+        LOG("only the first %lu of %u core sets are used", kMaxSets, declarations->getCount());
+    }
+    uint64_t taken = 0;
+    for (unsigned int i = 0; i < declarations->getCount() && count < kMaxSets; i++) {
+        OSDictionary *declaration = OSDynamicCast(OSDictionary, declarations->getObject(i));
+        if (!declaration) {
+            continue;
+        }
+        if (!compile(declaration, sets[count], taken)) {
+            continue;
+        }
+        taken |= sets[count].cpus;
+        feedback |= sets[count].targetShare > 0;
+        count++;
+    }
+    if (count == 0) {
+        return false;
+    }
+    if (!publish()) {
+        free();
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const CoreSet &set = sets[i];
+        LOG("core set %s: cpus 0x%llx, policy 0x%llx (fields 0x%llx)", set.name, set.cpus, set.value, set.mask);
+    }
+    return true;
+}
+
+bool CoreSets::publish() {
+    dict = OSDictionary::withCapacity(static_cast<unsigned int>(count));
+    siblingDict = OSDictionary::withCapacity(3);
+    if (!dict || !siblingDict) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        CoreSet &set = sets[i];
+        OSDictionary *setDict = OSDictionary::withCapacity(6);
+        if (!setDict) {
+            return false;
+        }
+        dict->setObject(set.name, setDict);
+        setDict->release();
+        OSNumber *cpusNumber = addNumberToDictionary(setDict, "CPUs");
+        set.policyNumber = addNumberToDictionary(setDict, "Policy");
+        set.maskNumber = addNumberToDictionary(setDict, "PolicyMask");
+        set.appliesNumber = addNumberToDictionary(setDict, "Applies");
+        set.delayNumber = addNumberToDictionary(setDict, "MBADelay");
+        set.shareNumber = addNumberToDictionary(setDict, "BandwidthShare");
+        if (!cpusNumber || !set.policyNumber || !set.maskNumber || !set.appliesNumber || !set.delayNumber || !set.shareNumber) {
+            return false;
+        }
+        cpusNumber->setValue(set.cpus);
+        set.policyNumber->setValue(set.value);
+        set.maskNumber->setValue(set.mask);
+    }
+
+    const uint32_t cores = topology->getCoreCount();
+    OSArray *coreArray = OSArray::withCapacity(cores);
+    if (!coreArray) {
+        return false;
+    }
+    siblingDict->setObject("Cores", coreArray);
+    coreArray->release();
+    for (uint32_t core = 0; core < cores; core++) {
+        OSNumber *number = OSNumber::withNumber(0ULL, 64);
+        if (!number) {
+            return false;
+        }
+        coreArray->setObject(number);
+        number->release();
+        coreNumbers[core] = number;
+    }
+    conflictsNumber = addNumberToDictionary(siblingDict, "Conflicts");
+    if (!conflictsNumber) {
+        return false;
+    }
+    siblingDict->setObject("Merge", mergeSiblings ? kOSBooleanTrue : kOSBooleanFalse);
+    return true;
+}
+
+void CoreSets::free() {
+    for (size_t i = 0; i < count; i++) {
+        sets[i].policyNumber = nullptr;
+        sets[i].maskNumber = nullptr;
+        sets[i].appliesNumber = nullptr;
+        sets[i].delayNumber = nullptr;
+        sets[i].shareNumber = nullptr;
+    }
+    feedback = false;
+    for (uint32_t core = 0; core < kMaxCPUs; core++) {
+        coreNumbers[core] = nullptr;
+    }
+    conflictsNumber = nullptr;
+    count = 0;
+    dirty = 0;
+    OSSafeReleaseNULL(dict);
+    OSSafeReleaseNULL(siblingDict);
+}
+
+void CoreSets::refresh(uint32_t &changed, uint32_t &unchanged) {
+    for (size_t i = 0; i < count; i++) {
+        CoreSet &set = sets[i];
+        if (!set.source.path) {
+            continue;
+        }
+        if (!set.source.refresh(kPolicyLength)) {
+            unchanged++;
+            continue;
+        }
+        changed++;
+        if (!set.source.getContent()) {
+            continue;
+        }
+        if (set.source.isTruncated()) {
+            LOG("core set %s: ignore %s: longer than %lu bytes", set.name, set.source.path, kPolicyLength);
+            continue;
+        }
+        merge(set, set.source.getContent(), set.source.getLength(), set.source.path);
+    }
+}
+
+uint64_t CoreSets::effectiveHWPRequest(const uint64_t *requests, const uint64_t cpus) {
+    uint64_t minimum = 0;
+    uint64_t maximum = 0;
+    uint64_t desired = 0;
+    uint64_t epp = msr::HWPEnergyPerfPreference::maxValue;
+    bool autonomous = false;
+    for (uint32_t cpu = 0; cpu < kMaxCPUs; cpu++) {
+        if (!(cpus & (1ULL << cpu))) {
+            continue;
+        }
+        const uint64_t request = requests[cpu];
+        if (msr::HWPMinimum::extract(request) > minimum) {
+            minimum = msr::HWPMinimum::extract(request);
+        }
+        if (msr::HWPMaximum::extract(request) > maximum) {
+            maximum = msr::HWPMaximum::extract(request);
+        }
+        if (msr::HWPDesired::extract(request) > desired) {
+            desired = msr::HWPDesired::extract(request);
+        }
+        autonomous |= msr::HWPDesired::extract(request) == 0;
+        if (msr::HWPEnergyPerfPreference::extract(request) < epp) {
+            epp = msr::HWPEnergyPerfPreference::extract(request);
+        }
+    }
+    uint64_t request = msr::HWPMinimum::insert(0, minimum);
+    request = msr::HWPMaximum::insert(request, maximum);
+    request = msr::HWPDesired::insert(request, autonomous ? 0 : desired);
+    return msr::HWPEnergyPerfPreference::insert(request, epp);
+}
+
+void CoreSets::coordinate() {
+    backend->readAllCPUs(&kPolicyMSRs[kHWPRequest], 1, requests, cpus);
+    uint64_t merged = 0;
+    for (uint32_t core = 0; core < topology->getCoreCount(); core++) {
+        const uint64_t siblings = topology->getCoreCPUs(core);
+        const uint64_t effective = effectiveHWPRequest(requests, siblings);
+        coreNumbers[core]->setValue(effective);
+        bool differ = false;
+        for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+            if ((siblings & (1ULL << cpu)) && (requests[cpu] & kHWPBits) != effective) {
+                differ = true;
+            }
+        }
+        if (!differ) {
+            continue;
+        }
+        conflicts++;
+        if (!mergeSiblings) {
+            LOG("core %u: siblings 0x%llx request different HWP fields, the core runs at 0x%llx", core, siblings, effective);
+            continue;
+        }
+        for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+            if (siblings & (1ULL << cpu)) {
+                scratch[cpu] = effective;
+            }
+        }
+        merged |= siblings;
+    }
+    conflictsNumber->setValue(conflicts);
+    if (merged) {
+        backend->updateCPUs(kPolicyMSRs[kHWPRequest], kHWPBits, scratch, merged);
+        touched[kHWPRequest] |= kHWPBits;
+        written |= merged;
+        hwpCPUs |= merged;
+        LOG("core sets: merge the HWP requests of siblings 0x%llx", merged);
+    }
+}
+
+void CoreSets::apply() {
+    if (!dirty) {
+        return;
+    }
+    bool hwp = false;
+    for (size_t i = 0; dirty && i < count; i++) {
+        if (!(dirty & (1U << i))) {
+            continue;
+        }
+        dirty &= ~(1U << i);
+        CoreSet &set = sets[i];
+        for (size_t r = 0; r < kPolicyRegisterCount; r++) {
+            uint64_t bits = 0;
+            uint64_t bitsMask = 0;
+            split(set.value, set.mask, static_cast<PolicyRegister>(r), i, &bits, &bitsMask);
+            if (!bitsMask) {
+                continue;
+            }
+            if (r == kCacheClass && (set.mask & kL3Bits)) {
+                // the capacity of the class before its cpus move into it
+                backend->write(msr::L3QOSMask0::address + i + 1, (set.value & kL3Bits) >> kL3Shift);
+                touchedClasses |= 1U << (i + 1);
+            }
+            if (r == kCacheClass && ((set.mask & kMBABits) || set.targetShare)) {
+                // the feedback loop starts from the throttle of the policy
+                if (set.mask & kMBABits) {
+                    set.delay = static_cast<uint32_t>((set.value & kMBABits) >> kMBAShift) * MemoryBandwidth::kDelayStep;
+                }
+                bandwidth.setThrottle(static_cast<uint32_t>(i + 1), set.delay);
+                if (set.delayNumber) {
+                    set.delayNumber->setValue(set.delay);
+                }
+            }
+            for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+                scratch[cpu] = bits;
+            }
+            backend->updateCPUs(kPolicyMSRs[r], bitsMask, scratch, set.cpus);
+            if (r == kHWPRequest) {
+                hwp = true;
+                hwpCPUs |= set.cpus;
+            }
+        }
+        written |= set.cpus;
+        set.applies++;
+        if (set.appliesNumber) {
+            set.appliesNumber->setValue(set.applies);
+        }
+        LOG("core set %s: apply policy 0x%llx (fields 0x%llx) to cpus 0x%llx", set.name, set.value, set.mask, set.cpus);
+    }
+    if (hwp && siblingDict) {
+        coordinate();
+    }
+}
+
+void CoreSets::control() {
+    // nothing to do before the sets are applied
+    if (!feedback || dirty) {
+        return;
+    }
+    const uint32_t ids = static_cast<uint32_t>(count) + 1 < bandwidth.getRMIDs() ? static_cast<uint32_t>(count) + 1 : bandwidth.getRMIDs();
+    if (!bandwidth.sample(ids, traffic)) {
+        return;
+    }
+    uint64_t total = 0;
+    for (uint32_t id = 0; id < ids; id++) {
+        total += traffic[id];
+    }
+    if (total == 0) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        CoreSet &set = sets[i];
+        if (!set.targetShare) {
+            continue;
+        }
+        const uint32_t share = static_cast<uint32_t>(traffic[i + 1] * 100 / total);
+        set.shareNumber->setValue(share);
+        uint32_t delay = set.delay;
+        if (share > set.targetShare + kShareDeadband && delay + MemoryBandwidth::kDelayStep <= bandwidth.getMaxDelay()) {
+            delay += MemoryBandwidth::kDelayStep;
+        } else if (share + kShareDeadband < set.targetShare && delay >= MemoryBandwidth::kDelayStep) {
+            delay -= MemoryBandwidth::kDelayStep;
+        }
+        if (delay != set.delay) {
+            LOG("core set %s: %u%% of the memory traffic for a target of %u%%, throttle %u%% -> %u%%", set.name, share,
+                set.targetShare, set.delay, delay);
+            set.delay = delay;
+            bandwidth.setThrottle(static_cast<uint32_t>(i + 1), delay);
+            set.delayNumber->setValue(delay);
+        }
+    }
+}
+
+void CoreSets::restore() {
+    for (size_t r = 0; r < kPolicyRegisterCount; r++) {
+        if (!touched[r] || !written) {
+            continue;
+        }
+        backend->updateCPUs(kPolicyMSRs[r], touched[r], &original[r * kMaxCPUs], written);
+        LOG("core sets: restore bits 0x%llx of %s on cpus 0x%llx", touched[r], kRegisterNames[r], written);
+    }
+    // the cpus are back in their classes, now the class masks and throttles
+    bandwidth.restore();
+    for (size_t i = 0; i < l3Classes; i++) {
+        if (touchedClasses & (1U << (i + 1))) {
+            backend->write(msr::L3QOSMask0::address + i + 1, originalL3Masks[i]);
+            LOG("core sets: restore IA32_L3_QOS_MASK_%lu to 0x%llx", i + 1, originalL3Masks[i]);
+        }
+    }
+}
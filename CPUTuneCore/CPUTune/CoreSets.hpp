@@ -0,0 +1,235 @@
+//
+//  CoreSets.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef CoreSets_hpp
+#define CoreSets_hpp
+
+#include "MSRBackend.hpp"
+#include "MSRProbe.hpp"
+#include "ConfigSource.hpp"
+#include "ConfigParser.hpp"
+#include "ConfigValidator.hpp"
+#include "Topology.hpp"
+#include "MemoryBandwidth.hpp"
+
+/**
+ *  key=value fields of a core set policy: the HWP request fields at their
+ *  place in IA32_HWP_REQUEST, the prefetchers to disable (bits 3:0 of
+ *  MSR_MISC_FEATURE_CONTROL) and the on-demand clock modulation duty cycle
+ *  in 12.5% steps (0 turns it off), the capacity bit mask of the L3 cache
+ *  ways the set may fill (Intel RDT cache allocation, contiguous bits) and
+ *  the memory bandwidth throttle in 10% steps (Intel RDT bandwidth allocation)
+ */
+static constexpr ConfigField kCoreSetPolicyFields[] {
+    { "min",          7,  0 },
+    { "max",          15, 8 },
+    { "desired",      23, 16 },
+    { "epp",          31, 24 },
+    { "prefetch_off", 35, 32 },
+    { "duty",         38, 36 },
+    { "l3_mask",      59, 40 },
+    { "mba",          63, 60 },
+};
+
+/**
+ *  Named sets of cpus with a performance policy of their own, for machines
+ *  that pin a latency critical service and batch jobs to different cores.
+ *  "CoreSets" is an array of dictionaries:
+ *
+ *      Name        set name, up to 23 characters
+ *      CPUs        logical cpus, a list such as "0-3,8" or a bit mask number
+ *      Policy      fields of kCoreSetPolicyFields, e.g. "min=30 max=40 epp=0" (optional)
+ *      ConfigPath  file with policy fields, merged into the policy when it changes (optional)
+ *      BandwidthShare  percent of the memory traffic the set should cause at most (optional)
+ *
+ *  A cpu belongs to one set at most. A set whose policy changed is marked in
+ *  a dirty mask and apply() writes the registers of its cpus only, on all
+ *  of them at once; cpus of sets that did not change are not touched. The
+ *  bits any set changed are restored on every cpu by restore(). Published as
+ *  the "CoreSets" dictionary, created by init() so applying never allocates.
+ *
+ *  SMT siblings share one core and the hardware resolves their HWP requests
+ *  to about the highest performance of the two. After an apply the requests
+ *  of all cpus are read back and the request each core honours (highest min,
+ *  max and desired, lowest epp) is published in the "Siblings" dictionary.
+ *  Siblings with different requests are logged as a conflict, or get the
+ *  request of their core written if the siblings are merged. Once written,
+ *  the HWP request of these cpus belongs to the sets until restore(); the
+ *  HWP config, transactions and the frequency cap leave them alone.
+ *
+ *  On cpus with L3 cache allocation (CPUID.10H) set n uses class of service
+ *  n + 1: its l3_mask is written to IA32_L3_QOS_MASK_n+1 and its cpus are
+ *  associated with the class through IA32_PQR_ASSOC. Class 0 keeps the whole
+ *  cache for every other cpu. The mba field throttles the memory bandwidth of
+ *  the same class. A set with a BandwidthShare also gets resource monitoring
+ *  ID n + 1, and control() moves its throttle by one step per tick until its
+ *  share of the total memory traffic is within kShareDeadband of the target,
+ *  on processors with linear throttling only.
+ *  The masks, throttles and associations are restored on stop.
+ */
+class CoreSets {
+public:
+    static constexpr size_t kMaxSets = 8;
+    static constexpr uint32_t kMaxCPUs = Topology::kMaxCPUs;
+    static constexpr size_t kMaxNameLength = 23;
+    static constexpr size_t kPolicyLength = 128;
+
+    /**
+     *  Validate the declarations, read the registers the policies change on
+     *  every cpu and create the published dictionary
+     *
+     *  @param declarations  "CoreSets" array from Info.plist
+     *  @param backend       MSR backend to read and write through
+     *  @param probe         probe of the registers this machine has
+     *  @param topology      cpus and their cores
+     *  @param caps          HWP capabilities to validate HWP fields against
+     *  @param mergeSiblings write the request of the core to siblings that differ instead of logging them
+     *
+     *  @return true if at least one set was declared and the sets are usable
+     */
+    bool init(OSArray *declarations, MSRBackend *backend, MSRProbe &probe, const Topology &topology,
+              const HWPCapabilities &caps, const bool mergeSiblings);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    OSDictionary *getSiblingDictionary(void) const { return siblingDict; }
+
+    size_t getCount(void) const { return count; }
+
+    /**
+     *  @return cpus whose IA32_HWP_REQUEST a set has written, other writers must leave them alone
+     */
+    uint64_t getHWPCPUs(void) const { return hwpCPUs; }
+
+    /**
+     *  Merge the config files that changed into their policies
+     *
+     *  @param changed    incremented for every config file that changed
+     *  @param unchanged  incremented for every config file that did not
+     */
+    void refresh(uint32_t &changed, uint32_t &unchanged);
+
+    /**
+     *  Write the policies of the sets in the dirty mask to their cpus
+     */
+    void apply(void);
+
+    /**
+     *  Sample the memory traffic and adjust the throttle of the sets with a
+     *  BandwidthShare, called once per tick
+     */
+    void control(void);
+
+    /**
+     *  Request a core honours given the HWP requests of its siblings
+     *
+     *  @param requests  IA32_HWP_REQUEST of every cpu, indexed by cpu
+     *  @param cpus      siblings of the core
+     *
+     *  @return the highest min, max and desired (0, autonomous, if any is 0) and the lowest epp
+     */
+    static uint64_t effectiveHWPRequest(const uint64_t *requests, const uint64_t cpus);
+
+    /**
+     *  Write the bits the policies changed back to the value found by init()
+     */
+    void restore(void);
+
+private:
+    // registers a policy is made of
+    enum PolicyRegister {
+        kHWPRequest,
+        kPrefetcher,
+        kClockModulation,
+        kCacheClass,
+        kPolicyRegisterCount
+    };
+
+    static const uint32_t kPolicyMSRs[kPolicyRegisterCount];
+
+    // percent the measured share may differ from the target before the throttle moves
+    static constexpr uint32_t kShareDeadband = 2;
+
+    struct CoreSet {
+        char name[kMaxNameLength + 1];
+        uint64_t cpus;
+        // policy fields given, see kCoreSetPolicyFields
+        uint64_t value;
+        uint64_t mask;
+        uint64_t applies;
+        // target share of the memory traffic in percent, 0 without feedback
+        uint32_t targetShare;
+        // memory bandwidth throttle in percent
+        uint32_t delay;
+        OSNumber *policyNumber;
+        OSNumber *maskNumber;
+        OSNumber *appliesNumber;
+        OSNumber *delayNumber;
+        OSNumber *shareNumber;
+        ConfigSource source;
+    };
+
+    MSRBackend *backend = nullptr;
+    const Topology *topology = nullptr;
+    HWPCapabilities caps {};
+    uint32_t cpus = 0;
+    bool mergeSiblings = false;
+    // cpus written by apply(), all of them are restored
+    uint64_t written = 0;
+    // cpus whose HWP request was written by apply() or merged by coordinate()
+    uint64_t hwpCPUs = 0;
+    uint64_t conflicts = 0;
+    // L3 capacity bit mask length and highest class of service, 0 without cache allocation
+    uint8_t cbmLength = 0;
+    uint32_t l3Classes = 0;
+    // class n + 1 masks found by init() and classes written since
+    uint64_t originalL3Masks[kMaxSets] {};
+    uint32_t touchedClasses = 0;
+    MemoryBandwidth bandwidth;
+    // memory traffic per resource monitoring ID, ID 0 is every cpu outside a monitored set
+    uint64_t traffic[kMaxSets + 1] {};
+    bool feedback = false;
+    bool writable[kPolicyRegisterCount] {};
+    CoreSet sets[kMaxSets] {};
+    size_t count = 0;
+    // bit n marks sets[n] for the next apply()
+    uint32_t dirty = 0;
+    // bits any policy changed per register, and their values found by init()
+    uint64_t touched[kPolicyRegisterCount] {};
+    uint64_t original[kMaxCPUs * kPolicyRegisterCount] {};
+    uint64_t scratch[kMaxCPUs] {};
+    uint64_t requests[kMaxCPUs] {};
+
+    OSDictionary *dict = nullptr;
+    OSDictionary *siblingDict = nullptr;
+    // effective HWP request per core
+    OSNumber *coreNumbers[kMaxCPUs] {};
+    OSNumber *conflictsNumber = nullptr;
+
+    bool compile(OSDictionary *declaration, CoreSet &set, const uint64_t taken);
+    bool merge(CoreSet &set, const char *str, const size_t length, const char *where);
+    bool publish(void);
+
+    /**
+     *  Read back the HWP requests, publish the request of every core and handle siblings that differ
+     */
+    void coordinate(void);
+
+    /**
+     *  Bits of one register a policy changes
+     */
+    void split(const uint64_t value, const uint64_t mask, const PolicyRegister reg, const size_t set, uint64_t *bits, uint64_t *bitsMask) const;
+
+    /**
+     *  Detect L3 cache allocation and probe its registers
+     */
+    void detectCacheAllocation(MSRProbe &probe);
+};
+
+#endif /* CoreSets_hpp */
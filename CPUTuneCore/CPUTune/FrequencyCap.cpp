@@ -0,0 +1,210 @@
+//
+//  FrequencyCap.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "FrequencyCap.hpp"
+#include <kern/cpu_number.h>
+
+static const char *kMechanismNames[FrequencyCap::kMechanismCount] {
+    "none",
+    "turbo ratio limit",
+    "hwp maximum",
+    "perf ctl",
+};
+
+bool FrequencyCap::init(MSRBackend *backend, const Mechanism mechanism, const uint64_t limits, const uint8_t bins, const uint8_t cores,
+                        const uint32_t cpus) {
+    this->backend = backend;
+    this->mechanism = mechanism;
+    this->limits = limits;
+    // an unknown encoding still has at most one limit per byte
+    this->bins = bins > 0 && bins <= 8 ? bins : 8;
+    this->cores = cores > 0 ? cores : 1;
+    this->cpus = cpus < kMaxCPUs ? cpus : kMaxCPUs;
+    limited = false;
+    for (uint32_t cpu = 0; cpu < kMaxCPUs; cpu++) {
+        uncapped[cpu] = 0;
+        written[cpu] = 0;
+        uncappedMinimum[cpu] = 0;
+        writtenMinimum[cpu] = 0;
+    }
+    cap = 0;
+    writes = 0;
+
+    dict = OSDictionary::withCapacity(4);
+    if (!dict) {
+        return false;
+    }
+    OSString *mechanismString = OSString::withCString(kMechanismNames[mechanism]);
+    if (!mechanismString) {
+        free();
+        return false;
+    }
+    dict->setObject("Mechanism", mechanismString);
+    mechanismString->release();
+    activeCoresNumber = addNumberToDictionary(dict, "ActiveCores");
+    ratioNumber = addNumberToDictionary(dict, "Ratio");
+    writesNumber = addNumberToDictionary(dict, "Writes");
+    if (!activeCoresNumber || !ratioNumber || !writesNumber) {
+        free();
+        return false;
+    }
+    LOG("turbo ratio limits are enforced through %s", kMechanismNames[mechanism]);
+    return true;
+}
+
+void FrequencyCap::free() {
+    activeCoresNumber = nullptr;
+    ratioNumber = nullptr;
+    writesNumber = nullptr;
+    OSSafeReleaseNULL(dict);
+}
+
+void FrequencyCap::setLimits(const uint64_t value) {
+    limits = value;
+    limited = true;
+    LOG("turbo ratio limits 0x%llx are enforced through %s", value, kMechanismNames[mechanism]);
+}
+
+uint64_t FrequencyCap::limitHWPRequest(const uint64_t request, const uint8_t ratio) {
+    uint64_t value = msr::HWPMaximum::insert(request, ratio);
+    // a minimum above the maximum is undefined behaviour of HWP
+    if (msr::HWPMinimum::extract(value) > ratio) {
+        value = msr::HWPMinimum::insert(value, ratio);
+    }
+    return value;
+}
+
+uint64_t FrequencyCap::capHWPRequest(const uint64_t request) const {
+    if (mechanism != kMechanismHWPMaximum || !limited || cap == 0 || msr::HWPMaximum::extract(request) <= cap) {
+        return request;
+    }
+    return limitHWPRequest(request, cap);
+}
+
+void FrequencyCap::setUncapped(const uint64_t request) {
+    if (mechanism != kMechanismHWPMaximum || !limited || cap == 0) {
+        return;
+    }
+    const uint8_t maximum = static_cast<uint8_t>(msr::HWPMaximum::extract(request));
+    const uint8_t minimum = static_cast<uint8_t>(msr::HWPMinimum::extract(request));
+    const uint32_t cpu = static_cast<uint32_t>(cpu_number());
+    if (cpu < cpus) {
+        uncapped[cpu] = maximum;
+        written[cpu] = min<uint8_t>(maximum, cap);
+        uncappedMinimum[cpu] = minimum;
+        writtenMinimum[cpu] = min<uint8_t>(minimum, cap);
+    }
+}
+
+void FrequencyCap::update(const Telemetry &telemetry, const bool paused, const uint64_t excluded) {
+    // the read-only register already holds the limits the hardware enforces
+    if (!isEmulating() || !limited || paused || !dict) {
+        return;
+    }
+
+    uint32_t activeCores = 1;
+    const uint32_t sampled = telemetry.getCPUCount();
+    if (telemetry.getSampleCount() > 0 && sampled > 0) {
+        uint32_t activeThreads = 0;
+        for (uint32_t cpu = 0; cpu < sampled; cpu++) {
+            if (telemetry.getBusyPercent(cpu) >= kActiveBusyPercent) {
+                activeThreads++;
+            }
+        }
+        // busy siblings of one core count once
+        activeCores = (activeThreads * cores + sampled - 1) / sampled;
+    }
+    if (activeCores < 1) {
+        activeCores = 1;
+    } else if (activeCores > bins) {
+        activeCores = bins;
+    }
+    const uint8_t ratio = static_cast<uint8_t>(limits >> ((activeCores - 1) * 8));
+    activeCoresNumber->setValue(activeCores);
+    ratioNumber->setValue(ratio);
+    cap = ratio;
+    if (ratio == 0) {
+        return;
+    }
+
+    const uint32_t address = mechanism == kMechanismHWPMaximum ? msr::HWPRequest::address : msr::PerfCtl::address;
+    backend->readAllCPUs(&address, 1, values, cpus);
+    uint64_t changed = 0;
+    // core sets do not touch IA32_PERF_CTL
+    const uint64_t skipped = mechanism == kMechanismHWPMaximum ? excluded : 0;
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        if (skipped & (1ULL << cpu)) {
+            continue;
+        }
+        const bool hwp = mechanism == kMechanismHWPMaximum;
+        const uint8_t current = static_cast<uint8_t>(hwp ? msr::HWPMaximum::extract(values[cpu]) : msr::TargetRatio::extract(values[cpu]));
+        const uint8_t currentMinimum = static_cast<uint8_t>(hwp ? msr::HWPMinimum::extract(values[cpu]) : 0);
+        // anything but our own cap was written by someone else and becomes the value to return to
+        if (current != written[cpu] || currentMinimum != writtenMinimum[cpu]) {
+            uncapped[cpu] = current;
+            uncappedMinimum[cpu] = currentMinimum;
+        }
+        const uint8_t target = min<uint8_t>(uncapped[cpu], ratio);
+        const uint8_t targetMinimum = min<uint8_t>(uncappedMinimum[cpu], target);
+        written[cpu] = target;
+        writtenMinimum[cpu] = targetMinimum;
+        if (target == current && targetMinimum == currentMinimum) {
+            continue;
+        }
+        if (hwp) {
+            values[cpu] = msr::HWPMinimum::insert(msr::HWPMaximum::insert(values[cpu], target), targetMinimum);
+        } else {
+            values[cpu] = msr::TargetRatio::insert(values[cpu], target);
+        }
+        changed |= 1ULL << cpu;
+    }
+    if (!changed) {
+        return;
+    }
+    // the minimum follows the maximum down and returns with it
+    const uint64_t mask = mechanism == kMechanismHWPMaximum ? msr::HWPMaximum::mask | msr::HWPMinimum::mask : msr::TargetRatio::mask;
+    backend->updateCPUs(address, mask, values, changed);
+    writes++;
+    writesNumber->setValue(writes);
+}
+
+void FrequencyCap::restore(const uint64_t excluded) {
+    if (!isEmulating() || !limited || !dict) {
+        return;
+    }
+    const bool hwp = mechanism == kMechanismHWPMaximum;
+    const uint32_t address = hwp ? msr::HWPRequest::address : msr::PerfCtl::address;
+    backend->readAllCPUs(&address, 1, values, cpus);
+    uint64_t changed = 0;
+    const uint64_t skipped = hwp ? excluded : 0;
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        if ((skipped & (1ULL << cpu)) || written[cpu] == 0) {
+            continue;
+        }
+        const uint8_t current = static_cast<uint8_t>(hwp ? msr::HWPMaximum::extract(values[cpu]) : msr::TargetRatio::extract(values[cpu]));
+        const uint8_t currentMinimum = static_cast<uint8_t>(hwp ? msr::HWPMinimum::extract(values[cpu]) : 0);
+        // a value someone else wrote after the cap stays
+        if (current != written[cpu] || currentMinimum != writtenMinimum[cpu] ||
+            (current == uncapped[cpu] && currentMinimum == uncappedMinimum[cpu])) {
+            continue;
+        }
+        if (hwp) {
+            values[cpu] = msr::HWPMinimum::insert(msr::HWPMaximum::insert(values[cpu], uncapped[cpu]), uncappedMinimum[cpu]);
+        } else {
+            values[cpu] = msr::TargetRatio::insert(values[cpu], uncapped[cpu]);
+        }
+        written[cpu] = uncapped[cpu];
+        writtenMinimum[cpu] = uncappedMinimum[cpu];
+        changed |= 1ULL << cpu;
+    }
+    if (!changed) {
+        return;
+    }
+    const uint64_t mask = hwp ? msr::HWPMaximum::mask | msr::HWPMinimum::mask : msr::TargetRatio::mask;
+    backend->updateCPUs(address, mask, values, changed);
+    LOG("restored the uncapped ratio of cpus 0x%llx", changed);
+}
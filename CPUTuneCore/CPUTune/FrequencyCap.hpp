@@ -0,0 +1,136 @@
+//
+//  FrequencyCap.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef FrequencyCap_hpp
+#define FrequencyCap_hpp
+
+#include "MSRBackend.hpp"
+#include "Telemetry.hpp"
+
+/**
+ *  Turbo ratio limits for cpus whose MSR_TURBO_RATIO_LIMIT is read-only (most
+ *  locked mobile parts). The limits keep their meaning, the ratio with n
+ *  active cores, but are enforced per tick through the ratio ceiling of the
+ *  processor: a core counts as active if it was busy for at least half of the
+ *  last tick, and the limit of that many active cores caps the maximum of
+ *  IA32_HWP_REQUEST, or the target ratio of IA32_PERF_CTL without HWP.
+ *
+ *  The cap is written to every cpu at once and only lowers the ceiling: the
+ *  value found in the register of a cpu (e.g. set by the HWP config or the OS)
+ *  is kept as its uncapped ceiling and restored once the cap rises above it, along with an HWP minimum
+ *  the cap had to lower. The OS rewrites IA32_PERF_CTL on every
+ *  P-state change, so without HWP the cap holds for the rest of a tick at most.
+ *  The mechanism in use is published as the "FrequencyCap" dictionary.
+ */
+class FrequencyCap {
+public:
+    static constexpr uint32_t kMaxCPUs = 64;
+
+    enum Mechanism : uint8_t {
+        kMechanismNone,
+        kMechanismTurboRatioLimit,  // the register is writable, nothing to emulate
+        kMechanismHWPMaximum,
+        kMechanismPerfCtl,
+        kMechanismCount
+    };
+
+    /**
+     *  Create the published dictionary
+     *
+     *  @param backend    MSR backend to read and write through
+     *  @param mechanism  how the limits are enforced
+     *  @param limits     current MSR_TURBO_RATIO_LIMIT, the limits until setLimits()
+     *  @param bins       number of limits in use, see CPUInfo::turboRatioBins
+     *  @param cores      number of cores
+     *  @param cpus       number of logical cpus to cap
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *backend, const Mechanism mechanism, const uint64_t limits, const uint8_t bins, const uint8_t cores,
+              const uint32_t cpus);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    /**
+     *  @return true if turbo ratio limits are enforced through another register
+     */
+    bool isEmulating(void) const { return mechanism == kMechanismHWPMaximum || mechanism == kMechanismPerfCtl; }
+
+    uint64_t getLimits(void) const { return limits; }
+
+    /**
+     *  Set validated turbo ratio limits to enforce from the next update() on
+     */
+    void setLimits(const uint64_t value);
+
+    /**
+     *  Count the active cores and write the cap of that many active cores to every cpu
+     *
+     *  @param telemetry  last sample, without one the single core limit is used
+     *  @param paused     the ceiling register is owned by someone else (a sweep or experiment)
+     *  @param excluded   cpus whose IA32_HWP_REQUEST belongs to a core set, left uncapped
+     */
+    void update(const Telemetry &telemetry, const bool paused, const uint64_t excluded);
+
+    /**
+     *  Write the uncapped values back to every cpu that still holds the last
+     *  cap, must be called when CPUTune stops
+     *
+     *  @param excluded  cpus whose IA32_HWP_REQUEST belongs to a core set, restored by the sets
+     */
+    void restore(const uint64_t excluded);
+
+    /**
+     *  Cap an HWP request about to be written by someone else (the HWP config
+     *  or a transaction) so that it does not fight the cap every tick
+     *
+     *  @param request  IA32_HWP_REQUEST to write
+     *
+     *  @return request with the maximum (and minimum) at most the current cap
+     */
+    uint64_t capHWPRequest(const uint64_t request) const;
+
+    /**
+     *  Take the maximum and minimum of a request before capHWPRequest() as the
+     *  uncapped values of the current cpu, once the capped request was written there
+     *
+     *  @param request  IA32_HWP_REQUEST as given
+     */
+    void setUncapped(const uint64_t request);
+
+private:
+    static constexpr uint32_t kActiveBusyPercent = 50;
+
+    MSRBackend *backend = nullptr;
+    Mechanism mechanism = kMechanismNone;
+    uint64_t limits = 0;
+    bool limited = false;
+    uint8_t bins = 0;
+    uint8_t cores = 0;
+    uint32_t cpus = 0;
+    // ceiling found in the register of every cpu and the last cap written over it,
+    // with the HWP minimum the cap may have to lower along with it
+    uint8_t uncapped[kMaxCPUs] {};
+    uint8_t written[kMaxCPUs] {};
+    uint8_t uncappedMinimum[kMaxCPUs] {};
+    uint8_t writtenMinimum[kMaxCPUs] {};
+    uint64_t values[kMaxCPUs] {};
+    // limit of the active cores found by the last update(), 0 before
+    uint8_t cap = 0;
+    uint64_t writes = 0;
+
+    OSDictionary *dict = nullptr;
+    OSNumber *activeCoresNumber = nullptr;
+    OSNumber *ratioNumber = nullptr;
+    OSNumber *writesNumber = nullptr;
+
+    static uint64_t limitHWPRequest(const uint64_t request, const uint8_t ratio);
+};
+
+#endif /* FrequencyCap_hpp */
@@ -0,0 +1,267 @@
+//
+//  KnobTable.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "KnobTable.hpp"
+#include "Transaction.hpp"
+#include "CPUInfo.hpp"
+#include "CoreSets.hpp"
+#include "ConfigParser.hpp"
+
+// registers written by the built-in knobs and the core sets, a second writer would fight them
+static constexpr struct {
+    uint32_t first;
+    uint32_t last;
+} kReservedMSRs[] {
+    { msr::MiscEnable::address,         msr::MiscEnable::address },
+    { msr::PerfCtl::address,            msr::PerfCtl::address },
+    { msr::PowerCtl::address,           msr::PowerCtl::address },
+    { msr::PMEnable::address,           msr::PMEnable::address },
+    { msr::HWPRequest::address,         msr::HWPRequest::address },
+    { msr::TurboRatioLimit::address,    msr::TurboRatioLimit::address },
+    { msr::MiscFeatureControl::address, msr::MiscFeatureControl::address },
+    { msr::ClockModulation::address,    msr::ClockModulation::address },
+    // IA32_QM_EVTSEL, IA32_QM_CTR and IA32_PQR_ASSOC
+    { msr::QMEventSelect::address,      msr::PQRAssoc::address },
+    // the class masks and throttles of class 0 and the classes of the sets
+    { msr::L3QOSMask0::address,         msr::L3QOSMask0::address + CoreSets::kMaxSets },
+    { msr::MBAThrottle0::address,       msr::MBAThrottle0::address + MemoryBandwidth::kMaxClasses },
+};
+
+/**
+ *  Read an optional number of a declaration
+ *
+ *  @return false if the key holds something other than a number
+ */
+static bool getNumber(OSDictionary *declaration, const char *key, uint64_t *value) {
+    OSObject *object = declaration->getObject(key);
+    if (!object) {
+        return true;
+    }
+    OSNumber *number = OSDynamicCast(OSNumber, object);
+    if (!number) {
+        return false;
+    }
+    *value = number->unsigned64BitValue();
+    return true;
+}
+
+KnobTable::~KnobTable() {
+    free();
+}
+
+bool KnobTable::compile(OSDictionary *declaration, Knob &knob) const {
+    OSString *name = OSDynamicCast(OSString, declaration->getObject("Name"));
+    if (!name || name->getLength() == 0 || name->getLength() > kMaxNameLength) {
+        LOG("refuse knob: Name must have 1 to %lu characters", kMaxNameLength);
+        return false;
+    }
+    const char *str = name->getCStringNoCopy();
+    const size_t length = name->getLength();
+    for (size_t i = 0; i < length; i++) {
+        const char c = str[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_')) {
+            LOG("refuse knob %s: names consist of a-z, 0-9 and _", str);
+            return false;
+        }
+    }
+    if (Transaction::isReservedName(str, length) || find(str, length) >= 0) {
+        LOG("refuse knob %s: name is taken", str);
+        return false;
+    }
+    strlcpy(knob.name, str, sizeof(knob.name));
+
+    uint64_t address = UINT64_MAX;
+    uint64_t hi = 63;
+    uint64_t lo = 0;
+    if (!getNumber(declaration, "MSR", &address) || address > UINT32_MAX ||
+        !getNumber(declaration, "Hi", &hi) || !getNumber(declaration, "Lo", &lo)) {
+        LOG("refuse knob %s: needs an MSR address, Hi and Lo are numbers", str);
+        return false;
+    }
+    if (hi > 63 || lo > hi) {
+        LOG("refuse knob %s: bits %llu:%llu are not within the register", str, hi, lo);
+        return false;
+    }
+    for (size_t i = 0; i < arrsize(kReservedMSRs); i++) {
+        if (address >= kReservedMSRs[i].first && address <= kReservedMSRs[i].last) {
+            LOG("refuse knob %s: MSR 0x%llx is managed by CPUTune", str, address);
+            return false;
+        }
+    }
+    knob.msr = static_cast<uint32_t>(address);
+    knob.hi = static_cast<uint8_t>(hi);
+    knob.lo = static_cast<uint8_t>(lo);
+
+    const uint64_t fieldMax = knob.mask() >> knob.lo;
+    knob.minimum = 0;
+    knob.maximum = fieldMax;
+    if (!getNumber(declaration, "Min", &knob.minimum) || !getNumber(declaration, "Max", &knob.maximum) ||
+        knob.minimum > knob.maximum || knob.maximum > fieldMax) {
+        LOG("refuse knob %s: need Min <= Max <= 0x%llx", str, fieldMax);
+        return false;
+    }
+
+    knob.scope = kScopeThread;
+    if (OSString *scope = OSDynamicCast(OSString, declaration->getObject("Scope"))) {
+        if (scope->isEqualTo("package")) {
+            knob.scope = kScopePackage;
+        } else if (!scope->isEqualTo("thread")) {
+            LOG("refuse knob %s: Scope is thread or package", str);
+            return false;
+        }
+    }
+    knob.restoreOnStop = true;
+    if (OSBoolean *restore = OSDynamicCast(OSBoolean, declaration->getObject("RestoreOnStop"))) {
+        knob.restoreOnStop = restore->isTrue();
+    }
+    knob.source.path = nullptr;
+    if (OSString *path = OSDynamicCast(OSString, declaration->getObject("ConfigPath"))) {
+        knob.source.path = path->getCStringNoCopy();
+    }
+    return true;
+}
+
+bool KnobTable::init(OSArray *declarations, MSRBackend *backend, MSRProbe &probe, const uint32_t cpus) {
+    this->backend = backend;
+    this->cpus = cpus < kMaxCPUs ? cpus : kMaxCPUs;
+    allCPUs = this->cpus == kMaxCPUs ? ~0ULL : (1ULL << this->cpus) - 1;
+    count = 0;
+    if (!declarations || !backend || cpus == 0) {
+        return false;
+    }
+    if (declarations->getCount() > kMaxKnobs) {
+        LOG("only the first %lu of %u knobs are used", kMaxKnobs, declarations->getCount());
+    }
+    for (unsigned int i = 0; i < declarations->getCount() && count < kMaxKnobs; i++) {
+        OSDictionary *declaration = OSDynamicCast(OSDictionary, declarations->getObject(i));
+        if (!declaration || !compile(declaration, knobs[count])) {
+            continue;
+        }
+        if (!probe.probe(knobs[count].msr)) {
+            LOG("refuse knob %s: MSR 0x%x faults on this cpu", knobs[count].name, knobs[count].msr);
+            continue;
+        }
+        count++;
+    }
+    if (count == 0) {
+        return false;
+    }
+
+    dict = OSDictionary::withCapacity(static_cast<unsigned int>(count));
+    if (!dict) {
+        free();
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        Knob &knob = knobs[i];
+        knob.number = addNumberToDictionary(dict, knob.name);
+        if (!knob.number) {
+            free();
+            return false;
+        }
+        knob.original = backend->read(knob.msr);
+        if (knob.scope == kScopeThread) {
+            backend->readAllCPUs(&knob.msr, 1, &originals[i * kMaxCPUs], this->cpus);
+        }
+        knob.number->setValue(knob.extract(knob.original));
+        LOG("knob %s: MSR 0x%x bits %u:%u, %llu to %llu, now %llu", knob.name, knob.msr, knob.hi, knob.lo,
+            knob.minimum, knob.maximum, knob.extract(knob.original));
+    }
+    return true;
+}
+
+void KnobTable::free() {
+    for (size_t i = 0; i < count; i++) {
+        knobs[i].number = nullptr;
+    }
+    count = 0;
+    OSSafeReleaseNULL(dict);
+}
+
+int KnobTable::find(const char *name, const size_t length) const {
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(knobs[i].name, name, length) == 0 && knobs[i].name[length] == '\0') {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+ValidateStatus KnobTable::validate(const size_t i, const uint64_t value) const {
+    const Knob &knob = knobs[i];
+    return value < knob.minimum || value > knob.maximum ? kValidateOutOfRange : kValidateOK;
+}
+
+void KnobTable::apply(const size_t i, const uint64_t value) {
+    Knob &knob = knobs[i];
+    if (knob.scope == kScopeThread) {
+        for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+            values[cpu] = value << knob.lo;
+        }
+        backend->updateCPUs(knob.msr, knob.mask(), values, allCPUs);
+        LOG("knob %s: set %llu in MSR 0x%x on every cpu", knob.name, value, knob.msr);
+        knob.number->setValue(value);
+        return;
+    }
+    const uint64_t cur = backend->read(knob.msr);
+    const uint64_t val = (cur & ~knob.mask()) | ((value << knob.lo) & knob.mask());
+    if (cur != val) {
+        backend->write(knob.msr, val);
+        LOG("knob %s: change 0x%llx to 0x%llx in MSR 0x%x", knob.name, cur, val, knob.msr);
+    }
+    knob.number->setValue(value);
+}
+
+void KnobTable::refresh(uint32_t &changed, uint32_t &unchanged) {
+    for (size_t i = 0; i < count; i++) {
+        ConfigSource &source = knobs[i].source;
+        if (!source.path) {
+            continue;
+        }
+        if (!source.refresh(kValueLength)) {
+            unchanged++;
+            continue;
+        }
+        changed++;
+        if (!source.getContent()) {
+            continue;
+        }
+        uint64_t value = 0;
+        const ParseResult result = parseUInt64(source.getContent(), source.getLength(), 10, &value);
+        if (result.status != kParseOK) {
+            LOG("refuse %s: %s", source.path, parseStatusToString(result.status));
+            continue;
+        }
+        const ValidateStatus status = validate(i, value);
+        if (status != kValidateOK) {
+            LOG("refuse %llu from %s: %s", value, source.path, validateStatusToString(status));
+            continue;
+        }
+        apply(i, value);
+    }
+}
+
+void KnobTable::restore() {
+    for (size_t i = 0; i < count; i++) {
+        const Knob &knob = knobs[i];
+        if (!knob.restoreOnStop) {
+            continue;
+        }
+        if (knob.scope == kScopeThread) {
+            backend->updateCPUs(knob.msr, knob.mask(), &originals[i * kMaxCPUs], allCPUs);
+            LOG("knob %s: restore MSR 0x%x bits %u:%u on every cpu", knob.name, knob.msr, knob.hi, knob.lo);
+            continue;
+        }
+        // only the field, the rest of the register may have moved on
+        const uint64_t cur = backend->read(knob.msr);
+        const uint64_t val = (cur & ~knob.mask()) | (knob.original & knob.mask());
+        if (cur != val) {
+            backend->write(knob.msr, val);
+            LOG("knob %s: restore MSR 0x%x from 0x%llx to 0x%llx", knob.name, knob.msr, cur, val);
+        }
+    }
+}
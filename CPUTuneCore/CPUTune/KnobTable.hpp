@@ -0,0 +1,133 @@
+//
+//  KnobTable.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef KnobTable_hpp
+#define KnobTable_hpp
+
+#include "MSRBackend.hpp"
+#include "MSRField.hpp"
+#include "ConfigSource.hpp"
+#include "ConfigValidator.hpp"
+#include "MSRProbe.hpp"
+
+/**
+ *  Knobs declared in Info.plist rather than in code. "Knobs" is an array of
+ *  dictionaries:
+ *
+ *      Name           knob name in transactions, [a-z0-9_], up to 23 characters
+ *      MSR            register address
+ *      Hi, Lo         field bits
+ *      Min, Max       allowed field values (optional, whole field by default)
+ *      Scope          "thread" (default, written on every cpu) or "package" (written once)
+ *      RestoreOnStop  write the value found at init back on stop (optional, true)
+ *      ConfigPath     file with the field value, applied when it changes (optional)
+ *
+ *  init() compiles the declarations into a fixed table; declarations that do
+ *  not validate are skipped and logged, as are names of built-in knobs and the
+ *  registers CPUTune writes itself or that fault when probed. A thread knob is
+ *  applied with one read-modify-write on every cpu and restored to the value
+ *  each cpu had at init, a package knob with one on the current cpu. The
+ *  values are published as the "Knobs" dictionary, which is created by init()
+ *  so applying never allocates.
+ */
+class KnobTable {
+public:
+    static constexpr size_t kMaxKnobs = 16;
+    static constexpr uint32_t kMaxCPUs = 64;
+    static constexpr size_t kMaxNameLength = 23;
+    // a number of up to 64 bits in binary plus prefix and newline
+    static constexpr size_t kValueLength = 72;
+
+    struct Knob {
+        char name[kMaxNameLength + 1];
+        uint32_t msr;
+        uint8_t hi;
+        uint8_t lo;
+        RegisterScope scope;
+        bool restoreOnStop;
+        uint64_t minimum;
+        uint64_t maximum;
+        // register value found by init() on the current cpu
+        uint64_t original;
+        OSNumber *number;
+        ConfigSource source;
+
+        uint64_t mask(void) const { return (hi - lo == 63 ? ~0ULL : (1ULL << (hi - lo + 1)) - 1) << lo; }
+        uint64_t extract(const uint64_t reg) const { return (reg & mask()) >> lo; }
+    };
+
+    ~KnobTable();
+
+    /**
+     *  Validate the declarations, read the current value of every knob and
+     *  create the published dictionary
+     *
+     *  @param declarations  "Knobs" array from Info.plist
+     *  @param backend       MSR backend to read and write through
+     *  @param probe         probe of the registers this machine has
+     *  @param cpus          number of logical cpus thread knobs are written to
+     *
+     *  @return true if at least one knob was declared and the table is usable
+     */
+    bool init(OSArray *declarations, MSRBackend *backend, MSRProbe &probe, const uint32_t cpus);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    size_t getCount(void) const { return count; }
+
+    Knob &getKnob(const size_t i) { return knobs[i]; }
+
+    /**
+     *  Look up a knob by name
+     *
+     *  @param name    name, not terminated
+     *  @param length  length of name
+     *
+     *  @return index of the knob or -1
+     */
+    int find(const char *name, const size_t length) const;
+
+    /**
+     *  Check a field value against the declared range
+     */
+    ValidateStatus validate(const size_t i, const uint64_t value) const;
+
+    /**
+     *  Write a validated field value, on every cpu for a thread knob
+     */
+    void apply(const size_t i, const uint64_t value);
+
+    /**
+     *  Apply the config file of every knob that has one and changed
+     *
+     *  @param changed    incremented for every file that changed
+     *  @param unchanged  incremented for every file that did not
+     */
+    void refresh(uint32_t &changed, uint32_t &unchanged);
+
+    /**
+     *  Write the original value of every knob declared RestoreOnStop
+     */
+    void restore(void);
+
+private:
+    MSRBackend *backend = nullptr;
+    uint32_t cpus = 0;
+    uint64_t allCPUs = 0;
+    Knob knobs[kMaxKnobs] {};
+    // register of every cpu found by init() for the thread knobs, indexed by knob * kMaxCPUs + cpu
+    uint64_t originals[kMaxKnobs * kMaxCPUs] {};
+    uint64_t values[kMaxCPUs] {};
+    size_t count = 0;
+    OSDictionary *dict = nullptr;
+
+    bool compile(OSDictionary *declaration, Knob &knob) const;
+};
+
+#endif /* KnobTable_hpp */
@@ -0,0 +1,138 @@
+//
+//  MSRBackend.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "MSRBackend.hpp"
+#include <i386/proc_reg.h>
+#include <kern/cpu_number.h>
+
+/**
+ *  Runs action on every cpu with interrupts disabled, missing from headers
+ */
+extern "C" void mp_rendezvous_no_intrs(void (*action_func)(void *), void *arg);
+
+struct ReadAllCPUsContext {
+    const uint32_t *msrs;
+    size_t count;
+    uint64_t *values;
+    uint32_t cpus;
+};
+
+static void readAllCPUsAction(void *arg) {
+    auto ctx = static_cast<ReadAllCPUsContext *>(arg);
+    const uint32_t cpu = static_cast<uint32_t>(cpu_number());
+    if (cpu >= ctx->cpus) {
+        return;
+    }
+    uint64_t *values = ctx->values + cpu * ctx->count;
+    for (size_t i = 0; i < ctx->count; i++) {
+        values[i] = rdmsr64(ctx->msrs[i]);
+    }
+}
+
+struct UpdateCPUsContext {
+    uint32_t msr;
+    uint64_t mask;
+    const uint64_t *values;
+    uint64_t cpus;
+};
+
+static void updateCPUsAction(void *arg) {
+    auto ctx = static_cast<UpdateCPUsContext *>(arg);
+    const uint32_t cpu = static_cast<uint32_t>(cpu_number());
+    if (cpu >= 64 || !(ctx->cpus & (1ULL << cpu))) {
+        return;
+    }
+    const uint64_t cur = rdmsr64(ctx->msr);
+    const uint64_t val = (cur & ~ctx->mask) | (ctx->values[cpu] & ctx->mask);
+    if (cur != val) {
+        wrmsr64(ctx->msr, val);
+    }
+}
+
+uint64_t HardwareMSRBackend::read(const uint32_t msr) {
+    return rdmsr64(msr);
+}
+
+void HardwareMSRBackend::write(const uint32_t msr, const uint64_t value) {
+    wrmsr64(msr, value);
+}
+
+void HardwareMSRBackend::readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) {
+    ReadAllCPUsContext ctx {msrs, count, values, cpus};
+    mp_rendezvous_no_intrs(readAllCPUsAction, &ctx);
+}
+
+void HardwareMSRBackend::updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) {
+    UpdateCPUsContext ctx {msr, mask, values, cpus};
+    mp_rendezvous_no_intrs(updateCPUsAction, &ctx);
+}
+
+DryRunMSRBackend::ShadowRegister *DryRunMSRBackend::lookup(const uint32_t msr) {
+    for (size_t i = 0; i < shadowCount; i++) {
+        if (shadow[i].msr == msr) {
+            return &shadow[i];
+        }
+    }
+    return nullptr;
+}
+
+uint64_t DryRunMSRBackend::read(const uint32_t msr) {
+    if (ShadowRegister *reg = lookup(msr)) {
+        return reg->value;
+    }
+    return rdmsr64(msr);
+}
+
+void DryRunMSRBackend::write(const uint32_t msr, const uint64_t value) {
+    ShadowRegister *reg = lookup(msr);
+    if (!reg) {
+        if (shadowCount >= kMaxShadowRegisters) {
+            LOG("dry run: shadow register file is full, drop write 0x%llx to MSR(0x%x)", value, msr);
+            return;
+        }
+        reg = &shadow[shadowCount++];
+        reg->msr = msr;
+    }
+    reg->value = value;
+    LOG("dry run: MSR(0x%x) <- 0x%llx", msr, value);
+}
+
+void DryRunMSRBackend::readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) {
+    ReadAllCPUsContext ctx {msrs, count, values, cpus};
+    mp_rendezvous_no_intrs(readAllCPUsAction, &ctx);
+    for (size_t i = 0; i < count; i++) {
+        if (ShadowRegister *reg = lookup(msrs[i])) {
+            for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+                values[cpu * count + i] = reg->value;
+            }
+        }
+    }
+}
+
+uint64_t HardwareMSRBackend::writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) {
+    const boolean_t interrupts = ml_set_interrupts_enabled(FALSE);
+    wrmsr64(writeMsr, value);
+    const uint64_t result = rdmsr64(readMsr);
+    ml_set_interrupts_enabled(interrupts);
+    return result;
+}
+
+void DryRunMSRBackend::updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) {
+    if (cpus == 0) {
+        return;
+    }
+    // the shadow register file has one value for all cpus, the lowest selected cpu wins
+    const uint32_t cpu = static_cast<uint32_t>(__builtin_ctzll(cpus));
+    write(msr, (read(msr) & ~mask) | (values[cpu] & mask));
+    LOG("dry run: MSR(0x%x) bits 0x%llx on cpus 0x%llx", msr, mask, cpus);
+}
+
+uint64_t DryRunMSRBackend::writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) {
+    // the write stays in the shadow register file, the read sees what the processor has
+    write(writeMsr, value);
+    return read(readMsr);
+}
@@ -0,0 +1,113 @@
+//
+//  MSRBackend.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MSRBackend_hpp
+#define MSRBackend_hpp
+
+#include "kern_util.hpp"
+
+/**
+ *  Model specific register access used by CPUTune.
+ *  Every MSR read/write CPUTune issues goes through this interface so that
+ *  the tuning logic can run against something other than the real processor.
+ */
+class MSRBackend {
+public:
+    virtual ~MSRBackend() {}
+
+    /**
+     *  Read a model specific register on the current cpu
+     *
+     *  @param msr  register address
+     *
+     *  @return register value
+     */
+    virtual uint64_t read(const uint32_t msr) = 0;
+
+    /**
+     *  Write a model specific register on the current cpu
+     *
+     *  @param msr    register address
+     *  @param value  value to write
+     */
+    virtual void write(const uint32_t msr, const uint64_t value) = 0;
+
+    /**
+     *  Read a set of registers on every cpu in one go
+     *
+     *  @param msrs    register addresses
+     *  @param count   number of registers
+     *  @param values  receives cpus * count values, values[cpu * count + i] holds msrs[i]
+     *  @param cpus    number of cpus values has room for
+     */
+    virtual void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) = 0;
+
+    /**
+     *  Read-modify-write a register on a set of cpus in one go, every cpu
+     *  keeps the bits outside mask of its own value
+     *
+     *  @param msr     register address
+     *  @param mask    bits to change
+     *  @param values  new bits per cpu, values[cpu] for every selected cpu
+     *  @param cpus    bit n selects cpu n
+     */
+    virtual void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) = 0;
+
+    /**
+     *  Write a register and read another on the current cpu with interrupts
+     *  disabled in between, for a select and data pair (e.g. IA32_QM_EVTSEL
+     *  and IA32_QM_CTR) that a preemption could separate
+     *
+     *  @param writeMsr  register to write
+     *  @param value     value to write
+     *  @param readMsr   register to read afterwards
+     *
+     *  @return value of readMsr
+     */
+    virtual uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) = 0;
+};
+
+/**
+ *  Backend that talks to the processor via rdmsr/wrmsr
+ */
+class HardwareMSRBackend : public MSRBackend {
+public:
+    uint64_t read(const uint32_t msr) override;
+    void write(const uint32_t msr, const uint64_t value) override;
+    void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) override;
+    void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) override;
+    uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) override;
+};
+
+/**
+ *  Backend that never writes the processor (-cputdry).
+ *  Registers are read from hardware until CPUTune writes them, afterwards
+ *  the written value is kept in a shadow register file and returned instead
+ *  (for every cpu).
+ */
+class DryRunMSRBackend : public MSRBackend {
+public:
+    uint64_t read(const uint32_t msr) override;
+    void write(const uint32_t msr, const uint64_t value) override;
+    void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) override;
+    void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) override;
+    uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) override;
+
+private:
+    struct ShadowRegister {
+        uint32_t msr;
+        uint64_t value;
+    };
+
+    static constexpr size_t kMaxShadowRegisters = 32;
+    ShadowRegister shadow[kMaxShadowRegisters];
+    size_t shadowCount = 0;
+
+    ShadowRegister *lookup(const uint32_t msr);
+};
+
+#endif /* MSRBackend_hpp */
@@ -0,0 +1,113 @@
+//
+//  MSRField.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MSRField_hpp
+#define MSRField_hpp
+
+#include <stdint.h>
+
+/**
+ *  Whether a register holds a value per logical processor or one for the package
+ */
+enum RegisterScope : uint8_t {
+    kScopeThread,
+    kScopePackage,
+};
+
+/**
+ *  A model specific register
+ *
+ *  @tparam Address  register address
+ *  @tparam Scope    scope of the value
+ */
+template <uint32_t Address, RegisterScope Scope = kScopeThread>
+struct Msr {
+    static constexpr uint32_t address = Address;
+    static constexpr RegisterScope scope = Scope;
+};
+
+template <uint32_t Address, RegisterScope Scope>
+constexpr uint32_t Msr<Address, Scope>::address;
+
+template <uint32_t Address, RegisterScope Scope>
+constexpr RegisterScope Msr<Address, Scope>::scope;
+
+/**
+ *  Bits to change in one register: a read-modify-write of cur becomes
+ *  (cur & ~mask) | value. Updates of the same register combine with |, a
+ *  combination of constant updates folds into a single mask and value at
+ *  compile time, updates of different registers do not combine at all.
+ */
+template <typename Register>
+struct MsrUpdate {
+    uint64_t mask;
+    uint64_t value;
+
+    constexpr MsrUpdate operator|(const MsrUpdate &other) const {
+        return { mask | other.mask, (value & ~other.mask) | other.value };
+    }
+
+    constexpr uint64_t apply(const uint64_t current) const {
+        return (current & ~mask) | value;
+    }
+};
+
+/**
+ *  Bits Hi:Lo of a register
+ */
+template <typename Register, uint8_t Hi, uint8_t Lo>
+struct Field {
+    static_assert(Hi < 64, "field must lie within the 64 bit register");
+    static_assert(Lo <= Hi, "field must have its low bit at or below its high bit");
+
+    static constexpr uint8_t hi = Hi;
+    static constexpr uint8_t lo = Lo;
+    static constexpr uint8_t width = Hi - Lo + 1;
+    static constexpr uint64_t maxValue = width == 64 ? ~0ULL : (1ULL << width) - 1;
+    static constexpr uint64_t mask = maxValue << Lo;
+
+    static constexpr uint64_t extract(const uint64_t reg) {
+        return (reg & mask) >> Lo;
+    }
+
+    static constexpr uint64_t insert(const uint64_t reg, const uint64_t field) {
+        return (reg & ~mask) | ((field << Lo) & mask);
+    }
+
+    /**
+     *  Set the field to a value known at runtime, bits beyond the field are dropped
+     */
+    static constexpr MsrUpdate<Register> set(const uint64_t field) {
+        return { mask, (field << Lo) & mask };
+    }
+
+    /**
+     *  Set the field to a constant, checked to fit at compile time
+     */
+    template <uint64_t Value>
+    static constexpr MsrUpdate<Register> set() {
+        static_assert(Value <= maxValue, "value does not fit into the field");
+        return { mask, Value << Lo };
+    }
+};
+
+template <typename Register, uint8_t Hi, uint8_t Lo>
+constexpr uint8_t Field<Register, Hi, Lo>::hi;
+
+template <typename Register, uint8_t Hi, uint8_t Lo>
+constexpr uint8_t Field<Register, Hi, Lo>::lo;
+
+template <typename Register, uint8_t Hi, uint8_t Lo>
+constexpr uint8_t Field<Register, Hi, Lo>::width;
+
+template <typename Register, uint8_t Hi, uint8_t Lo>
+constexpr uint64_t Field<Register, Hi, Lo>::maxValue;
+
+template <typename Register, uint8_t Hi, uint8_t Lo>
+constexpr uint64_t Field<Register, Hi, Lo>::mask;
+
+#endif /* MSRField_hpp */
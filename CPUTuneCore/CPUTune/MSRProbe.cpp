@@ -0,0 +1,247 @@
+//
+//  MSRProbe.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "MSRProbe.hpp"
+
+/**
+ *  rdmsr that recovers from #GP, returns 0 on success, missing from headers
+ */
+extern "C" int rdmsr_carefully(uint32_t msr, uint32_t *lo, uint32_t *hi);
+
+// MSR_PLATFORM_INFO first, it decides if the turbo ratio limits are writable
+static constexpr uint32_t kCandidates[] {
+    msr::PlatformInfo::address,
+    msr::CoreThreadCount::address,
+    msr::MiscEnable::address,
+    msr::PerfStatus::address,
+    msr::PerfCtl::address,
+    msr::PowerCtl::address,
+    msr::PMEnable::address,
+    msr::HWPCapabilities::address,
+    msr::HWPRequest::address,
+    msr::RAPLPowerUnit::address,
+    msr::PackageEnergyStatus::address,
+    msr::PP0EnergyStatus::address,
+    msr::ThermStatus::address,
+    msr::PackageThermStatus::address,
+    msr::TemperatureTarget::address,
+    msr::CorePerfLimitReasonsHSW::address,
+    msr::CorePerfLimitReasons::address,
+    msr::TurboRatioLimit::address,
+    msr::TurboRatioLimit1::address,
+    msr::TurboRatioLimit2::address,
+    msr::MiscFeatureControl::address,
+    msr::ClockModulation::address,
+    MSR_IA32_MPERF,
+    MSR_IA32_APERF,
+};
+
+// registers of CPUModels.def, ModelDescriptor::registers or a column of their own
+struct ModelRegisterAddress {
+    uint32_t address;
+    ModelRegister flag;     // kModelRegNone for the uncore ratio limit and OC mailbox columns
+};
+
+static constexpr ModelRegisterAddress kModelRegisters[] {
+    { msr::TurboRatioLimit::address,  kModelRegTurboRatio },
+    { msr::TurboRatioLimit1::address, kModelRegTurboRatio },
+    { msr::TurboRatioLimit2::address, kModelRegTurboRatio },
+    { msr::PowerCtl::address,         kModelRegPowerCtl },
+    { msr::UncoreRatioLimit::address, kModelRegNone },
+    { msr::OCMailbox::address,        kModelRegNone },
+};
+
+// registers that report status or capabilities, CPUTune never writes them
+static constexpr uint32_t kReadOnly[] {
+    msr::PlatformInfo::address,
+    msr::CoreThreadCount::address,
+    msr::PerfStatus::address,
+    msr::HWPCapabilities::address,
+    msr::RAPLPowerUnit::address,
+    msr::PackageEnergyStatus::address,
+    msr::PP0EnergyStatus::address,
+    msr::ThermStatus::address,
+    msr::PackageThermStatus::address,
+    msr::TemperatureTarget::address,
+    msr::CorePerfLimitReasonsHSW::address,
+    msr::CorePerfLimitReasons::address,
+};
+
+bool MSRProbe::isWritableRegister(const uint32_t msr) const {
+    for (size_t i = 0; i < arrsize(kReadOnly); i++) {
+        if (msr == kReadOnly[i]) {
+            return false;
+        }
+    }
+    switch (msr) {
+        case msr::TurboRatioLimit::address:
+        case msr::TurboRatioLimit1::address:
+        case msr::TurboRatioLimit2::address:
+            return msr::TurboRatioLimitWritable::extract(platformInfo);
+        default:
+            return true;
+    }
+}
+
+bool MSRProbe::probe(const uint32_t msr) {
+    // including the ones markMissing() took as missing without reading them
+    if (test(probed, msr)) {
+        return test(readable, msr);
+    }
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    const bool ok = rdmsr_carefully(msr, &lo, &hi) == 0;
+    if (ok && msr == msr::PlatformInfo::address) {
+        platformInfo = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    if (msr >= kAddressLimit) {
+        return ok;
+    }
+    mark(probed, msr);
+    probedCount++;
+    if (ok) {
+        mark(readable, msr);
+        readableCount++;
+        if (isWritableRegister(msr)) {
+            mark(writable, msr);
+            writableCount++;
+        }
+    }
+    if (dict) {
+        probedNumber->setValue(probedCount);
+        readableNumber->setValue(readableCount);
+        writableNumber->setValue(writableCount);
+    }
+    return ok;
+}
+
+void MSRProbe::markMissing(const uint32_t msr) {
+    if (msr >= kAddressLimit || test(probed, msr)) {
+        return;
+    }
+    mark(probed, msr);
+    probedCount++;
+}
+
+bool MSRProbe::init(MSRBackend *next, const CPUInfo &info) {
+    this->next = next;
+    const uint64_t begin = mach_absolute_time();
+    // MSR_PLATFORM_INFO decides if the turbo ratio limits are writable, the
+    // model registers go before the candidates so that probe() skips what the model lacks
+    probe(msr::PlatformInfo::address);
+    for (size_t i = 0; i < arrsize(kModelRegisters); i++) {
+        const ModelRegisterAddress &reg = kModelRegisters[i];
+        const bool listed = reg.flag ? info.hasModelRegister(reg.flag) :
+                            reg.address == msr::UncoreRatioLimit::address ? info.hasUncoreRatioLimit() : info.hasOCMailbox();
+        if (listed) {
+            probe(reg.address);
+        } else {
+            markMissing(reg.address);
+        }
+    }
+    for (size_t i = 0; i < arrsize(kCandidates); i++) {
+        probe(kCandidates[i]);
+    }
+    uint64_t ns = 0;
+    absolutetime_to_nanoseconds(mach_absolute_time() - begin, &ns);
+    LOG("probed %u registers in %llu ns, %u readable, %u writable", probedCount, ns, readableCount, writableCount);
+
+    dict = OSDictionary::withCapacity(6);
+    if (!dict) {
+        return false;
+    }
+    probedNumber = addNumberToDictionary(dict, "Probed");
+    readableNumber = addNumberToDictionary(dict, "Readable");
+    writableNumber = addNumberToDictionary(dict, "Writable");
+    OSNumber *timeNumber = addNumberToDictionary(dict, "ProbeNanoseconds");
+    refusedReadsNumber = addNumberToDictionary(dict, "RefusedReads");
+    refusedWritesNumber = addNumberToDictionary(dict, "RefusedWrites");
+    if (!probedNumber || !readableNumber || !writableNumber || !timeNumber || !refusedReadsNumber || !refusedWritesNumber) {
+        free();
+        return false;
+    }
+    probedNumber->setValue(probedCount);
+    readableNumber->setValue(readableCount);
+    writableNumber->setValue(writableCount);
+    timeNumber->setValue(ns);
+    return true;
+}
+
+void MSRProbe::free() {
+    probedNumber = nullptr;
+    readableNumber = nullptr;
+    writableNumber = nullptr;
+    refusedReadsNumber = nullptr;
+    refusedWritesNumber = nullptr;
+    OSSafeReleaseNULL(dict);
+}
+
+uint64_t MSRProbe::read(const uint32_t msr) {
+    if (isProbed(msr) && !isReadable(msr)) {
+        refusedReads++;
+        if (refusedReadsNumber) {
+            refusedReadsNumber->setValue(refusedReads);
+        }
+        return 0;
+    }
+    return next->read(msr);
+}
+
+void MSRProbe::write(const uint32_t msr, const uint64_t value) {
+    if (isProbed(msr) && !isWritable(msr)) {
+        refusedWrites++;
+        if (refusedWritesNumber) {
+            refusedWritesNumber->setValue(refusedWrites);
+        }
+        return;
+    }
+    next->write(msr, value);
+}
+
+void MSRProbe::readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) {
+    // a single missing register would fault on every cpu, refuse the whole set
+    for (size_t i = 0; i < count; i++) {
+        if (isProbed(msrs[i]) && !isReadable(msrs[i])) {
+            refusedReads++;
+            if (refusedReadsNumber) {
+                refusedReadsNumber->setValue(refusedReads);
+            }
+            memset(values, 0, sizeof(uint64_t) * count * cpus);
+            return;
+        }
+    }
+    next->readAllCPUs(msrs, count, values, cpus);
+}
+
+void MSRProbe::updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) {
+    if (isProbed(msr) && !isWritable(msr)) {
+        refusedWrites++;
+        if (refusedWritesNumber) {
+            refusedWritesNumber->setValue(refusedWrites);
+        }
+        return;
+    }
+    next->updateCPUs(msr, mask, values, cpus);
+}
+
+uint64_t MSRProbe::writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) {
+    if (isProbed(writeMsr) && !isWritable(writeMsr)) {
+        refusedWrites++;
+        if (refusedWritesNumber) {
+            refusedWritesNumber->setValue(refusedWrites);
+        }
+        return 0;
+    }
+    if (isProbed(readMsr) && !isReadable(readMsr)) {
+        refusedReads++;
+        if (refusedReadsNumber) {
+            refusedReadsNumber->setValue(refusedReads);
+        }
+        return 0;
+    }
+    return next->writeRead(writeMsr, value, readMsr);
+}
@@ -0,0 +1,118 @@
+//
+//  MSRProbe.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MSRProbe_hpp
+#define MSRProbe_hpp
+
+#include "MSRBackend.hpp"
+#include "CPUInfo.hpp"
+
+/**
+ *  Finds out which registers this machine has instead of guessing from the
+ *  cpu model: init() reads every register CPUTune knows about once with
+ *  rdmsr_carefully, which returns an error instead of panicking on #GP, and
+ *  keeps the outcome in bitmaps indexed by address.
+ *
+ *  As a backend layer it answers reads of registers that faulted with 0 and
+ *  drops writes to registers that are not writable, both are counted in the
+ *  published "Probe" dictionary. Registers that were not probed pass through.
+ *
+ *  There is no fault tolerant wrmsr, so a register is writable if it could be
+ *  read, is not read-only by definition and its enable bit says so (e.g.
+ *  MSR_PLATFORM_INFO[28] for the turbo ratio limit).
+ *  Model specific registers CPUModels.def does not list for a known model
+ *  (turbo ratio limits, MSR_POWER_CTL, MSR_UNCORE_RATIO_LIMIT, the OC
+ *  mailbox) are taken as missing without reading them, an address a model
+ *  does not define may read fine but mean something else.
+ *  Registers are probed on the current cpu, every cpu of a package has the
+ *  same set.
+ */
+class MSRProbe : public MSRBackend {
+public:
+    // registers up to this address are kept in the bitmaps
+    static constexpr uint32_t kAddressLimit = 0x1000;
+
+    /**
+     *  Probe the known registers and create the published dictionary
+     *
+     *  @param next  backend the accesses are forwarded to
+     *  @param info  cpu whose model decides which model specific registers exist
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *next, const CPUInfo &info);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    /**
+     *  Probe one more register (e.g. a declared knob), may be called after init()
+     *
+     *  @param msr  register address
+     *
+     *  @return true if the register can be read
+     */
+    bool probe(const uint32_t msr);
+
+    bool isProbed(const uint32_t msr) const { return test(probed, msr); }
+
+    /**
+     *  @return true if the register was probed and can be read
+     */
+    bool isReadable(const uint32_t msr) const { return test(readable, msr); }
+
+    /**
+     *  @return true if the register was probed and can be written
+     */
+    bool isWritable(const uint32_t msr) const { return test(writable, msr); }
+
+    uint64_t read(const uint32_t msr) override;
+    void write(const uint32_t msr, const uint64_t value) override;
+    void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) override;
+    void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) override;
+    uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) override;
+
+private:
+    static constexpr size_t kWords = kAddressLimit / 64;
+
+    MSRBackend *next = nullptr;
+    uint64_t probed[kWords] {};
+    uint64_t readable[kWords] {};
+    uint64_t writable[kWords] {};
+    uint32_t probedCount = 0;
+    uint32_t readableCount = 0;
+    uint32_t writableCount = 0;
+    uint64_t refusedReads = 0;
+    uint64_t refusedWrites = 0;
+    // MSR_PLATFORM_INFO as probed, decides if the turbo ratio limit is writable
+    uint64_t platformInfo = 0;
+
+    OSDictionary *dict = nullptr;
+    OSNumber *probedNumber = nullptr;
+    OSNumber *readableNumber = nullptr;
+    OSNumber *writableNumber = nullptr;
+    OSNumber *refusedReadsNumber = nullptr;
+    OSNumber *refusedWritesNumber = nullptr;
+
+    static bool test(const uint64_t *map, const uint32_t msr) {
+        return msr < kAddressLimit && (map[msr / 64] & (1ULL << (msr % 64)));
+    }
+
+    static void mark(uint64_t *map, const uint32_t msr) {
+        map[msr / 64] |= 1ULL << (msr % 64);
+    }
+
+    bool isWritableRegister(const uint32_t msr) const;
+
+    /**
+     *  Count a register as probed and missing without reading it
+     */
+    void markMissing(const uint32_t msr);
+};
+
+#endif /* MSRProbe_hpp */
@@ -0,0 +1,202 @@
+//
+//  MSRRegisters.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MSRRegisters_hpp
+#define MSRRegisters_hpp
+
+#include "MSRField.hpp"
+
+/**
+ *  MSR addresses and their typed fields, free of kernel headers so that code
+ *  which only checks values against the register layout (ConfigValidator)
+ *  builds without <i386/cpuid.h> and <i386/proc_reg.h>. Include it after
+ *  <i386/proc_reg.h> where both are needed.
+ */
+
+// Architectural MSRs xnu/osfmk/proc_reg.h defines as well
+#ifndef MSR_PLATFORM_INFO
+#define MSR_PLATFORM_INFO           0xce
+#endif
+#ifndef MSR_IA32_MISC_ENABLE
+#define MSR_IA32_MISC_ENABLE        0x1a0
+#endif
+#ifndef MSR_IA32_PERF_STS
+#define MSR_IA32_PERF_STS           0x198
+#endif
+#ifndef MSR_IA32_PERF_CTL
+#define MSR_IA32_PERF_CTL           0x199
+#endif
+
+// As per xnu/osfmk/proc_reg.h
+#define MSR_CORE_THREAD_COUNT       0x35
+
+// Intel SpeedShift MSRs
+#define MSR_IA32_PM_ENABLE          0x770
+#define MSR_IA32_HWP_CAPABILITIES   0x771
+#define MSR_IA32_HWP_REQUEST        0x774
+
+// Intel Power MSRs
+#define MSR_IA32_POWER_CTL          0x1FC
+
+// Running Average Power Limit (RAPL) MSRs
+#define MSR_RAPL_POWER_UNIT         0x606
+#define MSR_PKG_ENERGY_STATUS       0x611
+#define MSR_PP0_ENERGY_STATUS       0x639
+
+// Thermal MSRs
+#ifndef MSR_IA32_THERM_STATUS
+#define MSR_IA32_THERM_STATUS       0x19C
+#endif
+#ifndef MSR_IA32_PACKAGE_THERM_STATUS
+#define MSR_IA32_PACKAGE_THERM_STATUS 0x1B1
+#endif
+#define MSR_TEMPERATURE_TARGET      0x1A2
+
+// Reasons the core frequency is limited, Haswell/Broadwell and Skylake+ clients
+#define MSR_CORE_PERF_LIMIT_REASONS_HSW 0x690
+#define MSR_CORE_PERF_LIMIT_REASONS     0x64F
+
+// Hardware prefetcher control and on-demand clock modulation
+#define MSR_MISC_FEATURE_CONTROL    0x1A4
+#ifndef MSR_IA32_CLOCK_MODULATION
+#define MSR_IA32_CLOCK_MODULATION   0x19A
+#endif
+
+// Intel Resource Director Technology, cache allocation
+#define MSR_IA32_PQR_ASSOC          0xC8F
+#define MSR_IA32_L3_QOS_MASK_0      0xC90
+// Memory bandwidth monitoring and allocation
+#define MSR_IA32_QM_EVTSEL          0xC8D
+#define MSR_IA32_QM_CTR             0xC8E
+#define MSR_IA32_L2_QOS_EXT_BW_THRTL_0 0xD50
+
+// Time stamp counter
+#define MSR_IA32_TIME_STAMP_COUNTER 0x10
+
+// Maximum Ratio Limit of Turbo Mode
+// RW or RO stores in MSR_PLATFORM_INFO.[28]
+// Refer Software Developer's Manual Volume 4: Model-Specific Registers
+#define MSR_TURBO_RATIO_LIMIT_RW    (1 << 28)
+#define MSR_TURBO_RATIO_LIMIT       0x1AD
+#define MSR_TURBO_RATIO_LIMIT1      0x1AE
+#define MSR_TURBO_RATIO_LIMIT2      0x1AF
+
+// Model specific, see CPUModels.def
+#define MSR_UNCORE_RATIO_LIMIT      0x620
+#define MSR_OC_MAILBOX              0x150
+
+/**
+ *  Typed registers and fields, see MSRField.hpp
+ */
+namespace msr {
+    using CoreThreadCount           = Msr<MSR_CORE_THREAD_COUNT, kScopePackage>;
+    using ThreadCount               = Field<CoreThreadCount, 15, 0>;
+    using CoreCount                 = Field<CoreThreadCount, 31, 16>;
+
+    using PlatformInfo              = Msr<MSR_PLATFORM_INFO, kScopePackage>;
+    using MaxNonTurboRatio          = Field<PlatformInfo, 15, 8>;
+    using TurboRatioLimitWritable   = Field<PlatformInfo, 28, 28>;
+    using MaxEfficiencyRatio        = Field<PlatformInfo, 47, 40>;
+
+    using MiscEnable                = Msr<MSR_IA32_MISC_ENABLE>;
+    using TurboModeDisable          = Field<MiscEnable, 38, 38>;
+
+    using PerfStatus                = Msr<MSR_IA32_PERF_STS>;
+    using PerfCtl                   = Msr<MSR_IA32_PERF_CTL>;
+    using TargetRatio               = Field<PerfCtl, 15, 8>;
+    // turbo off for this cpu only
+    using TurboDisengage            = Field<PerfCtl, 32, 32>;
+    using TimeStampCounter          = Msr<MSR_IA32_TIME_STAMP_COUNTER>;
+
+    using MiscFeatureControl        = Msr<MSR_MISC_FEATURE_CONTROL>;
+    // L2 hardware, L2 adjacent line, DCU and DCU IP prefetcher, a set bit disables
+    using PrefetcherDisable         = Field<MiscFeatureControl, 3, 0>;
+
+    using ClockModulation           = Msr<MSR_IA32_CLOCK_MODULATION>;
+    // duty cycle in 12.5% steps
+    using ClockModulationDuty       = Field<ClockModulation, 3, 1>;
+    using ClockModulationEnable     = Field<ClockModulation, 4, 4>;
+
+    using PQRAssoc                  = Msr<MSR_IA32_PQR_ASSOC>;
+    using ResourceMonitoringID      = Field<PQRAssoc, 9, 0>;
+    using ClassOfService            = Field<PQRAssoc, 63, 32>;
+    // IA32_L3_QOS_MASK_n follow at MSR_IA32_L3_QOS_MASK_0 + n
+    using L3QOSMask0                = Msr<MSR_IA32_L3_QOS_MASK_0, kScopePackage>;
+    // IA32_L2_QoS_Ext_BW_Thrtl_n follow at MSR_IA32_L2_QOS_EXT_BW_THRTL_0 + n
+    using MBAThrottle0              = Msr<MSR_IA32_L2_QOS_EXT_BW_THRTL_0, kScopePackage>;
+    using MBADelay                  = Field<MBAThrottle0, 15, 0>;
+
+    using QMEventSelect             = Msr<MSR_IA32_QM_EVTSEL>;
+    using QMEventID                 = Field<QMEventSelect, 7, 0>;
+    using QMResourceMonitoringID    = Field<QMEventSelect, 41, 32>;
+    using QMCounter                 = Msr<MSR_IA32_QM_CTR>;
+    using QMCounterData             = Field<QMCounter, 61, 0>;
+    using QMCounterUnavailable      = Field<QMCounter, 62, 62>;
+    using QMCounterError            = Field<QMCounter, 63, 63>;
+
+    using PowerCtl                  = Msr<MSR_IA32_POWER_CTL, kScopePackage>;
+    using BiDirectionalProcHot      = Field<PowerCtl, 0, 0>;
+
+    using PMEnable                  = Msr<MSR_IA32_PM_ENABLE, kScopePackage>;
+    using HWPEnable                 = Field<PMEnable, 0, 0>;
+
+    using HWPCapabilities           = Msr<MSR_IA32_HWP_CAPABILITIES>;
+    using HighestPerformance        = Field<HWPCapabilities, 7, 0>;
+    using GuaranteedPerformance     = Field<HWPCapabilities, 15, 8>;
+    using EfficientPerformance      = Field<HWPCapabilities, 23, 16>;
+    using LowestPerformance         = Field<HWPCapabilities, 31, 24>;
+
+    using HWPRequest                = Msr<MSR_IA32_HWP_REQUEST>;
+    using HWPMinimum                = Field<HWPRequest, 7, 0>;
+    using HWPMaximum                = Field<HWPRequest, 15, 8>;
+    using HWPDesired                = Field<HWPRequest, 23, 16>;
+    using HWPEnergyPerfPreference   = Field<HWPRequest, 31, 24>;
+    using HWPActivityWindow         = Field<HWPRequest, 41, 32>;
+    using HWPPackageControl         = Field<HWPRequest, 42, 42>;
+    using HWPRequestReserved        = Field<HWPRequest, 63, 43>;
+
+    using RAPLPowerUnit             = Msr<MSR_RAPL_POWER_UNIT, kScopePackage>;
+    using EnergyStatusUnit          = Field<RAPLPowerUnit, 12, 8>;
+    using PackageEnergyStatus       = Msr<MSR_PKG_ENERGY_STATUS, kScopePackage>;
+    using PP0EnergyStatus           = Msr<MSR_PP0_ENERGY_STATUS, kScopePackage>;
+    // the energy status registers count in bits 31:0 and wrap around
+    using PackageEnergy             = Field<PackageEnergyStatus, 31, 0>;
+    using PP0Energy                 = Field<PP0EnergyStatus, 31, 0>;
+
+    using ThermStatus               = Msr<MSR_IA32_THERM_STATUS>;
+    using ThermalStatus             = Field<ThermStatus, 0, 0>;
+    using ThermalStatusLog          = Field<ThermStatus, 1, 1>;
+    using DigitalReadout            = Field<ThermStatus, 22, 16>;
+    using ReadingValid              = Field<ThermStatus, 31, 31>;
+    using PackageThermStatus        = Msr<MSR_IA32_PACKAGE_THERM_STATUS, kScopePackage>;
+    using PackageDigitalReadout     = Field<PackageThermStatus, 22, 16>;
+    using TemperatureTarget         = Msr<MSR_TEMPERATURE_TARGET, kScopePackage>;
+    using TjMax                     = Field<TemperatureTarget, 23, 16>;
+    // TCC activates this many degrees below TjMax
+    using TCCActivationOffset       = Field<TemperatureTarget, 29, 24>;
+
+    using CorePerfLimitReasonsHSW   = Msr<MSR_CORE_PERF_LIMIT_REASONS_HSW, kScopePackage>;
+    using CorePerfLimitReasons      = Msr<MSR_CORE_PERF_LIMIT_REASONS, kScopePackage>;
+    // same bits in both layouts, the log of a status bit is 16 bits above it
+    using LimitThermal              = Field<CorePerfLimitReasons, 1, 1>;
+    using LimitMaxTurbo             = Field<CorePerfLimitReasons, 12, 12>;
+    using LimitStatus               = Field<CorePerfLimitReasons, 15, 0>;
+
+    using TurboRatioLimit           = Msr<MSR_TURBO_RATIO_LIMIT, kScopePackage>;
+    using TurboRatioLimit1          = Msr<MSR_TURBO_RATIO_LIMIT1, kScopePackage>;
+    using TurboRatioLimit2          = Msr<MSR_TURBO_RATIO_LIMIT2, kScopePackage>;
+    // ratio limit with n active cores
+    template <uint8_t n>
+    using TurboRatioActiveCores     = Field<TurboRatioLimit, n * 8 - 1, n * 8 - 8>;
+
+    using UncoreRatioLimit          = Msr<MSR_UNCORE_RATIO_LIMIT, kScopePackage>;
+    using UncoreMaxRatio            = Field<UncoreRatioLimit, 6, 0>;
+    using UncoreMinRatio            = Field<UncoreRatioLimit, 14, 8>;
+    using OCMailbox                 = Msr<MSR_OC_MAILBOX>;
+}
+
+#endif /* MSRRegisters_hpp */
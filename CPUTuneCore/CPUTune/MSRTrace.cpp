@@ -0,0 +1,133 @@
+//
+//  MSRTrace.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "MSRTrace.hpp"
+#include "ChromeTrace.hpp"
+#include <kern/clock.h>
+#include <kern/cpu_number.h>
+
+RecordingMSRBackend::~RecordingMSRBackend() {
+    if (records) {
+        kern_os_free(records);
+        records = nullptr;
+    }
+}
+
+bool RecordingMSRBackend::init(MSRBackend *next, const uint32_t capacity) {
+    if (!next || capacity == 0) {
+        return false;
+    }
+    records = static_cast<MSRTraceRecord *>(kern_os_malloc(sizeof(MSRTraceRecord) * capacity));
+    if (!records) {
+        LOG("cannot allocate %u trace records", capacity);
+        return false;
+    }
+    this->next = next;
+    this->capacity = capacity;
+    readCapacity = capacity - capacity / kWriteShare;
+    count = 0;
+    dropped = 0;
+    return true;
+}
+
+void RecordingMSRBackend::record(const MSRTraceOp op, const uint32_t msr, const uint64_t value, const uint16_t cpu,
+                                 const uint64_t timestamp) {
+    if (count >= (op == kMSRTraceWrite ? capacity : readCapacity)) {
+        dropped++;
+        return;
+    }
+    MSRTraceRecord &rec = records[count++];
+    rec.timestamp = timestamp;
+    rec.value = value;
+    rec.msr = msr;
+    rec.cpu = cpu;
+    rec.op = op;
+    rec.reserved = 0;
+}
+
+uint64_t RecordingMSRBackend::read(const uint32_t msr) {
+    const uint64_t value = next->read(msr);
+    record(kMSRTraceRead, msr, value, static_cast<uint16_t>(cpu_number()));
+    return value;
+}
+
+void RecordingMSRBackend::write(const uint32_t msr, const uint64_t value) {
+    record(kMSRTraceWrite, msr, value, static_cast<uint16_t>(cpu_number()));
+    next->write(msr, value);
+}
+
+void RecordingMSRBackend::readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) {
+    next->readAllCPUs(msrs, count, values, cpus);
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        for (size_t i = 0; i < count; i++) {
+            record(kMSRTraceRead, msrs[i], values[cpu * count + i], static_cast<uint16_t>(cpu));
+        }
+    }
+}
+
+void RecordingMSRBackend::updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) {
+    // the bits written, the rest of every register stays as it was
+    for (uint32_t cpu = 0; cpu < 64; cpu++) {
+        if (cpus & (1ULL << cpu)) {
+            record(kMSRTraceWrite, msr, values[cpu] & mask, static_cast<uint16_t>(cpu));
+        }
+    }
+    next->updateCPUs(msr, mask, values, cpus);
+}
+
+uint64_t RecordingMSRBackend::writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) {
+    const uint16_t cpu = static_cast<uint16_t>(cpu_number());
+    record(kMSRTraceWrite, writeMsr, value, cpu);
+    const uint64_t result = next->writeRead(writeMsr, value, readMsr);
+    record(kMSRTraceRead, readMsr, result, cpu);
+    return result;
+}
+
+void RecordingMSRBackend::recordTick(const uint64_t begin, const uint64_t end) {
+    record(kMSRTraceTick, 0, end - begin, static_cast<uint16_t>(cpu_number()), begin);
+}
+
+void RecordingMSRBackend::recordFrequency(const uint16_t cpu, const uint32_t mhz) {
+    record(kMSRTraceFrequency, 0, mhz, cpu);
+}
+
+errno_t RecordingMSRBackend::saveChromeTrace(const char *path) const {
+    if (!path || !records) {
+        return EINVAL;
+    }
+    const errno_t err = writeChromeTrace(path, records, count, dropped);
+    if (!err) {
+        LOG("saved %u MSR trace records (%llu dropped) as Chrome trace to %s", count, dropped, path);
+    }
+    return err;
+}
+
+errno_t RecordingMSRBackend::save(const char *path) const {
+    if (!path || !records) {
+        return EINVAL;
+    }
+    mach_timebase_info_data_t timebase;
+    clock_timebase_info(&timebase);
+
+    MSRTraceHeader header {};
+    header.magic = kTraceMagic;
+    header.version = kTraceVersion;
+    header.recordSize = sizeof(MSRTraceRecord);
+    header.timebaseNumer = timebase.numer;
+    header.timebaseDenom = timebase.denom;
+    header.recordCount = count;
+    header.droppedCount = dropped;
+
+    errno_t err = writeBytesToFile(path, &header, sizeof(header), 0);
+    if (!err && count > 0) {
+        err = writeBytesToFile(path, records, sizeof(MSRTraceRecord) * count, sizeof(header));
+    }
+    if (!err) {
+        LOG("saved %u MSR trace records (%llu dropped) to %s", count, dropped, path);
+    }
+    return err;
+}
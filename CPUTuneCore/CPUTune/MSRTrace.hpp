@@ -0,0 +1,128 @@
+//
+//  MSRTrace.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MSRTrace_hpp
+#define MSRTrace_hpp
+
+#include "MSRBackend.hpp"
+
+/**
+ *  Kind of access stored in a trace record
+ */
+enum MSRTraceOp : uint8_t {
+    kMSRTraceRead      = 0,
+    kMSRTraceWrite     = 1,
+    // timer tick: timestamp is the start, value the duration in absolute time units, msr 0
+    kMSRTraceTick      = 2,
+    // telemetry sample: value is the effective frequency of cpu in MHz, msr 0
+    kMSRTraceFrequency = 3,
+};
+
+/**
+ *  Trace file layout: one MSRTraceHeader followed by recordCount MSRTraceRecord,
+ *  all little endian. Timestamps are in mach absolute time units, multiply by
+ *  timebaseNumer / timebaseDenom to get nanoseconds.
+ */
+struct MSRTraceHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t timebaseNumer;
+    uint32_t timebaseDenom;
+    uint64_t recordCount;
+    uint64_t droppedCount;
+} PACKED;
+
+struct MSRTraceRecord {
+    uint64_t timestamp;
+    uint64_t value;
+    uint32_t msr;
+    uint16_t cpu;
+    uint8_t op;
+    uint8_t reserved;
+} PACKED;
+
+static_assert(sizeof(MSRTraceHeader) == 32, "MSRTraceHeader is part of the trace file format");
+static_assert(sizeof(MSRTraceRecord) == 24, "MSRTraceRecord is part of the trace file format");
+
+/**
+ *  Backend that records every access forwarded to another backend.
+ *  Records go to a buffer allocated once by init(); when the buffer is full
+ *  further accesses are still forwarded but only counted as dropped, so the
+ *  trace always keeps the initial register state. Telemetry reads every
+ *  register of every cpu on each tick, so everything but writes stops at
+ *  capacity - capacity / kWriteShare records, the rest is kept for writes.
+ */
+class RecordingMSRBackend : public MSRBackend {
+public:
+    ~RecordingMSRBackend();
+
+    static constexpr uint32_t kTraceMagic = 0x54555043; // "CPUT"
+    static constexpr uint16_t kTraceVersion = 2;
+    // 1 / kWriteShare of the records is reserved for writes
+    static constexpr uint32_t kWriteShare = 4;
+
+    /**
+     *  Preallocate the record buffer and start recording
+     *
+     *  @param next      backend the accesses are forwarded to
+     *  @param capacity  maximum number of records
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *next, const uint32_t capacity);
+
+    uint64_t read(const uint32_t msr) override;
+    void write(const uint32_t msr, const uint64_t value) override;
+    void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) override;
+    void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) override;
+    uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) override;
+
+    bool isRecording(void) const { return records != nullptr; }
+
+    /**
+     *  Record a timer tick
+     *
+     *  @param begin  mach absolute time the tick started
+     *  @param end    mach absolute time the tick ended
+     */
+    void recordTick(const uint64_t begin, const uint64_t end);
+
+    /**
+     *  Record the effective frequency of a cpu
+     */
+    void recordFrequency(const uint16_t cpu, const uint32_t mhz);
+
+    /**
+     *  Write the trace recorded so far to path
+     *
+     *  @return 0 on success or errno on error
+     */
+    errno_t save(const char *path) const;
+
+    /**
+     *  Write the trace recorded so far to path as Chrome trace-event JSON
+     *  (chrome://tracing, ui.perfetto.dev), one track per cpu
+     *
+     *  @return 0 on success or errno on error
+     */
+    errno_t saveChromeTrace(const char *path) const;
+
+private:
+    MSRBackend *next = nullptr;
+    MSRTraceRecord *records = nullptr;
+    uint32_t capacity = 0;
+    // records reads, ticks and frequencies may fill
+    uint32_t readCapacity = 0;
+    uint32_t count = 0;
+    uint64_t dropped = 0;
+
+    void record(const MSRTraceOp op, const uint32_t msr, const uint64_t value, const uint16_t cpu,
+                const uint64_t timestamp = mach_absolute_time());
+};
+
+#endif /* MSRTrace_hpp */
@@ -0,0 +1,108 @@
+//
+//  MemoryBandwidth.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "MemoryBandwidth.hpp"
+#include "CPUInfo.hpp"
+
+bool MemoryBandwidth::init(MSRBackend *backend, MSRProbe &probe) {
+    this->backend = backend;
+    classes = 0;
+    maxDelay = 0;
+    linear = false;
+    rmids = 0;
+    touched = 0;
+    primed = false;
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000000, cpuid_reg);
+    if (!backend || cpuid_reg[eax] < 0x10) {
+        return false;
+    }
+    // CPUID.(EAX=07H, ECX=0):EBX[12] monitoring, EBX[15] allocation
+    do_cpuid(0x00000007, cpuid_reg);
+    const bool monitoring = bitfield32(cpuid_reg[ebx], 12, 12);
+    const bool allocation = bitfield32(cpuid_reg[ebx], 15, 15);
+
+    if (allocation) {
+        // CPUID.(EAX=10H, ECX=0):EBX[3] memory bandwidth allocation
+        do_cpuid(0x00000010, cpuid_reg);
+        if (bitfield32(cpuid_reg[ebx], 3, 3)) {
+            cpuid_reg[eax] = 0x00000010;
+            cpuid_reg[ecx] = 3;
+            cpuid(cpuid_reg);
+            maxDelay = bitfield32(cpuid_reg[eax], 11, 0) + 1;
+            linear = bitfield32(cpuid_reg[ecx], 2, 2);
+            const uint32_t highest = bitfield32(cpuid_reg[edx], 15, 0);
+            while (classes < highest && classes < kMaxClasses && probe.probe(msr::MBAThrottle0::address + classes + 1)) {
+                classes++;
+                original[classes] = backend->read(msr::MBAThrottle0::address + classes);
+            }
+        }
+    }
+
+    if (monitoring) {
+        // CPUID.(EAX=0FH, ECX=0):EDX[1] L3 monitoring
+        do_cpuid(0x0000000F, cpuid_reg);
+        if (bitfield32(cpuid_reg[edx], 1, 1)) {
+            cpuid_reg[eax] = 0x0000000F;
+            cpuid_reg[ecx] = 1;
+            cpuid(cpuid_reg);
+            // EDX[1] total bandwidth event, ECX highest RMID, EAX[7:0] counter width beyond 24 bits
+            const uint32_t width = 24 + bitfield32(cpuid_reg[eax], 7, 0);
+            const uint32_t highest = cpuid_reg[ecx];
+            if (bitfield32(cpuid_reg[edx], 1, 1) && probe.probe(msr::QMCounter::address) &&
+                probe.probe(msr::QMEventSelect::address)) {
+                rmids = highest + 1 < kMaxClasses + 1 ? highest + 1 : kMaxClasses + 1;
+                counterMask = width >= 62 ? msr::QMCounterData::maxValue : (1ULL << width) - 1;
+            }
+        }
+    }
+    if (classes == 0) {
+        return false;
+    }
+    LOG("memory bandwidth allocation: %s delay up to %u%%, classes 1 to %u, %u monitoring IDs",
+        linear ? "linear" : "non-linear", maxDelay, classes, rmids);
+    return true;
+}
+
+void MemoryBandwidth::setThrottle(const uint32_t cos, const uint32_t delay) {
+    if (cos == 0 || cos > classes) {
+        return;
+    }
+    backend->write(msr::MBAThrottle0::address + cos, msr::MBADelay::insert(original[cos], delay < maxDelay ? delay : maxDelay));
+    touched |= 1U << cos;
+}
+
+bool MemoryBandwidth::sample(const uint32_t count, uint64_t *deltas) {
+    bool valid = primed;
+    for (uint32_t rmid = 0; rmid < count && rmid < rmids; rmid++) {
+        uint64_t select = msr::QMEventID::insert(0, kTotalBandwidthEvent);
+        select = msr::QMResourceMonitoringID::insert(select, rmid);
+        // another select between the two would return the counter of another event or ID
+        const uint64_t counter = backend->writeRead(msr::QMEventSelect::address, select, msr::QMCounter::address);
+        if (msr::QMCounterError::extract(counter) || msr::QMCounterUnavailable::extract(counter)) {
+            valid = false;
+            deltas[rmid] = 0;
+            continue;
+        }
+        const uint64_t value = msr::QMCounterData::extract(counter) & counterMask;
+        // the counter wraps at its width
+        deltas[rmid] = (value - previous[rmid]) & counterMask;
+        previous[rmid] = value;
+    }
+    primed = true;
+    return valid;
+}
+
+void MemoryBandwidth::restore() {
+    for (uint32_t cos = 1; cos <= classes; cos++) {
+        if (touched & (1U << cos)) {
+            backend->write(msr::MBAThrottle0::address + cos, original[cos]);
+            LOG("restore IA32_L2_QoS_Ext_BW_Thrtl_%u to 0x%llx", cos, original[cos]);
+        }
+    }
+    touched = 0;
+}
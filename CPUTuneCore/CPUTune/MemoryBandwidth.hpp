@@ -0,0 +1,101 @@
+//
+//  MemoryBandwidth.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MemoryBandwidth_hpp
+#define MemoryBandwidth_hpp
+
+#include "MSRBackend.hpp"
+#include "MSRProbe.hpp"
+
+/**
+ *  Intel RDT memory bandwidth allocation and monitoring. A class of service
+ *  is throttled by the delay in IA32_L2_QoS_Ext_BW_Thrtl_n (CPUID.(10H,3)),
+ *  and the memory traffic of a resource monitoring ID is read from the
+ *  total bandwidth event of IA32_QM_CTR (CPUID.(0FH,1)), selected through
+ *  IA32_QM_EVTSEL on the same cpu with interrupts disabled. Both are package
+ *  scoped and accessed on the current cpu. Throttles written are restored by
+ *  restore().
+ */
+class MemoryBandwidth {
+public:
+    static constexpr uint32_t kMaxClasses = 8;
+    // delays are requested in steps of 10%, the granularity of linear throttling
+    static constexpr uint32_t kDelayStep = 10;
+
+    /**
+     *  Detect allocation and monitoring, probe their registers and read the
+     *  throttles of classes 1 to kMaxClasses
+     *
+     *  @param backend  MSR backend to read and write through
+     *  @param probe    probe of the registers this machine has
+     *
+     *  @return true if bandwidth allocation is usable
+     */
+    bool init(MSRBackend *backend, MSRProbe &probe);
+
+    /**
+     *  @return number of classes from 1 on that can be throttled
+     */
+    uint32_t getClasses(void) const { return classes; }
+
+    /**
+     *  @return highest delay the processor takes, in percent
+     */
+    uint32_t getMaxDelay(void) const { return maxDelay; }
+
+    /**
+     *  @return true if the delay scales the bandwidth linearly (CPUID.(10H,3):ECX[2]),
+     *          otherwise a delay step need not change the bandwidth at all
+     */
+    bool isLinear(void) const { return linear; }
+
+    bool hasMonitoring(void) const { return rmids > 0; }
+
+    /**
+     *  @return number of resource monitoring IDs from 0 on that can be sampled
+     */
+    uint32_t getRMIDs(void) const { return rmids; }
+
+    /**
+     *  Throttle a class of service
+     *
+     *  @param cos    class from 1 to getClasses()
+     *  @param delay  delay in percent, at most getMaxDelay()
+     */
+    void setThrottle(const uint32_t cos, const uint32_t delay);
+
+    /**
+     *  Read the total memory bandwidth counter of resource monitoring IDs
+     *
+     *  @param count   number of IDs from 0 on, at most getRMIDs()
+     *  @param deltas  receives the traffic of every ID since the previous sample, in counter units
+     *
+     *  @return false on the first sample or if a counter was unavailable
+     */
+    bool sample(const uint32_t count, uint64_t *deltas);
+
+    /**
+     *  Write the throttles back to the value found by init()
+     */
+    void restore(void);
+
+private:
+    static constexpr uint8_t kTotalBandwidthEvent = 2;
+
+    MSRBackend *backend = nullptr;
+    uint32_t classes = 0;
+    uint32_t maxDelay = 0;
+    bool linear = false;
+    uint32_t rmids = 0;
+    uint64_t counterMask = 0;
+    uint64_t original[kMaxClasses + 1] {};
+    uint32_t touched = 0;
+    uint64_t previous[kMaxClasses + 1] {};
+    bool primed = false;
+};
+
+#endif /* MemoryBandwidth_hpp */
@@ -0,0 +1,130 @@
+//
+//  MetricsExporter.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "MetricsExporter.hpp"
+#include <stdarg.h>
+
+/**
+ *  Limit reasons shared by the Haswell and Skylake core perf limit reasons layouts
+ */
+static constexpr struct {
+    uint8_t bit;
+    const char *reason;
+} kThrottleReasons[] {
+    { 0,  "prochot" },
+    { 1,  "thermal" },
+    { 10, "pl1" },
+    { 11, "pl2" },
+    { 12, "max_turbo" },
+    { 13, "turbo_attenuation" },
+};
+
+MetricsExporter::~MetricsExporter() {
+    free();
+}
+
+bool MetricsExporter::init(const uint32_t cpus) {
+    capacity = kFixedBytes + kBytesPerCPU * cpus;
+    buffer = static_cast<char *>(kern_os_malloc(capacity));
+    if (!buffer) {
+        capacity = 0;
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::free() {
+    if (buffer) {
+        kern_os_free(buffer);
+        buffer = nullptr;
+    }
+    capacity = 0;
+    length = 0;
+}
+
+void MetricsExporter::append(const char *format, ...) {
+    if (overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(buffer + length, capacity - length, format, args);
+    va_end(args);
+    if (written < 0 || static_cast<size_t>(written) >= capacity - length) {
+        overflow = true;
+        return;
+    }
+    length += static_cast<size_t>(written);
+}
+
+void MetricsExporter::family(const char *name, const char *type, const char *help) {
+    append("# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+size_t MetricsExporter::render(const Telemetry &telemetry, const uint64_t msrWrites, const uint64_t ticks) {
+    if (!buffer) {
+        return 0;
+    }
+    length = 0;
+    overflow = false;
+    const uint32_t cpus = telemetry.getCPUCount();
+
+    family("cputune_cpu_frequency_mhz", "gauge", "Effective frequency since the previous sample.");
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        append("cputune_cpu_frequency_mhz{cpu=\"%u\"} %u\n", cpu, telemetry.getEffectiveFrequencyMHz(cpu));
+    }
+    family("cputune_cpu_busy_percent", "gauge", "Share of time in C0 since the previous sample.");
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        append("cputune_cpu_busy_percent{cpu=\"%u\"} %u\n", cpu, telemetry.getBusyPercent(cpu));
+    }
+    if (telemetry.hasTemperature()) {
+        family("cputune_cpu_temperature_celsius", "gauge", "Digital thermal sensor reading.");
+        for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+            append("cputune_cpu_temperature_celsius{cpu=\"%u\"} %d\n", cpu, telemetry.getTemperatureC(cpu));
+        }
+    }
+    if (telemetry.hasPackageTemperature()) {
+        family("cputune_package_temperature_celsius", "gauge", "Package thermal sensor reading.");
+        append("cputune_package_temperature_celsius %d\n", telemetry.getPackageTemperatureC());
+    }
+
+    family("cputune_package_power_milliwatts", "gauge", "RAPL package power since the previous sample.");
+    append("cputune_package_power_milliwatts %u\n", telemetry.getPackagePowerMilliwatts());
+    family("cputune_core_power_milliwatts", "gauge", "RAPL core power since the previous sample.");
+    append("cputune_core_power_milliwatts %u\n", telemetry.getCorePowerMilliwatts());
+    family("cputune_package_energy_microjoules", "counter", "RAPL package energy since start.");
+    append("cputune_package_energy_microjoules_total %llu\n", telemetry.getPackageEnergyMicrojoules());
+
+    if (telemetry.hasThrottleReasons()) {
+        const uint16_t reasons = telemetry.getThrottleReasons();
+        family("cputune_throttle_active", "gauge", "Reason currently limiting the core frequency.");
+        for (const auto &r : kThrottleReasons) {
+            append("cputune_throttle_active{reason=\"%s\"} %u\n", r.reason, (reasons >> r.bit) & 1U);
+        }
+    }
+
+    family("cputune_msr_writes", "counter", "MSR writes issued by CPUTune.");
+    append("cputune_msr_writes_total %llu\n", msrWrites);
+    family("cputune_ticks", "counter", "Timer ticks handled.");
+    append("cputune_ticks_total %llu\n", ticks);
+    family("cputune_telemetry_samples", "counter", "Telemetry samples taken.");
+    append("cputune_telemetry_samples_total %llu\n", telemetry.getSampleCount());
+    append("# EOF\n");
+
+    if (overflow) {
+        LOG("metrics do not fit into %lu bytes", capacity);
+        length = 0;
+    }
+    return length;
+}
+
+errno_t MetricsExporter::save(const char *path) const {
+    if (!path || length == 0) {
+        return EINVAL;
+    }
+    return writeBytesToFile(path, buffer, length, 0);
+}
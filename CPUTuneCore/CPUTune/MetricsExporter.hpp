@@ -0,0 +1,66 @@
+//
+//  MetricsExporter.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef MetricsExporter_hpp
+#define MetricsExporter_hpp
+
+#include "Telemetry.hpp"
+
+/**
+ *  Renders the telemetry as OpenMetrics text (the Prometheus exposition
+ *  format) into a buffer sized for the number of cpus once by init(), and
+ *  writes it to a file a textfile collector or a scraper can pick up.
+ *  Rendering never allocates.
+ */
+class MetricsExporter {
+public:
+    ~MetricsExporter();
+
+    /**
+     *  Preallocate the text buffer
+     *
+     *  @param cpus  number of cpus rendered
+     *
+     *  @return true on success
+     */
+    bool init(const uint32_t cpus);
+
+    void free(void);
+
+    /**
+     *  Render the current telemetry
+     *
+     *  @param telemetry  sampled telemetry
+     *  @param msrWrites  MSR writes issued so far
+     *  @param ticks      timer ticks so far
+     *
+     *  @return length of the text, 0 if it did not fit into the buffer
+     */
+    size_t render(const Telemetry &telemetry, const uint64_t msrWrites, const uint64_t ticks);
+
+    /**
+     *  Write the text of the last render() to path
+     *
+     *  @return 0 on success or errno on error
+     */
+    errno_t save(const char *path) const;
+
+private:
+    // families and fixed lines, plus room per cpu
+    static constexpr size_t kFixedBytes = 4096;
+    static constexpr size_t kBytesPerCPU = 256;
+
+    char *buffer = nullptr;
+    size_t capacity = 0;
+    size_t length = 0;
+    bool overflow = false;
+
+    void append(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void family(const char *name, const char *type, const char *help);
+};
+
+#endif /* MetricsExporter_hpp */
@@ -25,13 +25,15 @@ bool NVRAMUtils::clearKextPanicKey() const {
 }
 
 bool NVRAMUtils::isKextPanicLastBoot() const {
-    size_t len = 15;
-    char ver[len + 1];
+    char ver[16] {};
+    size_t len = sizeof(ver) - 1;
     // Get the entry
     if (0 == this->getProperty(kCPUTUNE_PANIC_KEY, ver, &len)) {
         return false;
     }
-    return strncmp(ver, osrelease, len);
+    // len is the stored length, which may exceed the buffer: only compare
+    // what was copied, ver stays null terminated
+    return strncmp(ver, osrelease, min(len, sizeof(ver) - 1));
 }
 
 IODTNVRAM *NVRAMUtils::getNVRAMEntry(void) const {
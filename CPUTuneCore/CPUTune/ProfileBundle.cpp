@@ -0,0 +1,139 @@
+//
+//  ProfileBundle.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "ProfileBundle.hpp"
+
+static const char *kOverridesKey = "Overrides";
+// keys of an override that select cpus rather than set knobs
+static const char *kConditionKeys[] {
+    "Model",
+    "MinCores",
+    "MaxCores",
+};
+
+static bool isReservedKey(const OSString *key) {
+    if (key->isEqualTo(kOverridesKey)) {
+        return true;
+    }
+    for (size_t i = 0; i < arrsize(kConditionKeys); i++) {
+        if (key->isEqualTo(kConditionKeys[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ProfileBundle::matches(OSDictionary *override, const CPUInfo &info) {
+    if (OSObject *model = override->getObject("Model")) {
+        bool found = false;
+        if (OSNumber *number = OSDynamicCast(OSNumber, model)) {
+            found = number->unsigned32BitValue() == info.model;
+        } else if (OSArray *models = OSDynamicCast(OSArray, model)) {
+            for (unsigned int i = 0; !found && i < models->getCount(); i++) {
+                OSNumber *number = OSDynamicCast(OSNumber, models->getObject(i));
+                found = number && number->unsigned32BitValue() == info.model;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    if (OSNumber *minCores = OSDynamicCast(OSNumber, override->getObject("MinCores"))) {
+        if (info.coreCount < minCores->unsigned32BitValue()) {
+            return false;
+        }
+    }
+    if (OSNumber *maxCores = OSDynamicCast(OSNumber, override->getObject("MaxCores"))) {
+        if (info.coreCount > maxCores->unsigned32BitValue()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ProfileBundle::merge(OSDictionary *knobs, const char *where, const Transaction &transaction) {
+    OSCollectionIterator *iterator = OSCollectionIterator::withCollection(knobs);
+    if (!iterator) {
+        return false;
+    }
+    bool ok = true;
+    while (OSString *key = OSDynamicCast(OSString, iterator->getNextObject())) {
+        if (isReservedKey(key)) {
+            continue;
+        }
+        Transaction::Operation op {};
+        if (!transaction.lookup(key->getCStringNoCopy(), key->getLength(), &op)) {
+            LOG("profile %s: unknown knob %s", where, key->getCStringNoCopy());
+            ok = false;
+            break;
+        }
+        OSObject *object = knobs->getObject(key->getCStringNoCopy());
+        ParseResult result {kParseOK, 0};
+        if (OSString *value = OSDynamicCast(OSString, object)) {
+            result = Transaction::parseValue(value->getCStringNoCopy(), value->getLength(), &op);
+        } else if (OSBoolean *value = OSDynamicCast(OSBoolean, object)) {
+            // switches only, a register value is never a boolean
+            result = Transaction::parseValue(value->isTrue() ? "1" : "0", 1, &op);
+            if (op.mask != 1) {
+                result.status = kParseInvalidDigit;
+            }
+        } else {
+            result.status = kParseEmpty;
+        }
+        if (result.status != kParseOK) {
+            LOG("profile %s: %s %s", where, key->getCStringNoCopy(), parseStatusToString(result.status));
+            ok = false;
+            break;
+        }
+
+        // a knob given again replaces the bits it names
+        size_t i = 0;
+        while (i < operationCount && (operations[i].knob != op.knob || operations[i].index != op.index)) {
+            i++;
+        }
+        if (i == operationCount) {
+            if (operationCount == Transaction::kMaxOperations) {
+                ok = false;
+                break;
+            }
+            operations[operationCount++] = op;
+            continue;
+        }
+        operations[i].value = (operations[i].value & ~op.mask) | op.value;
+        operations[i].mask |= op.mask;
+    }
+    iterator->release();
+    return ok;
+}
+
+bool ProfileBundle::resolve(OSDictionary *profiles, const char *name, const CPUInfo &info, const Transaction &transaction) {
+    operationCount = 0;
+    matchedOverrides = 0;
+    OSDictionary *profile = profiles && name ? OSDynamicCast(OSDictionary, profiles->getObject(name)) : nullptr;
+    if (!profile) {
+        LOG("profile %s does not exist", name ? name : "(none)");
+        return false;
+    }
+    if (!merge(profile, name, transaction)) {
+        return false;
+    }
+    if (OSArray *overrides = OSDynamicCast(OSArray, profile->getObject(kOverridesKey))) {
+        for (unsigned int i = 0; i < overrides->getCount(); i++) {
+            OSDictionary *override = OSDynamicCast(OSDictionary, overrides->getObject(i));
+            if (!override || !matches(override, info)) {
+                continue;
+            }
+            if (!merge(override, name, transaction)) {
+                return false;
+            }
+            matchedOverrides++;
+        }
+    }
+    LOG("profile %s: %lu knobs, %u of the overrides match cpu model 0x%x with %u cores", name, operationCount,
+        matchedOverrides, info.model, info.coreCount);
+    return operationCount > 0;
+}
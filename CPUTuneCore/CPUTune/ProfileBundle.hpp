@@ -0,0 +1,68 @@
+//
+//  ProfileBundle.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef ProfileBundle_hpp
+#define ProfileBundle_hpp
+
+#include "Transaction.hpp"
+#include "CPUInfo.hpp"
+
+/**
+ *  Named profiles for a fleet of different cpus in one Info.plist. "Profiles"
+ *  maps a profile name to its knobs, written as in a transaction, and an
+ *  optional list of overrides that apply to some cpus only (in OpenStep
+ *  notation, Model and MinCores are integers):
+ *
+ *      balanced = {
+ *          turbo = 1;
+ *          hwp = "min=8 max=36 epp=128";
+ *          Overrides = (
+ *              { Model = (158); MinCores = 8; hwp = "max=42"; trl = "1c=48 2c=47"; },
+ *              { Model = 126; hwp = "epp=160"; }
+ *          );
+ *      };
+ *
+ *  An override matches if every condition it has holds: Model (a number or
+ *  a list), MinCores and MaxCores. Matching overrides are applied in order on
+ *  top of the base knobs; register knobs are merged field by field, so the
+ *  override above only changes max= of the HWP request.
+ *  resolve() runs once at load and leaves the resolved batch, which is then
+ *  applied like a transaction.
+ */
+class ProfileBundle {
+public:
+    /**
+     *  Resolve a profile for this cpu
+     *
+     *  @param profiles     "Profiles" dictionary from Info.plist
+     *  @param name         profile to resolve
+     *  @param info         detected cpu information
+     *  @param transaction  knob names and value syntax
+     *
+     *  @return true if the profile exists and every knob of it and its matching overrides parsed
+     */
+    bool resolve(OSDictionary *profiles, const char *name, const CPUInfo &info, const Transaction &transaction);
+
+    size_t getOperationCount(void) const { return operationCount; }
+
+    const Transaction::Operation *getOperations(void) const { return operations; }
+
+    /**
+     *  @return number of overrides that matched this cpu
+     */
+    uint32_t getMatchedOverrides(void) const { return matchedOverrides; }
+
+private:
+    Transaction::Operation operations[Transaction::kMaxOperations] {};
+    size_t operationCount = 0;
+    uint32_t matchedOverrides = 0;
+
+    bool merge(OSDictionary *knobs, const char *where, const Transaction &transaction);
+    static bool matches(OSDictionary *override, const CPUInfo &info);
+};
+
+#endif /* ProfileBundle_hpp */
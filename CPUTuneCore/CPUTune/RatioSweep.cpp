@@ -0,0 +1,289 @@
+//
+//  RatioSweep.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "RatioSweep.hpp"
+#include "ConfigSource.hpp"
+#include <stdarg.h>
+
+// the result file is a transaction, it has to be read back in one piece
+static constexpr size_t kTextBytes = ConfigSource::kMaxLength + 1;
+// longest profile line, "# hwp max=100\n"
+static constexpr size_t kProfileLineBytes = 14;
+
+RatioSweep::~RatioSweep() {
+    free();
+}
+
+bool RatioSweep::init(MSRBackend *backend, const HWPCapabilities &caps, const uint32_t dwellTicks, const uint32_t cpus) {
+    if (!backend || dwellTicks == 0 || cpus == 0 || caps.lowest == 0 || caps.highest < caps.lowest) {
+        return false;
+    }
+    this->backend = backend;
+    this->dwellTicks = dwellTicks;
+    this->cpus = cpus < kMaxCPUs ? cpus : kMaxCPUs;
+    allCPUs = this->cpus == kMaxCPUs ? ~0ULL : (1ULL << this->cpus) - 1;
+    const uint32_t highest = min<uint32_t>(caps.highest, kMaxRatio);
+    if (highest < caps.lowest) {
+        return false;
+    }
+    const uint32_t range = highest - caps.lowest + 1;
+    const uint32_t step = (range + kMaxPoints - 1) / kMaxPoints;
+    pointCount = (range + step - 1) / step;
+
+    points = static_cast<Point *>(kern_os_malloc(sizeof(Point) * pointCount));
+    textCapacity = kTextBytes;
+    text = static_cast<char *>(kern_os_malloc(textCapacity));
+    dict = OSDictionary::withCapacity(6);
+    pointArray = OSArray::withCapacity(pointCount);
+    if (!points || !text || !dict || !pointArray) {
+        free();
+        return false;
+    }
+    memset(points, 0, sizeof(Point) * pointCount);
+
+    phaseNumber = addNumberToDictionary(dict, "Phase");
+    staticPowerNumber = addNumberToDictionary(dict, "StaticPowerMilliwatts");
+    staticPowerNegativeNumber = addNumberToDictionary(dict, "StaticPowerNegative");
+    dynamicPowerNumber = addNumberToDictionary(dict, "DynamicPowerMicrowattsPerRatioCubed");
+    dynamicPowerNegativeNumber = addNumberToDictionary(dict, "DynamicPowerNegative");
+    bool ok = phaseNumber && staticPowerNumber && staticPowerNegativeNumber && dynamicPowerNumber && dynamicPowerNegativeNumber &&
+              dict->setObject("Points", pointArray);
+    for (uint32_t i = 0; ok && i < pointCount; i++) {
+        Point &p = points[i];
+        p.ratio = static_cast<uint8_t>(caps.lowest + i * step);
+        OSDictionary *pointDict = OSDictionary::withCapacity(5);
+        if (!pointDict) {
+            ok = false;
+            break;
+        }
+        OSNumber *ratioNumber = addNumberToDictionary(pointDict, "Ratio");
+        p.powerNumber = addNumberToDictionary(pointDict, "PackagePowerMilliwatts");
+        p.mhzNumber = addNumberToDictionary(pointDict, "EffectiveFrequencyMHz");
+        p.busyNumber = addNumberToDictionary(pointDict, "BusyPercent");
+        p.paretoNumber = addNumberToDictionary(pointDict, "Pareto");
+        ok = ratioNumber && p.powerNumber && p.mhzNumber && p.busyNumber && p.paretoNumber &&
+             pointArray->setObject(pointDict);
+        if (ok) {
+            ratioNumber->setValue(p.ratio);
+        }
+        pointDict->release();
+    }
+    if (!ok) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+void RatioSweep::free() {
+    // the OSNumber objects are owned by the dictionaries
+    OSSafeReleaseNULL(pointArray);
+    OSSafeReleaseNULL(dict);
+    if (points) {
+        kern_os_free(points);
+        points = nullptr;
+    }
+    if (text) {
+        kern_os_free(text);
+        text = nullptr;
+    }
+    pointCount = 0;
+    textCapacity = 0;
+    textLength = 0;
+}
+
+void RatioSweep::pin(const uint8_t ratio) {
+    // IA32_HWP_REQUEST[7:0] minimum and [15:8] maximum performance, desired left autonomous;
+    // every cpu, the averages cover all of them and the timer does not stay on one
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        requests[cpu] = (static_cast<uint64_t>(ratio) << 8) | ratio;
+    }
+    backend->updateCPUs(MSR_IA32_HWP_REQUEST, 0xFFFFFFULL, requests, allCPUs);
+    settleTicks = 1;
+}
+
+void RatioSweep::restore(const uint64_t cpuMask) {
+    backend->updateCPUs(MSR_IA32_HWP_REQUEST, ~0ULL, originalRequests, cpuMask);
+}
+
+void RatioSweep::stop() {
+    if (phase == kRunning) {
+        restore(allCPUs);
+        phase = kStopped;
+        phaseNumber->setValue(phase);
+        LOG("sweep stopped at ratio %u", points[current].ratio);
+    }
+}
+
+void RatioSweep::tick(const Telemetry &telemetry, const uint64_t reserved) {
+    if (!dict || phase == kDone || phase == kRefused || phase == kStopped) {
+        return;
+    }
+    if (reserved) {
+        // the sets keep their own requests, a sweep would measure and overwrite them
+        if (phase == kRunning) {
+            restore(allCPUs & ~reserved);
+        }
+        LOG("sweep refused: core sets manage IA32_HWP_REQUEST of cpus 0x%llx", reserved);
+        phase = kRefused;
+        phaseNumber->setValue(phase);
+        return;
+    }
+    if (phase == kIdle) {
+        // HWP requests are ignored until HWP is enabled
+        if (!(backend->read(MSR_IA32_PM_ENABLE) & 1)) {
+            return;
+        }
+        const uint32_t msr = MSR_IA32_HWP_REQUEST;
+        backend->readAllCPUs(&msr, 1, originalRequests, cpus);
+        current = 0;
+        phase = kRunning;
+        phaseNumber->setValue(phase);
+        LOG("sweep ratio %u to %u, %u ticks each", points[0].ratio, points[pointCount - 1].ratio, dwellTicks);
+        pin(points[current].ratio);
+        return;
+    }
+    if (settleTicks > 0) {
+        settleTicks--;
+        return;
+    }
+
+    // frequency weighted by busy time, idle cpus do not run at the pinned ratio
+    uint64_t weightedMHz = 0;
+    uint64_t busy = 0;
+    const uint32_t cpus = telemetry.getCPUCount();
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        weightedMHz += static_cast<uint64_t>(telemetry.getEffectiveFrequencyMHz(cpu)) * telemetry.getBusyPercent(cpu);
+        busy += telemetry.getBusyPercent(cpu);
+    }
+    Point &p = points[current];
+    p.powerSum += telemetry.getPackagePowerMilliwatts();
+    p.mhzSum += busy ? weightedMHz / busy : 0;
+    p.busySum += cpus ? busy / cpus : 0;
+    p.samples++;
+
+    if (p.samples < dwellTicks) {
+        return;
+    }
+    p.powerNumber->setValue(p.powerMW());
+    p.mhzNumber->setValue(p.mhz());
+    p.busyNumber->setValue(p.busyPercent());
+    if (++current < pointCount) {
+        pin(points[current].ratio);
+    } else {
+        finish();
+    }
+}
+
+void RatioSweep::finish() {
+    restore(allCPUs);
+    fitPowerModel();
+    markPareto();
+    render();
+    phase = kDone;
+    phaseNumber->setValue(phase);
+    LOG("sweep done, P(ratio) = %lld mW + %lld uW * ratio^3", staticPowerMW, dynamicPowerUW);
+}
+
+void RatioSweep::fitPowerModel() {
+    // least squares of power against x = ratio^3, in integers: x <= kMaxRatio^3
+    // and power below 1 kW keep n * sxy * 1000 below 2^63 for kMaxPoints points
+    int64_t n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (uint32_t i = 0; i < pointCount; i++) {
+        const int64_t x = static_cast<int64_t>(points[i].ratio) * points[i].ratio * points[i].ratio;
+        const int64_t y = points[i].powerMW();
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    const int64_t den = n * sxx - sx * sx;
+    if (den == 0) {
+        return;
+    }
+    dynamicPowerUW = (n * sxy - sx * sy) * 1000 / den;
+    staticPowerMW = (sy * 1000 - dynamicPowerUW * sx) / (n * 1000);
+    // OSNumber has no sign, a fit below 0 (e.g. from noisy points) would read as close to 2^64
+    staticPowerNumber->setValue(static_cast<uint64_t>(staticPowerMW < 0 ? -staticPowerMW : staticPowerMW));
+    staticPowerNegativeNumber->setValue(staticPowerMW < 0);
+    dynamicPowerNumber->setValue(static_cast<uint64_t>(dynamicPowerUW < 0 ? -dynamicPowerUW : dynamicPowerUW));
+    dynamicPowerNegativeNumber->setValue(dynamicPowerUW < 0);
+}
+
+void RatioSweep::markPareto() {
+    for (uint32_t i = 0; i < pointCount; i++) {
+        Point &p = points[i];
+        p.pareto = true;
+        for (uint32_t j = 0; p.pareto && j < pointCount; j++) {
+            const Point &q = points[j];
+            // q dominates p if it is at least as good in both and better in one
+            if (q.powerMW() <= p.powerMW() && q.mhz() >= p.mhz() &&
+                (q.powerMW() < p.powerMW() || q.mhz() > p.mhz())) {
+                p.pareto = false;
+            }
+        }
+        p.paretoNumber->setValue(p.pareto);
+    }
+}
+
+void RatioSweep::append(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(text + textLength, textCapacity - textLength, format, args);
+    va_end(args);
+    if (written > 0) {
+        // a cut off line is still terminated
+        textLength = min(textLength + static_cast<size_t>(written), textCapacity - 1);
+    }
+}
+
+void RatioSweep::render() {
+    textLength = 0;
+
+    // the most frequency per watt among the Pareto points becomes the active line
+    uint32_t best = pointCount;
+    for (uint32_t i = 0; i < pointCount; i++) {
+        const Point &p = points[i];
+        if (p.pareto && p.powerMW() > 0 &&
+            (best == pointCount ||
+             static_cast<uint64_t>(p.mhz()) * points[best].powerMW() > static_cast<uint64_t>(points[best].mhz()) * p.powerMW())) {
+            best = i;
+        }
+    }
+
+    // the measured points are in the Points of the dictionary, the file only has the profiles
+    append("# CPUTune ratio sweep, P(ratio) = %lld mW + %lld uW * ratio^3\n", staticPowerMW, dynamicPowerUW);
+    append("# Pareto optimal profiles, keep one hwp line for the TransactionConfigPath\n");
+    // the best line always fits, the other Pareto points as long as there is room
+    size_t room = (textCapacity - 1 - textLength) / kProfileLineBytes - (best < pointCount ? 1 : 0);
+    uint32_t omitted = 0;
+    for (uint32_t i = 0; i < pointCount; i++) {
+        const Point &p = points[i];
+        if (!p.pareto) {
+            continue;
+        }
+        if (i == best) {
+            append("hwp max=%u\n", p.ratio);
+        } else if (room > 0) {
+            append("# hwp max=%u\n", p.ratio);
+            room--;
+        } else {
+            omitted++;
+        }
+    }
+    if (omitted) {
+        LOG("sweep result leaves out %u Pareto optimal ratios, see the Points of the Sweep dictionary", omitted);
+    }
+}
+
+errno_t RatioSweep::save(const char *path) const {
+    if (!path || phase != kDone || textLength == 0) {
+        return EINVAL;
+    }
+    return writeBytesToFile(path, text, textLength, 0);
+}
@@ -0,0 +1,149 @@
+//
+//  RatioSweep.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef RatioSweep_hpp
+#define RatioSweep_hpp
+
+#include "Telemetry.hpp"
+#include "ConfigValidator.hpp"
+
+/**
+ *  Controlled sweep over the HWP ratio range. Every ratio from the lowest to
+ *  the highest HWP performance level (in larger steps on wide ranges) is pinned (HWP min = max = ratio) on
+ *  every cpu for a number of ticks while package power, effective frequency and busy time are
+ *  averaged. Afterwards the power model
+ *
+ *      P(ratio) = static + dynamic * ratio^3
+ *
+ *  is fitted by least squares (dynamic power follows f * V^2 and the voltage
+ *  rises about linearly with the ratio), the points no other ratio beats in
+ *  both power and frequency are marked Pareto optimal, and the original
+ *  request is restored. The outcome is published as the "Sweep" dictionary,
+ *  the fitted terms as their magnitude with a Negative key set to 1 below 0,
+ *  and can be written as a transaction file (see TransactionConfigPath) with
+ *  one ready to use "hwp max=<ratio>" line per Pareto optimal ratio, as many
+ *  as fit ConfigSource::kMaxLength (the points themselves are only in the
+ *  dictionary). The sweep is refused, or stopped with the original requests
+ *  restored, while core sets manage the HWP request of any cpu.
+ *
+ *  Run the same steady workload for the whole sweep, the effective frequency
+ *  stands in for its performance.
+ */
+class RatioSweep {
+public:
+    ~RatioSweep();
+
+    // wider ratio ranges are swept in larger steps
+    static constexpr uint32_t kMaxPoints = 64;
+    // highest ratio swept, keeps the integer fit from overflowing
+    static constexpr uint8_t kMaxRatio = 100;
+    static constexpr uint32_t kMaxCPUs = 64;
+
+    /**
+     *  Allocate the published dictionary and the result buffer
+     *
+     *  @param backend     MSR backend to write IA32_HWP_REQUEST through
+     *  @param caps        HWP ratio range of the cpu
+     *  @param dwellTicks  ticks averaged per ratio
+     *  @param cpus        number of logical cpus to pin
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *backend, const HWPCapabilities &caps, const uint32_t dwellTicks, const uint32_t cpus);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    bool isRunning(void) const { return phase == kRunning; }
+
+    /**
+     *  Account the current telemetry sample and move to the next ratio when
+     *  the current one has been sampled long enough. Must be called once per
+     *  tick after Telemetry::sample(); starts the sweep on the first call.
+     *
+     *  @param telemetry  last sample
+     *  @param reserved   cpus whose HWP request belongs to a core set, any refuses the sweep
+     */
+    void tick(const Telemetry &telemetry, const uint64_t reserved);
+
+    /**
+     *  End a running sweep early and restore the original requests of every cpu
+     */
+    void stop(void);
+
+    /**
+     *  Write the result as a transaction file
+     *
+     *  @return 0 on success or errno on error
+     */
+    errno_t save(const char *path) const;
+
+private:
+    enum Phase : uint8_t {
+        kIdle,
+        kRunning,
+        kDone,
+        kRefused,
+        kStopped,       // CPUTune stopped while running
+    };
+
+    struct Point {
+        uint8_t ratio;
+        bool pareto;
+        uint32_t samples;
+        uint64_t powerSum;
+        uint64_t mhzSum;
+        uint64_t busySum;
+        OSNumber *powerNumber;
+        OSNumber *mhzNumber;
+        OSNumber *busyNumber;
+        OSNumber *paretoNumber;
+
+        uint32_t powerMW(void) const { return samples ? static_cast<uint32_t>(powerSum / samples) : 0; }
+        uint32_t mhz(void) const { return samples ? static_cast<uint32_t>(mhzSum / samples) : 0; }
+        uint32_t busyPercent(void) const { return samples ? static_cast<uint32_t>(busySum / samples) : 0; }
+    };
+
+    MSRBackend *backend = nullptr;
+    Point *points = nullptr;
+    uint32_t pointCount = 0;
+    uint32_t current = 0;
+    uint32_t dwellTicks = 0;
+    // ticks left to skip at the current ratio, the first sample spans the change
+    uint32_t settleTicks = 0;
+    uint32_t cpus = 0;
+    uint64_t allCPUs = 0;
+    // IA32_HWP_REQUEST of every cpu before the sweep
+    uint64_t originalRequests[kMaxCPUs] {};
+    uint64_t requests[kMaxCPUs] {};
+    Phase phase = kIdle;
+    int64_t staticPowerMW = 0;
+    int64_t dynamicPowerUW = 0;
+
+    OSDictionary *dict = nullptr;
+    OSArray *pointArray = nullptr;
+    OSNumber *phaseNumber = nullptr;
+    OSNumber *staticPowerNumber = nullptr;
+    OSNumber *staticPowerNegativeNumber = nullptr;
+    OSNumber *dynamicPowerNumber = nullptr;
+    OSNumber *dynamicPowerNegativeNumber = nullptr;
+
+    char *text = nullptr;
+    size_t textCapacity = 0;
+    size_t textLength = 0;
+
+    void pin(const uint8_t ratio);
+    void finish(void);
+    void restore(const uint64_t cpuMask);
+    void fitPowerModel(void);
+    void markPareto(void);
+    void render(void);
+    void append(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif /* RatioSweep_hpp */
@@ -0,0 +1,143 @@
+//
+//  RegisterDump.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "RegisterDump.hpp"
+#include <stdarg.h>
+
+RegisterDump::~RegisterDump() {
+    free();
+}
+
+bool RegisterDump::init(MSRBackend *backend, const CPUInfo &info, const MSRProbe &probe) {
+    this->backend = backend;
+    model = info.model;
+    cpus = info.threadCount;
+    if (!backend || cpus == 0) {
+        return false;
+    }
+
+    threadRegisters = static_cast<uint8_t *>(kern_os_malloc(kRegisterTableSize));
+    packageRegisters = static_cast<uint8_t *>(kern_os_malloc(kRegisterTableSize));
+    threadMSRs = static_cast<uint32_t *>(kern_os_malloc(sizeof(uint32_t) * kRegisterTableSize));
+    if (!threadRegisters || !packageRegisters || !threadMSRs) {
+        free();
+        return false;
+    }
+    threadCount = 0;
+    packageCount = 0;
+    for (size_t i = 0; i < kRegisterTableSize; i++) {
+        const RegisterDescriptor &reg = kRegisterTable[i];
+        if (!isRegisterAvailable(reg, info) || (probe.isProbed(reg.msr) && !probe.isReadable(reg.msr))) {
+            continue;
+        }
+        if (reg.scope == kScopeThread) {
+            threadMSRs[threadCount] = reg.msr;
+            threadRegisters[threadCount++] = static_cast<uint8_t>(i);
+        } else {
+            packageRegisters[packageCount++] = static_cast<uint8_t>(i);
+        }
+    }
+
+    values = static_cast<uint64_t *>(kern_os_malloc(sizeof(uint64_t) * cpus * max<size_t>(threadCount, 1)));
+    capacity = kHeaderBytes + kBytesPerLine * (packageCount + threadCount * cpus);
+    buffer = static_cast<char *>(kern_os_malloc(capacity));
+    if (!values || !buffer) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+void RegisterDump::free() {
+    if (threadRegisters) {
+        kern_os_free(threadRegisters);
+        threadRegisters = nullptr;
+    }
+    if (packageRegisters) {
+        kern_os_free(packageRegisters);
+        packageRegisters = nullptr;
+    }
+    if (threadMSRs) {
+        kern_os_free(threadMSRs);
+        threadMSRs = nullptr;
+    }
+    if (values) {
+        kern_os_free(values);
+        values = nullptr;
+    }
+    if (buffer) {
+        kern_os_free(buffer);
+        buffer = nullptr;
+    }
+    capacity = 0;
+    length = 0;
+}
+
+void RegisterDump::append(const char *format, ...) {
+    if (overflow) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(buffer + length, capacity - length, format, args);
+    va_end(args);
+    if (written < 0 || static_cast<size_t>(written) >= capacity - length) {
+        overflow = true;
+        return;
+    }
+    length += static_cast<size_t>(written);
+}
+
+void RegisterDump::line(const char *prefix, const uint32_t cpu, const RegisterDescriptor &reg, const uint64_t value) {
+    if (reg.scope == kScopeThread) {
+        append("%s%u %s 0x%llx", prefix, cpu, reg.name, value);
+    } else {
+        append("%s %s 0x%llx", prefix, reg.name, value);
+    }
+    for (size_t i = 0; i < reg.fieldCount; i++) {
+        const ConfigField &field = reg.fields[i];
+        append(" %s=%llu", field.key, static_cast<uint64_t>(bitfield32(value, field.hi, field.lo)));
+    }
+    append("\n");
+}
+
+size_t RegisterDump::capture() {
+    if (!buffer) {
+        return 0;
+    }
+    length = 0;
+    overflow = false;
+
+    // per thread registers are read on every cpu in one rendezvous
+    if (threadCount > 0) {
+        backend->readAllCPUs(threadMSRs, threadCount, values, cpus);
+    }
+
+    append("# CPUTune register dump, cpu model 0x%x, %u cpus\n", model, cpus);
+    for (size_t i = 0; i < packageCount; i++) {
+        const RegisterDescriptor &reg = kRegisterTable[packageRegisters[i]];
+        line("pkg", 0, reg, backend->read(reg.msr));
+    }
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        for (size_t i = 0; i < threadCount; i++) {
+            line("cpu", cpu, kRegisterTable[threadRegisters[i]], values[cpu * threadCount + i]);
+        }
+    }
+
+    if (overflow) {
+        LOG("register dump does not fit into %lu bytes", capacity);
+        length = 0;
+    }
+    return length;
+}
+
+errno_t RegisterDump::save(const char *path) const {
+    if (!path || length == 0) {
+        return EINVAL;
+    }
+    return writeBytesToFile(path, buffer, length, 0);
+}
@@ -0,0 +1,84 @@
+//
+//  RegisterDump.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef RegisterDump_hpp
+#define RegisterDump_hpp
+
+#include "RegisterTable.hpp"
+#include "MSRProbe.hpp"
+
+/**
+ *  Reads every available register of the register table, the per thread ones
+ *  on all cpus at once, and writes them as text with their fields decoded:
+ *
+ *      # CPUTune register dump, cpu model 0x9e, 8 cpus
+ *      pkg  MSR_TURBO_RATIO_LIMIT 0x2b2c2d2f 1c=47 2c=45 3c=44 4c=43 ...
+ *      cpu0 IA32_HWP_REQUEST 0x80002a08 min=8 max=42 desired=0 epp=128 ...
+ *
+ *  One register per line in table order, so dumps of two machines or of the
+ *  same machine at two points in time compare with diff(1), and the fields of
+ *  the registers CPUTune writes read like their config files.
+ *  Buffers are allocated once by init(), capture() never allocates.
+ */
+class RegisterDump {
+public:
+    ~RegisterDump();
+
+    /**
+     *  Select the registers available on this cpu and allocate the buffers
+     *
+     *  @param backend  MSR backend to read through
+     *  @param info     detected cpu information
+     *  @param probe    probe of the registers this machine has
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *backend, const CPUInfo &info, const MSRProbe &probe);
+
+    void free(void);
+
+    /**
+     *  Read all registers and render the dump
+     *
+     *  @return length of the text, 0 if it did not fit into the buffer
+     */
+    size_t capture(void);
+
+    /**
+     *  Write the text of the last capture() to path
+     *
+     *  @return 0 on success or errno on error
+     */
+    errno_t save(const char *path) const;
+
+private:
+    // longest line: name, value and up to 8 fields
+    static constexpr size_t kBytesPerLine = 160;
+    static constexpr size_t kHeaderBytes = 128;
+
+    MSRBackend *backend = nullptr;
+    uint8_t model = 0;
+    uint32_t cpus = 0;
+
+    // indices into kRegisterTable
+    uint8_t *threadRegisters = nullptr;
+    uint8_t *packageRegisters = nullptr;
+    size_t threadCount = 0;
+    size_t packageCount = 0;
+    uint32_t *threadMSRs = nullptr;
+    uint64_t *values = nullptr;
+
+    char *buffer = nullptr;
+    size_t capacity = 0;
+    size_t length = 0;
+    bool overflow = false;
+
+    void line(const char *prefix, const uint32_t cpu, const RegisterDescriptor &reg, const uint64_t value);
+    void append(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+#endif /* RegisterDump_hpp */
@@ -0,0 +1,111 @@
+//
+//  RegisterTable.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "RegisterTable.hpp"
+#include <i386/proc_reg.h>
+
+static constexpr ConfigField kMiscEnableFields[] {
+    { "eist",          16, 16 },
+    { "turbo_disable", 38, 38 },
+};
+
+static constexpr ConfigField kPerfStatusFields[] {
+    { "ratio", 15, 8 },
+};
+
+static constexpr ConfigField kPerfCtlFields[] {
+    { "ratio",           15, 8 },
+    { "turbo_disengage", 32, 32 },
+};
+
+static constexpr ConfigField kPlatformInfoFields[] {
+    { "base",   15, 8 },
+    { "trl_rw", 28, 28 },
+    { "min",    47, 40 },
+};
+
+static constexpr ConfigField kPowerCtlFields[] {
+    { "bd_prochot", 0, 0 },
+    { "c1e",        1, 1 },
+};
+
+static constexpr ConfigField kPMEnableFields[] {
+    { "hwp", 0, 0 },
+};
+
+static constexpr ConfigField kHWPCapabilitiesFields[] {
+    { "highest",    7,  0 },
+    { "guaranteed", 15, 8 },
+    { "efficient",  23, 16 },
+    { "lowest",     31, 24 },
+};
+
+static constexpr ConfigField kThermStatusFields[] {
+    { "readout", 22, 16 },
+    { "valid",   31, 31 },
+};
+
+static constexpr ConfigField kTemperatureTargetFields[] {
+    { "tjmax", 23, 16 },
+};
+
+static constexpr ConfigField kUncoreRatioLimitFields[] {
+    { "max", 6,  0 },
+    { "min", 14, 8 },
+};
+
+static constexpr ConfigField kRAPLPowerUnitFields[] {
+    { "power",  3,  0 },
+    { "energy", 12, 8 },
+    { "time",   19, 16 },
+};
+
+#define REGISTER(msr, name, scope, feature, fields) \
+    { msr, name, scope, feature, fields, static_cast<uint8_t>(arrsize(fields)) }
+
+const RegisterDescriptor kRegisterTable[] {
+    REGISTER(MSR_PLATFORM_INFO,             "MSR_PLATFORM_INFO",            kScopePackage, kFeatureNone,           kPlatformInfoFields),
+    REGISTER(MSR_IA32_MISC_ENABLE,          "IA32_MISC_ENABLE",             kScopeThread,  kFeatureNone,           kMiscEnableFields),
+    REGISTER(MSR_IA32_PERF_STS,             "IA32_PERF_STATUS",             kScopeThread,  kFeatureNone,           kPerfStatusFields),
+    REGISTER(MSR_IA32_PERF_CTL,             "IA32_PERF_CTL",                kScopeThread,  kFeatureNone,           kPerfCtlFields),
+    REGISTER(MSR_IA32_POWER_CTL,            "MSR_POWER_CTL",                kScopePackage, kFeaturePowerCtl,       kPowerCtlFields),
+    REGISTER(MSR_TURBO_RATIO_LIMIT,         "MSR_TURBO_RATIO_LIMIT",        kScopePackage, kFeatureTurboRatio,     kTurboRatioLimitFields),
+    REGISTER(MSR_IA32_PM_ENABLE,            "IA32_PM_ENABLE",               kScopePackage, kFeatureHWP,            kPMEnableFields),
+    REGISTER(MSR_IA32_HWP_CAPABILITIES,     "IA32_HWP_CAPABILITIES",        kScopeThread,  kFeatureHWP,            kHWPCapabilitiesFields),
+    REGISTER(MSR_IA32_HWP_REQUEST,          "IA32_HWP_REQUEST",             kScopeThread,  kFeatureHWP,            kHWPRequestFields),
+    REGISTER(MSR_IA32_THERM_STATUS,         "IA32_THERM_STATUS",            kScopeThread,  kFeatureThermalSensor,  kThermStatusFields),
+    REGISTER(MSR_TEMPERATURE_TARGET,        "MSR_TEMPERATURE_TARGET",       kScopePackage, kFeatureThermalSensor,  kTemperatureTargetFields),
+    REGISTER(MSR_IA32_PACKAGE_THERM_STATUS, "IA32_PACKAGE_THERM_STATUS",    kScopePackage, kFeaturePackageThermal, kThermStatusFields),
+    REGISTER(MSR_RAPL_POWER_UNIT,           "MSR_RAPL_POWER_UNIT",          kScopePackage, kFeatureRAPL,           kRAPLPowerUnitFields),
+    REGISTER(MSR_UNCORE_RATIO_LIMIT,        "MSR_UNCORE_RATIO_LIMIT",       kScopePackage, kFeatureUncoreRatio,    kUncoreRatioLimitFields),
+};
+
+#undef REGISTER
+
+const size_t kRegisterTableSize = arrsize(kRegisterTable);
+
+bool isRegisterAvailable(const RegisterDescriptor &reg, const CPUInfo &info) {
+    switch (reg.feature) {
+        case kFeatureNone:
+            return true;
+        case kFeatureHWP:
+            return info.supportedHWP;
+        case kFeatureRAPL:
+            return info.supportedRAPL;
+        case kFeatureThermalSensor:
+            return info.powerManagementFeatures & CPUID_PM_DIGITAL_THERMAL_SENSOR;
+        case kFeaturePackageThermal:
+            return info.powerManagementFeatures & CPUID_PM_PACKAGE_THERMAL;
+        case kFeatureTurboRatio:
+            return info.hasModelRegister(kModelRegTurboRatio);
+        case kFeaturePowerCtl:
+            return info.hasModelRegister(kModelRegPowerCtl);
+        case kFeatureUncoreRatio:
+            return info.hasUncoreRatioLimit();
+    }
+    return false;
+}
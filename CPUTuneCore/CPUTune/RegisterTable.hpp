@@ -0,0 +1,54 @@
+//
+//  RegisterTable.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef RegisterTable_hpp
+#define RegisterTable_hpp
+
+#include "CPUInfo.hpp"
+#include "ConfigParser.hpp"
+
+/**
+ *  Feature a register depends on, reading it without the feature raises #GP
+ */
+enum RegisterFeature : uint8_t {
+    kFeatureNone,
+    kFeatureHWP,
+    kFeatureRAPL,
+    kFeatureThermalSensor,
+    kFeaturePackageThermal,
+    kFeatureTurboRatio,     // listed for the model in CPUModels.def
+    kFeaturePowerCtl,
+    kFeatureUncoreRatio,
+};
+
+/**
+ *  A register CPUTune knows about and the fields it decodes. Fields of the
+ *  registers CPUTune writes carry the names used by their config files.
+ */
+struct RegisterDescriptor {
+    uint32_t msr;
+    const char *name;
+    RegisterScope scope;
+    RegisterFeature feature;
+    const ConfigField *fields;
+    uint8_t fieldCount;
+};
+
+extern const RegisterDescriptor kRegisterTable[];
+extern const size_t kRegisterTableSize;
+
+/**
+ *  Check if a register can be read on this cpu
+ *
+ *  @param reg   register descriptor
+ *  @param info  detected cpu information
+ *
+ *  @return true if the feature the register depends on is present
+ */
+bool isRegisterAvailable(const RegisterDescriptor &reg, const CPUInfo &info);
+
+#endif /* RegisterTable_hpp */
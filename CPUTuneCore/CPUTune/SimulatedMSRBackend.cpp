@@ -0,0 +1,504 @@
+//
+//  SimulatedMSRBackend.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "SimulatedMSRBackend.hpp"
+#include "ConfigParser.hpp"
+#include <kern/cpu_number.h>
+
+// ratios of the simulated processor around the base ratio of the host
+static constexpr uint8_t kLowestRatio = 8;
+static constexpr uint8_t kDefaultBaseRatio = 20;
+static constexpr uint8_t kTurboRatios = 12;
+// 1/2^14 J per energy status unit, 1/8 W and 1/1024 s as on client parts
+static constexpr uint64_t kRAPLPowerUnit = 0xA0E03;
+static constexpr uint8_t kTjMax = 100;
+static constexpr int64_t kLeakageReferenceMicroC = 50000000;
+
+bool SimulatedMSRBackend::init(const CPUInfo &info, const uint32_t timeScale) {
+    cpus = min<uint32_t>(info.threadCount, kMaxCPUs);
+    if (cpus == 0) {
+        LOG("simulator: no logical processor reported");
+        return false;
+    }
+    cores = info.coreCount ? min<uint32_t>(info.coreCount, cpus) : cpus;
+    threadsPerCore = cpus / cores;
+    cores = cpus / threadsPerCore;
+    this->timeScale = timeScale ? min(timeScale, kMaxTimeScale) : 1;
+
+    dict = OSDictionary::withCapacity(5);
+    if (!dict) {
+        return false;
+    }
+    simulatedMsNumber = addNumberToDictionary(dict, "SimulatedMilliseconds");
+    timeScaleNumber = addNumberToDictionary(dict, "TimeScale");
+    segmentNumber = addNumberToDictionary(dict, "LoadSegment");
+    thermalCapNumber = addNumberToDictionary(dict, "ThermalCapRatio");
+    throttledMsNumber = addNumberToDictionary(dict, "ThrottledMilliseconds");
+    if (!simulatedMsNumber || !timeScaleNumber || !segmentNumber || !thermalCapNumber || !throttledMsNumber) {
+        free();
+        return false;
+    }
+    timeScaleNumber->setValue(this->timeScale);
+
+    // a deterministic processor: only the topology and base ratio come from the host
+    const uint8_t base = info.baseRatio > kLowestRatio ? static_cast<uint8_t>(info.baseRatio) : kDefaultBaseRatio;
+    const uint8_t highest = base + kTurboRatios;
+    platformInfo = msr::MaxNonTurboRatio::insert(0, base);
+    platformInfo = msr::TurboRatioLimitWritable::insert(platformInfo, 1);
+    platformInfo = msr::MaxEfficiencyRatio::insert(platformInfo, kLowestRatio);
+    // one ratio less for every two more active cores
+    turboRatioLimit = 0;
+    for (uint8_t n = 0; n < 8; n++) {
+        turboRatioLimit |= static_cast<uint64_t>(highest - n / 2) << (n * 8);
+    }
+    miscEnable = 0;
+    powerCtl = msr::BiDirectionalProcHot::insert(0, 1);
+    pmEnable = msr::HWPEnable::insert(0, info.supportedHWP);
+    hwpCapabilities = msr::HighestPerformance::insert(0, highest);
+    hwpCapabilities = msr::GuaranteedPerformance::insert(hwpCapabilities, base);
+    hwpCapabilities = msr::EfficientPerformance::insert(hwpCapabilities, kLowestRatio + (base - kLowestRatio) / 2);
+    hwpCapabilities = msr::LowestPerformance::insert(hwpCapabilities, kLowestRatio);
+    raplPowerUnit = kRAPLPowerUnit;
+    temperatureTarget = msr::TjMax::insert(0, kTjMax);
+    coreThreadCount = msr::CoreCount::insert(msr::ThreadCount::insert(0, cpus), cores);
+    perfLimitReasons = 0;
+    thermalLog = false;
+    tsc = 0;
+    packageNanojoules = 0;
+    coreNanojoules = 0;
+
+    uint64_t request = msr::HWPMinimum::insert(0, kLowestRatio);
+    request = msr::HWPMaximum::insert(request, highest);
+    request = msr::HWPEnergyPerfPreference::insert(request, 128);
+    for (uint32_t i = 0; i < cpus; i++) {
+        cpu[i] = {};
+        cpu[i].hwpRequest = request;
+        cpu[i].perfCtl = msr::TargetRatio::insert(0, base);
+        cpu[i].ratio = kLowestRatio;
+    }
+    for (uint32_t core = 0; core < cores; core++) {
+        coreTemperature[core] = kAmbientMicroC;
+    }
+    heatsinkTemperature = kAmbientMicroC;
+    thermalCap = 0xFF;
+    simulatedMs = 0;
+    throttledMs = 0;
+    shadowCount = 0;
+    resetLoadTrace();
+
+    LOG("simulator: %u cpus on %u cores, ratios %u/%u/%u, time scale %u", cpus, cores, kLowestRatio, base, highest,
+        this->timeScale);
+    return true;
+}
+
+void SimulatedMSRBackend::free() {
+    // the OSNumber objects are owned by the dictionary
+    OSSafeReleaseNULL(dict);
+    simulatedMsNumber = nullptr;
+    timeScaleNumber = nullptr;
+    segmentNumber = nullptr;
+    thermalCapNumber = nullptr;
+    throttledMsNumber = nullptr;
+}
+
+void SimulatedMSRBackend::resetLoadTrace() {
+    segmentCount = 3;
+    for (uint32_t i = 0; i < kMaxCPUs; i++) {
+        segments[0].busy[i] = 100;
+        segments[1].busy[i] = 5;
+        segments[2].busy[i] = i < cpus / 2 ? 100 : 0;
+    }
+    for (size_t i = 0; i < segmentCount; i++) {
+        segments[i].ticks = 30;
+    }
+    segment = 0;
+    segmentTick = 0;
+}
+
+bool SimulatedMSRBackend::setLoadTrace(const char *content, const size_t length) {
+    // parsed into loaded first, the trace in use is kept on failure
+    Segment parsed {};
+    size_t count = 0;
+
+    uint16_t line = 0;
+    size_t i = 0;
+    while (i < length) {
+        line++;
+        size_t end = i;
+        while (end < length && content[end] != '\n') {
+            end++;
+        }
+        const size_t next = end + 1;
+        parsed = {};
+        uint32_t values = 0;
+        uint8_t last = 0;
+        while (i < end) {
+            while (i < end && (content[i] == ' ' || content[i] == '\t' || content[i] == '\r')) {
+                i++;
+            }
+            if (i == end || content[i] == '#') {
+                break;
+            }
+            const size_t begin = i;
+            while (i < end && content[i] != ' ' && content[i] != '\t' && content[i] != '\r') {
+                i++;
+            }
+            uint64_t value = 0;
+            const ParseResult status = parseUInt64(content + begin, i - begin, 10, &value);
+            if (status.status != kParseOK) {
+                LOG("simulator load line %u: %s", line, parseStatusToString(status.status));
+                return false;
+            }
+            if (values == 0) {
+                parsed.ticks = static_cast<uint32_t>(min<uint64_t>(value, UINT32_MAX));
+            } else if (value > 100) {
+                LOG("simulator load line %u: busy percent %llu above 100", line, value);
+                return false;
+            } else if (values <= kMaxCPUs) {
+                last = static_cast<uint8_t>(value);
+                parsed.busy[values - 1] = last;
+            }
+            values++;
+        }
+        i = next;
+        if (values == 0) {
+            continue;
+        }
+        if (values == 1 || parsed.ticks == 0) {
+            LOG("simulator load line %u: needs ticks above 0 and a busy percent", line);
+            return false;
+        }
+        if (count == kMaxSegments) {
+            LOG("simulator load: more than %u segments", static_cast<uint32_t>(kMaxSegments));
+            return false;
+        }
+        for (uint32_t index = values - 1; index < kMaxCPUs; index++) {
+            parsed.busy[index] = last;
+        }
+        loaded[count++] = parsed;
+    }
+    if (count == 0) {
+        LOG("simulator load: no segment given");
+        return false;
+    }
+
+    for (size_t n = 0; n < count; n++) {
+        segments[n] = loaded[n];
+    }
+    segmentCount = count;
+    segment = 0;
+    segmentTick = 0;
+    return true;
+}
+
+void SimulatedMSRBackend::advance(const uint32_t ms) {
+    if (!dict) {
+        return;
+    }
+    const Segment &current = segments[segment];
+    for (uint32_t i = 0; i < cpus; i++) {
+        cpu[i].busy = current.busy[i];
+    }
+    segmentNumber->setValue(segment);
+    if (++segmentTick >= current.ticks) {
+        segmentTick = 0;
+        segment = (segment + 1) % segmentCount;
+    }
+
+    for (uint32_t t = 0; t + kStepMs <= ms; t += kStepMs) {
+        step();
+    }
+    simulatedMsNumber->setValue(simulatedMs);
+    thermalCapNumber->setValue(thermalCap);
+    throttledMsNumber->setValue(throttledMs);
+}
+
+uint8_t SimulatedMSRBackend::targetRatio(const CPUState &state, const uint8_t lowest, const uint8_t highest) const {
+    if (!msr::HWPEnable::extract(pmEnable)) {
+        return static_cast<uint8_t>(msr::TargetRatio::extract(state.perfCtl));
+    }
+    const uint8_t minimum = static_cast<uint8_t>(max<uint64_t>(msr::HWPMinimum::extract(state.hwpRequest), lowest));
+    const uint8_t maximum = static_cast<uint8_t>(max<uint64_t>(min<uint64_t>(msr::HWPMaximum::extract(state.hwpRequest), highest), minimum));
+    if (const uint8_t desired = static_cast<uint8_t>(msr::HWPDesired::extract(state.hwpRequest))) {
+        return min(max(desired, minimum), maximum);
+    }
+    // autonomous selection: EPP 128 follows the load, 0 doubles it, 255 stays at the minimum
+    const uint32_t boost = 256 - static_cast<uint32_t>(msr::HWPEnergyPerfPreference::extract(state.hwpRequest));
+    const uint32_t scaled = min<uint32_t>(state.busy * boost / 128, 100);
+    return static_cast<uint8_t>(minimum + (maximum - minimum) * scaled / 100);
+}
+
+void SimulatedMSRBackend::step() {
+    const uint8_t base = static_cast<uint8_t>(msr::MaxNonTurboRatio::extract(platformInfo));
+    const uint8_t lowest = static_cast<uint8_t>(msr::MaxEfficiencyRatio::extract(platformInfo));
+    const uint8_t highest = static_cast<uint8_t>(msr::HighestPerformance::extract(hwpCapabilities));
+    const bool turbo = !msr::TurboModeDisable::extract(miscEnable);
+
+    uint32_t activeCores = 0;
+    for (uint32_t core = 0; core < cores; core++) {
+        for (uint32_t thread = 0; thread < threadsPerCore; thread++) {
+            if (cpu[core * threadsPerCore + thread].busy) {
+                activeCores++;
+                break;
+            }
+        }
+    }
+    const uint32_t bin = activeCores ? min<uint32_t>(activeCores, 8) - 1 : 0;
+    uint8_t turboCap = static_cast<uint8_t>(turboRatioLimit >> (bin * 8));
+    if (turboCap == 0) {
+        turboCap = highest;
+    }
+
+    uint16_t reasons = 0;
+    const uint64_t tscDelta = static_cast<uint64_t>(base) * 100 * 1000 * kStepMs;
+    uint32_t corePower[kMaxCPUs] {};
+    for (uint32_t i = 0; i < cpus; i++) {
+        CPUState &state = cpu[i];
+        uint8_t target = targetRatio(state, lowest, highest);
+        uint8_t ceiling = turbo && !msr::TurboDisengage::extract(state.perfCtl) ? max(turboCap, base) : base;
+        if (target > ceiling && ceiling < highest) {
+            reasons |= msr::LimitMaxTurbo::mask;
+        }
+        if (thermalCap < ceiling) {
+            ceiling = max(thermalCap, lowest);
+            if (target > ceiling) {
+                reasons |= msr::LimitThermal::mask;
+            }
+        }
+        state.ratio = min(max(target, lowest), ceiling);
+
+        // duty cycle in eighths, 0 is reserved and taken as no modulation
+        const uint64_t duty = msr::ClockModulationDuty::extract(state.clockModulation);
+        const uint64_t eighths = msr::ClockModulationEnable::extract(state.clockModulation) && duty ? duty : 8;
+        const uint64_t mperf = tscDelta * state.busy / 100;
+        state.mperf += mperf;
+        state.aperf += mperf * state.ratio * eighths / (static_cast<uint64_t>(base) * 8);
+        const uint64_t ratio = state.ratio;
+        // the threads of a core share its execution units
+        corePower[i / threadsPerCore] += static_cast<uint32_t>(state.busy * ratio * ratio * ratio * eighths / 8 *
+                                                               kDynamicMicrowattsPerRatioCubed / 100 / 1000 / threadsPerCore);
+    }
+    tsc += tscDelta;
+
+    uint32_t packagePower = kUncoreMilliwatts;
+    uint32_t coresPower = 0;
+    int64_t flowToHeatsink = 0;
+    int64_t hottest = kAmbientMicroC;
+    for (uint32_t core = 0; core < cores; core++) {
+        const int64_t above = max<int64_t>(coreTemperature[core] - kLeakageReferenceMicroC, 0);
+        corePower[core] += static_cast<uint32_t>(kLeakageMilliwatts + kLeakageMilliwatts * above / kLeakageReferenceMicroC);
+        coresPower += corePower[core];
+        const int64_t flow = (coreTemperature[core] - heatsinkTemperature) / kCoreMicroCPerMilliwatt;
+        coreTemperature[core] += (static_cast<int64_t>(corePower[core]) - flow) * kCoreMicroCPerMilliwattMs * kStepMs;
+        flowToHeatsink += flow;
+        hottest = max(hottest, coreTemperature[core]);
+    }
+    packagePower += coresPower;
+    const int64_t flowToAmbient = (heatsinkTemperature - kAmbientMicroC) / kHeatsinkMicroCPerMilliwatt;
+    heatsinkTemperature += (flowToHeatsink + kUncoreMilliwatts - flowToAmbient) * kStepMs / kHeatsinkMilliwattMsPerMicroC;
+    packageNanojoules += static_cast<uint64_t>(packagePower) * 1000 * kStepMs;
+    coreNanojoules += static_cast<uint64_t>(coresPower) * 1000 * kStepMs;
+
+    // TCC: PROCHOT lowers the package ratio until the hottest core is below activation
+    const int64_t activation = (static_cast<int64_t>(msr::TjMax::extract(temperatureTarget)) -
+                                static_cast<int64_t>(msr::TCCActivationOffset::extract(temperatureTarget))) * 1000000;
+    if (hottest >= activation) {
+        uint8_t running = lowest;
+        for (uint32_t i = 0; i < cpus; i++) {
+            running = max(running, cpu[i].ratio);
+        }
+        thermalCap = static_cast<uint8_t>(max<uint32_t>(min(thermalCap, running) - 1, lowest));
+        thermalLog = true;
+    } else if (thermalCap != 0xFF && hottest < activation - 1000000) {
+        thermalCap = thermalCap >= highest ? 0xFF : thermalCap + 1;
+    }
+    if (thermalCap != 0xFF) {
+        throttledMs += kStepMs;
+    }
+    perfLimitReasons = (perfLimitReasons & ~msr::LimitStatus::mask) | reasons | (static_cast<uint64_t>(reasons) << 16);
+    simulatedMs += kStepMs;
+}
+
+uint64_t SimulatedMSRBackend::thermStatus(const int64_t temperature) const {
+    const int64_t tjMax = static_cast<int64_t>(msr::TjMax::extract(temperatureTarget));
+    const int64_t readout = min<int64_t>(max<int64_t>(tjMax - temperature / 1000000, 0), msr::DigitalReadout::maxValue);
+    uint64_t value = msr::DigitalReadout::insert(0, static_cast<uint64_t>(readout));
+    value = msr::ReadingValid::insert(value, 1);
+    value = msr::ThermalStatus::insert(value, thermalCap != 0xFF);
+    return msr::ThermalStatusLog::insert(value, thermalLog);
+}
+
+uint32_t SimulatedMSRBackend::energyStatus(const uint64_t nanojoules) const {
+    const uint64_t shift = msr::EnergyStatusUnit::extract(raplPowerUnit);
+    return static_cast<uint32_t>((static_cast<unsigned __int128>(nanojoules) << shift) / 1000000000);
+}
+
+uint32_t SimulatedMSRBackend::currentCPU() const {
+    return min<uint32_t>(static_cast<uint32_t>(cpu_number()), cpus - 1);
+}
+
+uint64_t SimulatedMSRBackend::load(const uint32_t index, const uint32_t msr) const {
+    const CPUState &state = cpu[index];
+    switch (msr) {
+        case msr::HWPRequest::address:
+            return state.hwpRequest;
+        case msr::PerfCtl::address:
+            return state.perfCtl;
+        case msr::PerfStatus::address:
+            return msr::TargetRatio::insert(0, state.ratio);
+        case msr::ClockModulation::address:
+            return state.clockModulation;
+        case msr::TimeStampCounter::address:
+            return tsc;
+        case MSR_IA32_MPERF:
+            return state.mperf;
+        case MSR_IA32_APERF:
+            return state.aperf;
+        case msr::ThermStatus::address:
+            return thermStatus(coreTemperature[index / threadsPerCore]);
+        case msr::PackageThermStatus::address: {
+            int64_t hottest = kAmbientMicroC;
+            for (uint32_t core = 0; core < cores; core++) {
+                hottest = max(hottest, coreTemperature[core]);
+            }
+            return thermStatus(hottest);
+        }
+        case msr::CoreThreadCount::address:
+            return coreThreadCount;
+        case msr::PlatformInfo::address:
+            return platformInfo;
+        case msr::TurboRatioLimit::address:
+            return turboRatioLimit;
+        case msr::MiscEnable::address:
+            return miscEnable;
+        case msr::PowerCtl::address:
+            return powerCtl;
+        case msr::PMEnable::address:
+            return pmEnable;
+        case msr::HWPCapabilities::address:
+            return hwpCapabilities;
+        case msr::RAPLPowerUnit::address:
+            return raplPowerUnit;
+        case msr::PackageEnergyStatus::address:
+            return energyStatus(packageNanojoules);
+        case msr::PP0EnergyStatus::address:
+            return energyStatus(coreNanojoules);
+        case msr::TemperatureTarget::address:
+            return temperatureTarget;
+        case msr::CorePerfLimitReasons::address:
+        case msr::CorePerfLimitReasonsHSW::address:
+            return perfLimitReasons;
+        default:
+            for (size_t i = 0; i < shadowCount; i++) {
+                if (shadow[i].msr == msr) {
+                    return shadow[i].value;
+                }
+            }
+            return 0;
+    }
+}
+
+void SimulatedMSRBackend::store(const uint32_t index, const uint32_t msr, const uint64_t value) {
+    CPUState &state = cpu[index];
+    switch (msr) {
+        case msr::HWPRequest::address:
+            state.hwpRequest = value;
+            return;
+        case msr::PerfCtl::address:
+            state.perfCtl = value;
+            return;
+        case msr::ClockModulation::address:
+            state.clockModulation = value;
+            return;
+        case msr::TimeStampCounter::address:
+            tsc = value;
+            return;
+        case MSR_IA32_MPERF:
+            state.mperf = value;
+            return;
+        case MSR_IA32_APERF:
+            state.aperf = value;
+            return;
+        case msr::ThermStatus::address:
+        case msr::PackageThermStatus::address:
+            // the log bit is cleared by writing 0
+            thermalLog = thermalLog && msr::ThermalStatusLog::extract(value);
+            return;
+        case msr::CorePerfLimitReasons::address:
+        case msr::CorePerfLimitReasonsHSW::address:
+            perfLimitReasons &= value | msr::LimitStatus::mask;
+            return;
+        case msr::TurboRatioLimit::address:
+            turboRatioLimit = value;
+            return;
+        case msr::MiscEnable::address:
+            miscEnable = value;
+            return;
+        case msr::PowerCtl::address:
+            powerCtl = value;
+            return;
+        case msr::PMEnable::address:
+            // HWP cannot be disabled again until reset
+            pmEnable |= value & msr::HWPEnable::mask;
+            return;
+        case msr::TemperatureTarget::address:
+            temperatureTarget = msr::TCCActivationOffset::insert(temperatureTarget, msr::TCCActivationOffset::extract(value));
+            return;
+        case msr::PerfStatus::address:
+        case msr::CoreThreadCount::address:
+        case msr::PlatformInfo::address:
+        case msr::HWPCapabilities::address:
+        case msr::RAPLPowerUnit::address:
+        case msr::PackageEnergyStatus::address:
+        case msr::PP0EnergyStatus::address:
+            LOG("simulator: drop write 0x%llx to read-only MSR(0x%x)", value, msr);
+            return;
+        default:
+            break;
+    }
+    for (size_t i = 0; i < shadowCount; i++) {
+        if (shadow[i].msr == msr) {
+            shadow[i].value = value;
+            return;
+        }
+    }
+    if (shadowCount >= kMaxShadowRegisters) {
+        LOG("simulator: shadow register file is full, drop write 0x%llx to MSR(0x%x)", value, msr);
+        return;
+    }
+    shadow[shadowCount++] = { msr, value };
+}
+
+uint64_t SimulatedMSRBackend::read(const uint32_t msr) {
+    return load(currentCPU(), msr);
+}
+
+void SimulatedMSRBackend::write(const uint32_t msr, const uint64_t value) {
+    store(currentCPU(), msr, value);
+}
+
+void SimulatedMSRBackend::readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) {
+    for (uint32_t index = 0; index < cpus && index < this->cpus; index++) {
+        for (size_t i = 0; i < count; i++) {
+            values[index * count + i] = load(index, msrs[i]);
+        }
+    }
+}
+
+void SimulatedMSRBackend::updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) {
+    for (uint32_t index = 0; index < this->cpus; index++) {
+        if (cpus & (1ULL << index)) {
+            store(index, msr, (load(index, msr) & ~mask) | (values[index] & mask));
+        }
+    }
+}
+
+uint64_t SimulatedMSRBackend::writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) {
+    const uint32_t index = currentCPU();
+    store(index, writeMsr, value);
+    return load(index, readMsr);
+}
@@ -0,0 +1,192 @@
+//
+//  SimulatedMSRBackend.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef SimulatedMSRBackend_hpp
+#define SimulatedMSRBackend_hpp
+
+#include "MSRBackend.hpp"
+#include "CPUInfo.hpp"
+
+/**
+ *  Backend that runs CPUTune against a simulated processor (-cputsim) instead
+ *  of the real one, so that a governor or policy can be evaluated without
+ *  touching the hardware. The processor is derived from CPUInfo (logical cpus,
+ *  cores, base ratio) and stepped in kStepMs steps of simulated time by
+ *  advance(), once per tick:
+ *
+ *  - the ratio of every cpu follows IA32_HWP_REQUEST (desired, or min to max
+ *    by load and EPP) with HWP enabled, IA32_PERF_CTL otherwise, capped by
+ *    MSR_TURBO_RATIO_LIMIT for the number of active cores, by the base ratio
+ *    with turbo disabled, and by on-demand clock modulation
+ *  - core power is leakage, rising with temperature, plus busy time of its
+ *    threads times ratio^3, the package adds a fixed uncore power
+ *  - temperatures come from an RC network, one node per core over a shared
+ *    heatsink to ambient; once the hottest core reaches the TCC activation
+ *    temperature the package ratio is lowered by one per step (PROCHOT) and
+ *    raised again once it is a degree below
+ *  - APERF/MPERF/TSC, the thermal status registers, the perf limit reasons and
+ *    the RAPL energy status counters are derived from the above
+ *
+ *  Load is the busy percent of every cpu per tick from a load trace, see
+ *  setLoadTrace(), or a built-in synthetic pattern. A tick may advance a
+ *  multiple of the update interval (SimulatorTimeScale) to run faster than
+ *  real time. Registers without a model keep the last written value for all
+ *  cpus and read 0 before. Stepping never allocates.
+ *  Published as the "Simulator" dictionary.
+ */
+class SimulatedMSRBackend : public MSRBackend {
+public:
+    static constexpr uint32_t kMaxCPUs = 64;
+    static constexpr size_t kMaxSegments = 32;
+    // simulated time of one step of the model
+    static constexpr uint32_t kStepMs = 1;
+    static constexpr uint32_t kMaxTimeScale = 100;
+
+    /**
+     *  Build the simulated processor and create the published dictionary
+     *
+     *  @param info       processor whose topology and base ratio are simulated
+     *  @param timeScale  simulated time per real time, capped at kMaxTimeScale
+     *
+     *  @return true on success
+     */
+    bool init(const CPUInfo &info, const uint32_t timeScale);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    uint32_t getTimeScale(void) const { return timeScale; }
+
+    /**
+     *  Parse a load trace, one segment per line:
+     *
+     *      <ticks> <busy percent of cpu 0> [<busy percent of cpu 1> ...]
+     *
+     *  cpus without a value take the last one given, the trace repeats after
+     *  its last segment. A recorded TelemetryLog reduces to this format with
+     *  one segment per run of equal samples.
+     *
+     *  @param content  trace text
+     *  @param length   length of content
+     *
+     *  @return true if every line parsed, the previous trace is kept otherwise
+     */
+    bool setLoadTrace(const char *content, const size_t length);
+
+    /**
+     *  Go back to the built-in synthetic load: all cpus busy, all nearly idle,
+     *  half of the cpus busy, 30 ticks each
+     */
+    void resetLoadTrace(void);
+
+    /**
+     *  Run the model for the given simulated time with the load of the next
+     *  tick of the trace
+     *
+     *  @param ms  simulated milliseconds, rounded down to kStepMs
+     */
+    void advance(const uint32_t ms);
+
+    uint64_t read(const uint32_t msr) override;
+    void write(const uint32_t msr, const uint64_t value) override;
+    void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) override;
+    void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) override;
+    uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) override;
+
+private:
+    // power and thermal model, temperatures in micro degrees Celsius
+    static constexpr uint32_t kUncoreMilliwatts = 2000;
+    static constexpr uint32_t kLeakageMilliwatts = 300;
+    // at 100% busy, 15 W for a core at ratio 40
+    static constexpr uint32_t kDynamicMicrowattsPerRatioCubed = 234;
+    static constexpr int64_t kAmbientMicroC = 35000000;
+    // micro degrees per milliwatt and millisecond: 50 mJ/C per core, 20 J/C heatsink
+    static constexpr int64_t kCoreMicroCPerMilliwattMs = 20;
+    static constexpr int64_t kHeatsinkMilliwattMsPerMicroC = 20;
+    // micro degrees per milliwatt of flow: 2 C/W core to heatsink, 1 C/W heatsink to ambient
+    static constexpr int64_t kCoreMicroCPerMilliwatt = 2000;
+    static constexpr int64_t kHeatsinkMicroCPerMilliwatt = 1000;
+    static constexpr size_t kMaxShadowRegisters = 32;
+
+    struct Segment {
+        uint32_t ticks;
+        uint8_t busy[kMaxCPUs];
+    };
+
+    struct CPUState {
+        uint64_t hwpRequest;
+        uint64_t perfCtl;
+        uint64_t clockModulation;
+        uint64_t mperf;
+        uint64_t aperf;
+        uint8_t ratio;
+        uint8_t busy;
+    };
+
+    struct ShadowRegister {
+        uint32_t msr;
+        uint64_t value;
+    };
+
+    uint32_t cpus = 0;
+    uint32_t cores = 0;
+    uint32_t threadsPerCore = 1;
+    uint32_t timeScale = 1;
+
+    CPUState cpu[kMaxCPUs] {};
+    int64_t coreTemperature[kMaxCPUs] {};
+    int64_t heatsinkTemperature = 0;
+
+    // package scope registers
+    uint64_t platformInfo = 0;
+    uint64_t turboRatioLimit = 0;
+    uint64_t miscEnable = 0;
+    uint64_t powerCtl = 0;
+    uint64_t pmEnable = 0;
+    uint64_t hwpCapabilities = 0;
+    uint64_t raplPowerUnit = 0;
+    uint64_t temperatureTarget = 0;
+    uint64_t coreThreadCount = 0;
+    uint64_t perfLimitReasons = 0;
+    bool thermalLog = false;
+    uint64_t tsc = 0;
+    uint64_t packageNanojoules = 0;
+    uint64_t coreNanojoules = 0;
+
+    // ratio the package is held at by TCC, 0xFF when not throttling
+    uint8_t thermalCap = 0xFF;
+    uint64_t simulatedMs = 0;
+    uint64_t throttledMs = 0;
+
+    Segment segments[kMaxSegments] {};
+    // trace being parsed by setLoadTrace()
+    Segment loaded[kMaxSegments] {};
+    size_t segmentCount = 0;
+    size_t segment = 0;
+    uint32_t segmentTick = 0;
+
+    ShadowRegister shadow[kMaxShadowRegisters] {};
+    size_t shadowCount = 0;
+
+    OSDictionary *dict = nullptr;
+    OSNumber *simulatedMsNumber = nullptr;
+    OSNumber *timeScaleNumber = nullptr;
+    OSNumber *segmentNumber = nullptr;
+    OSNumber *thermalCapNumber = nullptr;
+    OSNumber *throttledMsNumber = nullptr;
+
+    uint32_t currentCPU(void) const;
+    uint64_t load(const uint32_t index, const uint32_t msr) const;
+    void store(const uint32_t index, const uint32_t msr, const uint64_t value);
+    uint64_t thermStatus(const int64_t temperature) const;
+    uint32_t energyStatus(const uint64_t nanojoules) const;
+    uint8_t targetRatio(const CPUState &state, const uint8_t lowest, const uint8_t highest) const;
+    void step(void);
+};
+
+#endif /* SimulatedMSRBackend_hpp */
@@ -0,0 +1,128 @@
+//
+//  StateCache.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "StateCache.hpp"
+#include "CPUInfo.hpp"
+#include <i386/proc_reg.h>
+#include <kern/cpu_number.h>
+
+const StateCache::Entry StateCache::kEntries[kEntryCount] {
+    { MSR_IA32_MISC_ENABLE,  "MiscEnable" },
+    { MSR_IA32_PERF_CTL,     "PerfCtl" },
+    { MSR_IA32_POWER_CTL,    "PowerCtl" },
+    { MSR_IA32_PM_ENABLE,    "PMEnable" },
+    { MSR_IA32_HWP_REQUEST,  "HWPRequest" },
+    { MSR_TURBO_RATIO_LIMIT, "TurboRatioLimit" },
+};
+
+bool StateCache::init(MSRBackend *next) {
+    this->next = next;
+    dict = OSDictionary::withCapacity(kEntryCount + 2);
+    if (!dict) {
+        return false;
+    }
+    generationNumber = addNumberToDictionary(dict, "Generation");
+    writesNumber = addNumberToDictionary(dict, "Writes");
+    bool ok = generationNumber && writesNumber;
+    for (size_t i = 0; ok && i < kEntryCount; i++) {
+        numbers[i] = addNumberToDictionary(dict, kEntries[i].key);
+        ok = numbers[i] != nullptr;
+    }
+    if (!ok) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+void StateCache::free() {
+    // the OSNumber objects are owned by the dictionary
+    OSSafeReleaseNULL(dict);
+    generationNumber = nullptr;
+    writesNumber = nullptr;
+    for (size_t i = 0; i < kEntryCount; i++) {
+        numbers[i] = nullptr;
+    }
+}
+
+void StateCache::set(const size_t index, const uint64_t value) {
+    if (!known[index] || cached[index] != value) {
+        known[index] = true;
+        cached[index] = value;
+        generation++;
+        if (dict) {
+            numbers[index]->setValue(value);
+            generationNumber->setValue(generation);
+        }
+    }
+}
+
+void StateCache::update(const uint32_t msr, const uint64_t value) {
+    const bool stateCPU = static_cast<uint32_t>(cpu_number()) == kStateCPU;
+    for (size_t i = 0; i < kEntryCount; i++) {
+        if (kEntries[i].msr == msr) {
+            if (stateCPU || !known[i]) {
+                set(i, value);
+            }
+            return;
+        }
+    }
+}
+
+uint64_t StateCache::read(const uint32_t msr) {
+    const uint64_t value = next->read(msr);
+    update(msr, value);
+    return value;
+}
+
+void StateCache::write(const uint32_t msr, const uint64_t value) {
+    next->write(msr, value);
+    writes++;
+    if (writesNumber) {
+        writesNumber->setValue(writes);
+    }
+    update(msr, value);
+}
+
+void StateCache::readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) {
+    // per cpu samples (telemetry) are not part of the state
+    next->readAllCPUs(msrs, count, values, cpus);
+}
+
+void StateCache::updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) {
+    next->updateCPUs(msr, mask, values, cpus);
+    writes += __builtin_popcountll(cpus);
+    if (writesNumber) {
+        writesNumber->setValue(writes);
+    }
+    if (!(cpus & (1ULL << kStateCPU))) {
+        return;
+    }
+    if (static_cast<uint32_t>(cpu_number()) == kStateCPU) {
+        update(msr, next->read(msr));
+        return;
+    }
+    // the state cpu is not this one, apply the same read-modify-write to its value
+    for (size_t i = 0; i < kEntryCount; i++) {
+        if (kEntries[i].msr == msr) {
+            if (known[i]) {
+                set(i, (cached[i] & ~mask) | (values[kStateCPU] & mask));
+            }
+            return;
+        }
+    }
+}
+
+uint64_t StateCache::writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) {
+    const uint64_t result = next->writeRead(writeMsr, value, readMsr);
+    writes++;
+    if (writesNumber) {
+        writesNumber->setValue(writes);
+    }
+    update(writeMsr, value);
+    return result;
+}
@@ -0,0 +1,87 @@
+//
+//  StateCache.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef StateCache_hpp
+#define StateCache_hpp
+
+#include "MSRBackend.hpp"
+
+/**
+ *  Backend that remembers the last value read from or written to each
+ *  register CPUTune controls, and publishes it as the "State" dictionary in
+ *  the IORegistry. Clients read the current settings from there without a
+ *  single MSR access. The state is the one of cpu kStateCPU: the timer moves
+ *  between cpus, and core sets, knobs and the sweep may leave the cpus with
+ *  different values, so following the current cpu would change it without
+ *  any setting changing. Until kStateCPU is seen, the first value read on
+ *  any cpu stands in. "Generation" is bumped on every change, so a client
+ *  polling the state only needs to compare one number. "Writes" counts every
+ *  MSR write that reached the processor: the cache sits below MSRProbe, so
+ *  accesses the probe refused neither count nor change the state. Reads are
+ *  still forwarded: the tuning loop compares against the hardware, not the cache.
+ */
+class StateCache : public MSRBackend {
+public:
+    // cpu whose registers are published, the boot cpu is always there
+    static constexpr uint32_t kStateCPU = 0;
+
+    /**
+     *  Create the published dictionary
+     *
+     *  @param next  backend the accesses are forwarded to
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *next);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    /**
+     *  @return number of MSR writes issued since start
+     */
+    uint64_t getWriteCount(void) const { return writes; }
+
+    uint64_t read(const uint32_t msr) override;
+    void write(const uint32_t msr, const uint64_t value) override;
+    void readAllCPUs(const uint32_t *msrs, const size_t count, uint64_t *values, const uint32_t cpus) override;
+    void updateCPUs(const uint32_t msr, const uint64_t mask, const uint64_t *values, const uint64_t cpus) override;
+    uint64_t writeRead(const uint32_t writeMsr, const uint64_t value, const uint32_t readMsr) override;
+
+private:
+    struct Entry {
+        uint32_t msr;
+        const char *key;
+    };
+
+    static constexpr size_t kEntryCount = 6;
+    static const Entry kEntries[kEntryCount];
+
+    MSRBackend *next = nullptr;
+    uint64_t cached[kEntryCount] {};
+    bool known[kEntryCount] {};
+    uint64_t generation = 0;
+    uint64_t writes = 0;
+
+    OSDictionary *dict = nullptr;
+    OSNumber *numbers[kEntryCount] {};
+    OSNumber *generationNumber = nullptr;
+    OSNumber *writesNumber = nullptr;
+
+    /**
+     *  Take the value of a register accessed on the current cpu
+     */
+    void update(const uint32_t msr, const uint64_t value);
+
+    /**
+     *  Set the value of a register to publish
+     */
+    void set(const size_t index, const uint64_t value);
+};
+
+#endif /* StateCache_hpp */
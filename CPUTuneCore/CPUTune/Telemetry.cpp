@@ -0,0 +1,179 @@
+//
+//  Telemetry.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "Telemetry.hpp"
+#include <kern/clock.h>
+
+constexpr uint32_t Telemetry::kPerCPURegisters[kPerCPURegisterCount];
+
+bool Telemetry::init(MSRBackend *backend, const CPUInfo &info) {
+    this->backend = backend;
+    cpus = info.threadCount;
+    baseMHz = info.baseRatio * 100;
+    hasAPERFMPERF = info.supportedAPERFMPERF;
+    hasRAPL = info.supportedRAPL;
+    hasDTS = info.powerManagementFeatures & CPUID_PM_DIGITAL_THERMAL_SENSOR;
+    hasPTM = info.powerManagementFeatures & CPUID_PM_PACKAGE_THERMAL;
+    perfLimitReasonsMSR = info.perfLimitReasonsMSR;
+    perCPURegisters = hasDTS ? kPerCPURegisterCount : kThermStatus;
+    if (cpus == 0) {
+        LOG("no logical processor reported, telemetry disabled");
+        return false;
+    }
+
+    const size_t values = cpus * perCPURegisters;
+    current = static_cast<uint64_t *>(kern_os_malloc(sizeof(uint64_t) * values));
+    previous = static_cast<uint64_t *>(kern_os_malloc(sizeof(uint64_t) * values));
+    perCPU = static_cast<CPUSample *>(kern_os_malloc(sizeof(CPUSample) * cpus));
+    dict = OSDictionary::withCapacity(7);
+    cpuArray = OSArray::withCapacity(cpus);
+    if (!current || !previous || !perCPU || !dict || !cpuArray) {
+        free();
+        return false;
+    }
+    memset(perCPU, 0, sizeof(CPUSample) * cpus);
+
+    samplesNumber = addNumberToDictionary(dict, "Samples");
+    packageEnergyNumber = addNumberToDictionary(dict, "PackageEnergyMicrojoules");
+    packagePowerNumber = addNumberToDictionary(dict, "PackagePowerMilliwatts");
+    corePowerNumber = addNumberToDictionary(dict, "CorePowerMilliwatts");
+    bool ok = samplesNumber && packageEnergyNumber && packagePowerNumber && corePowerNumber &&
+              dict->setObject("CPUs", cpuArray);
+    if (ok && hasPTM) {
+        packageTemperatureNumber = addNumberToDictionary(dict, "PackageTemperatureC");
+        ok = packageTemperatureNumber != nullptr;
+    }
+    if (ok && perfLimitReasonsMSR) {
+        throttleReasonsNumber = addNumberToDictionary(dict, "ThrottleReasons");
+        ok = throttleReasonsNumber != nullptr;
+    }
+    for (uint32_t cpu = 0; ok && cpu < cpus; cpu++) {
+        OSDictionary *cpuDict = OSDictionary::withCapacity(3);
+        if (!cpuDict) {
+            ok = false;
+            break;
+        }
+        perCPU[cpu].effectiveMHzNumber = addNumberToDictionary(cpuDict, "EffectiveFrequencyMHz");
+        perCPU[cpu].busyPercentNumber = addNumberToDictionary(cpuDict, "BusyPercent");
+        ok = perCPU[cpu].effectiveMHzNumber && perCPU[cpu].busyPercentNumber;
+        if (ok && hasDTS) {
+            perCPU[cpu].temperatureNumber = addNumberToDictionary(cpuDict, "TemperatureC");
+            ok = perCPU[cpu].temperatureNumber != nullptr;
+        }
+        ok = ok && cpuArray->setObject(cpuDict);
+        cpuDict->release();
+    }
+    if (!ok) {
+        free();
+        return false;
+    }
+
+    if (hasRAPL) {
+        // energy status unit, 1/2^ESU joules
+        energyUnitShift = static_cast<uint32_t>(msr::EnergyStatusUnit::extract(backend->read(msr::RAPLPowerUnit::address)));
+    }
+    if (hasDTS) {
+        // assume 100 C where TjMax is not reported
+        tjMax = static_cast<uint32_t>(msr::TjMax::extract(backend->read(msr::TemperatureTarget::address)));
+        if (tjMax == 0) {
+            tjMax = 100;
+        }
+    }
+    return true;
+}
+
+void Telemetry::free() {
+    // the OSNumber objects are owned by the dictionaries
+    OSSafeReleaseNULL(cpuArray);
+    OSSafeReleaseNULL(dict);
+    if (current) {
+        kern_os_free(current);
+        current = nullptr;
+    }
+    if (previous) {
+        kern_os_free(previous);
+        previous = nullptr;
+    }
+    if (perCPU) {
+        kern_os_free(perCPU);
+        perCPU = nullptr;
+    }
+    cpus = 0;
+}
+
+void Telemetry::sample() {
+    if (!dict) {
+        return;
+    }
+    const uint64_t now = mach_absolute_time();
+    uint64_t elapsedNs = 0;
+    absolutetime_to_nanoseconds(now - lastSampleTime, &elapsedNs);
+    if (fixedIntervalNs) {
+        elapsedNs = fixedIntervalNs;
+    }
+
+    if (hasAPERFMPERF) {
+        backend->readAllCPUs(kPerCPURegisters, perCPURegisters, current, cpus);
+        for (uint32_t cpu = 0; hasDTS && cpu < cpus; cpu++) {
+            CPUSample &s = perCPU[cpu];
+            s.temperatureC = toCelsius(current[cpu * perCPURegisters + kThermStatus]);
+            s.temperatureNumber->setValue(s.temperatureC);
+        }
+        for (uint32_t cpu = 0; samples > 0 && cpu < cpus; cpu++) {
+            const uint64_t *cur = current + cpu * perCPURegisters;
+            const uint64_t *prev = previous + cpu * perCPURegisters;
+            const uint64_t tsc = cur[kTSC] - prev[kTSC];
+            const uint64_t mperf = cur[kMPERF] - prev[kMPERF];
+            const uint64_t aperf = cur[kAPERF] - prev[kAPERF];
+            CPUSample &s = perCPU[cpu];
+            // APERF/MPERF only count in C0, at the actual and the base frequency respectively
+            s.effectiveMHz = mperf ? static_cast<uint32_t>(baseMHz * aperf / mperf) : 0;
+            s.busyPercent = tsc ? static_cast<uint32_t>(min<uint64_t>(mperf * 100 / tsc, 100)) : 0;
+            s.effectiveMHzNumber->setValue(s.effectiveMHz);
+            s.busyPercentNumber->setValue(s.busyPercent);
+        }
+        uint64_t *swap = previous;
+        previous = current;
+        current = swap;
+    }
+
+    if (hasRAPL) {
+        sampleRAPL(elapsedNs);
+    }
+
+    if (hasPTM) {
+        packageTemperatureC = toCelsius(backend->read(MSR_IA32_PACKAGE_THERM_STATUS));
+        packageTemperatureNumber->setValue(packageTemperatureC);
+    }
+
+    if (perfLimitReasonsMSR) {
+        throttleReasons = static_cast<uint16_t>(backend->read(perfLimitReasonsMSR));
+        throttleReasonsNumber->setValue(throttleReasons);
+    }
+
+    lastSampleTime = now;
+    samples++;
+    samplesNumber->setValue(samples);
+}
+
+void Telemetry::sampleRAPL(const uint64_t elapsedNs) {
+    // energy status counters are 32 bit wide and wrap around
+    const uint32_t package = static_cast<uint32_t>(msr::PackageEnergy::extract(backend->read(msr::PackageEnergyStatus::address)));
+    const uint32_t core = static_cast<uint32_t>(msr::PP0Energy::extract(backend->read(msr::PP0EnergyStatus::address)));
+    if (samples > 0 && elapsedNs > 0) {
+        const uint64_t packageUJ = (static_cast<uint64_t>(package - lastPackageEnergy) * 1000000) >> energyUnitShift;
+        const uint64_t coreUJ = (static_cast<uint64_t>(core - lastCoreEnergy) * 1000000) >> energyUnitShift;
+        packageEnergyUJ += packageUJ;
+        packagePowerMW = static_cast<uint32_t>(packageUJ * 1000000 / elapsedNs);
+        corePowerMW = static_cast<uint32_t>(coreUJ * 1000000 / elapsedNs);
+        packageEnergyNumber->setValue(packageEnergyUJ);
+        packagePowerNumber->setValue(packagePowerMW);
+        corePowerNumber->setValue(corePowerMW);
+    }
+    lastPackageEnergy = package;
+    lastCoreEnergy = core;
+}
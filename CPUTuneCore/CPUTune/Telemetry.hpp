@@ -0,0 +1,158 @@
+//
+//  Telemetry.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef Telemetry_hpp
+#define Telemetry_hpp
+
+#include "CPUInfo.hpp"
+#include "MSRBackend.hpp"
+#include <i386/proc_reg.h>
+
+/**
+ *  Per tick hardware telemetry: effective frequency, busy time and
+ *  temperature of every cpu (IA32_APERF/IA32_MPERF against the TSC,
+ *  IA32_THERM_STATUS), package temperature, RAPL package/core energy and the
+ *  reasons the core frequency is currently limited.
+ *  Published as the "Telemetry" dictionary in the IORegistry. All buffers and
+ *  OSNumber objects are created by init(), sample() only updates them.
+ */
+class Telemetry {
+public:
+    /**
+     *  Allocate per cpu buffers and the published dictionary
+     *
+     *  @param backend  MSR backend to sample through
+     *  @param info     detected cpu information
+     *
+     *  @return true on success
+     */
+    bool init(MSRBackend *backend, const CPUInfo &info);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    /**
+     *  Read the counters on every cpu and update the published values
+     */
+    void sample(void);
+
+    uint32_t getCPUCount(void) const { return cpus; }
+
+    uint32_t getEffectiveFrequencyMHz(const uint32_t cpu) const { return cpu < cpus ? perCPU[cpu].effectiveMHz : 0; }
+
+    uint32_t getBusyPercent(const uint32_t cpu) const { return cpu < cpus ? perCPU[cpu].busyPercent : 0; }
+
+    uint64_t getPackageEnergyMicrojoules(void) const { return packageEnergyUJ; }
+
+    uint32_t getPackagePowerMilliwatts(void) const { return packagePowerMW; }
+
+    uint32_t getCorePowerMilliwatts(void) const { return corePowerMW; }
+
+    bool hasPower(void) const { return hasRAPL; }
+
+    bool hasTemperature(void) const { return hasDTS; }
+
+    int32_t getTemperatureC(const uint32_t cpu) const { return cpu < cpus ? perCPU[cpu].temperatureC : 0; }
+
+    bool hasPackageTemperature(void) const { return hasPTM; }
+
+    int32_t getPackageTemperatureC(void) const { return packageTemperatureC; }
+
+    bool hasThrottleReasons(void) const { return perfLimitReasonsMSR != 0; }
+
+    /**
+     *  Active limit reasons, bits 15:0 of the core perf limit reasons register
+     */
+    uint16_t getThrottleReasons(void) const { return throttleReasons; }
+
+    uint64_t getSampleCount(void) const { return samples; }
+
+    /**
+     *  Take a fixed time between two samples instead of the clock, for a
+     *  simulated processor that advances a fixed time per tick
+     *
+     *  @param ns  nanoseconds per sample, 0 to use the clock again
+     */
+    void setFixedInterval(const uint64_t ns) { fixedIntervalNs = ns; }
+
+private:
+    // registers sampled on every cpu, in this order
+    enum PerCPURegister {
+        kTSC,
+        kMPERF,
+        kAPERF,
+        // only read with a digital thermal sensor
+        kThermStatus,
+        kPerCPURegisterCount
+    };
+
+    static constexpr uint32_t kPerCPURegisters[kPerCPURegisterCount] {
+        MSR_IA32_TIME_STAMP_COUNTER,
+        MSR_IA32_MPERF,
+        MSR_IA32_APERF,
+        MSR_IA32_THERM_STATUS,
+    };
+
+    struct CPUSample {
+        uint32_t effectiveMHz;
+        uint32_t busyPercent;
+        int32_t temperatureC;
+        OSNumber *effectiveMHzNumber;
+        OSNumber *busyPercentNumber;
+        OSNumber *temperatureNumber;
+    };
+
+    MSRBackend *backend = nullptr;
+    uint32_t cpus = 0;
+    uint32_t baseMHz = 0;
+    bool hasAPERFMPERF = false;
+    bool hasRAPL = false;
+    bool hasDTS = false;
+    bool hasPTM = false;
+    uint32_t energyUnitShift = 0;
+    // registers read per cpu, kThermStatus only with a thermal sensor
+    size_t perCPURegisters = 0;
+    uint32_t tjMax = 0;
+    uint32_t perfLimitReasonsMSR = 0;
+
+    uint64_t *current = nullptr;
+    uint64_t *previous = nullptr;
+    CPUSample *perCPU = nullptr;
+    uint64_t samples = 0;
+
+    uint64_t lastSampleTime = 0;
+    uint64_t fixedIntervalNs = 0;
+    uint32_t lastPackageEnergy = 0;
+    uint32_t lastCoreEnergy = 0;
+    uint64_t packageEnergyUJ = 0;
+    uint32_t packagePowerMW = 0;
+    uint32_t corePowerMW = 0;
+    int32_t packageTemperatureC = 0;
+    uint16_t throttleReasons = 0;
+
+    OSDictionary *dict = nullptr;
+    OSArray *cpuArray = nullptr;
+    OSNumber *samplesNumber = nullptr;
+    OSNumber *packageEnergyNumber = nullptr;
+    OSNumber *packagePowerNumber = nullptr;
+    OSNumber *corePowerNumber = nullptr;
+    OSNumber *packageTemperatureNumber = nullptr;
+    OSNumber *throttleReasonsNumber = nullptr;
+
+    void sampleRAPL(const uint64_t elapsedNs);
+
+    /**
+     *  Temperature in degrees Celsius from a thermal status register
+     *  (the digital readout is the distance to TjMax, same bits in the package register)
+     */
+    int32_t toCelsius(const uint64_t thermStatus) const {
+        return static_cast<int32_t>(tjMax) - static_cast<int32_t>(msr::DigitalReadout::extract(thermStatus));
+    }
+};
+
+#endif /* Telemetry_hpp */
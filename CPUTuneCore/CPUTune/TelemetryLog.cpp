@@ -0,0 +1,123 @@
+//
+//  TelemetryLog.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "TelemetryLog.hpp"
+#include <kern/clock.h>
+
+TelemetryLog::~TelemetryLog() {
+    free();
+}
+
+bool TelemetryLog::init(const char *path, const Telemetry &telemetry, const uint32_t blockSamples, const uint32_t intervalMs) {
+    cpus = telemetry.getCPUCount();
+    if (!path || cpus == 0 || blockSamples == 0) {
+        return false;
+    }
+    this->path = path;
+    this->blockSamples = (blockSamples + 7) & ~7U;
+
+    // lay out the columns, see TelemetryLog.hpp
+    const size_t n = this->blockSamples;
+    timestampOffset = sizeof(TelemetryLogBlock);
+    frequencyOffset = timestampOffset + sizeof(uint64_t) * n;
+    busyOffset = frequencyOffset + sizeof(uint16_t) * n * cpus;
+    temperatureOffset = busyOffset + sizeof(uint16_t) * n * cpus;
+    packagePowerOffset = temperatureOffset + sizeof(int16_t) * n * cpus;
+    corePowerOffset = packagePowerOffset + sizeof(uint32_t) * n;
+    packageTemperatureOffset = corePowerOffset + sizeof(uint32_t) * n;
+    throttleOffset = packageTemperatureOffset + sizeof(int16_t) * n;
+    const size_t bytes = throttleOffset + sizeof(uint16_t) * n;
+    if (bytes > UINT32_MAX) {
+        return false;
+    }
+    blockBytes = static_cast<uint32_t>(bytes);
+
+    block = static_cast<uint8_t *>(kern_os_malloc(blockBytes));
+    if (!block) {
+        LOG("cannot allocate a %u byte telemetry log block", blockBytes);
+        return false;
+    }
+    memset(block, 0, blockBytes);
+
+    TelemetryLogHeader fileHeader {};
+    fileHeader.magic = kLogMagic;
+    fileHeader.version = kLogVersion;
+    fileHeader.headerSize = sizeof(TelemetryLogHeader);
+    fileHeader.cpus = cpus;
+    fileHeader.blockSamples = this->blockSamples;
+    fileHeader.blockBytes = blockBytes;
+    fileHeader.intervalMs = intervalMs;
+    fileHeader.flags = (telemetry.hasTemperature() ? kFlagTemperature : 0) |
+                       (telemetry.hasPackageTemperature() ? kFlagPackageTemperature : 0) |
+                       (telemetry.hasThrottleReasons() ? kFlagThrottleReasons : 0) |
+                       (telemetry.hasPower() ? kFlagRAPL : 0);
+    err = writeBytesToFile(path, &fileHeader, sizeof(fileHeader), 0);
+    if (err) {
+        free();
+        return false;
+    }
+    sequence = 0;
+    startTime = mach_absolute_time();
+    return true;
+}
+
+void TelemetryLog::free() {
+    if (block) {
+        kern_os_free(block);
+        block = nullptr;
+    }
+    path = nullptr;
+}
+
+void TelemetryLog::append(const Telemetry &telemetry) {
+    if (!block || err) {
+        return;
+    }
+    TelemetryLogBlock *blockHeader = header();
+    const uint32_t i = blockHeader->samples;
+    uint64_t ns = 0;
+    absolutetime_to_nanoseconds(mach_absolute_time() - startTime, &ns);
+    if (i == 0) {
+        blockHeader->sequence = sequence;
+        blockHeader->startNs = ns;
+    }
+
+    column<uint64_t>(timestampOffset)[i] = ns;
+    uint16_t *frequency = column<uint16_t>(frequencyOffset);
+    uint16_t *busy = column<uint16_t>(busyOffset);
+    int16_t *temperature = column<int16_t>(temperatureOffset);
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        const size_t at = cpu * blockSamples + i;
+        frequency[at] = static_cast<uint16_t>(min<uint32_t>(telemetry.getEffectiveFrequencyMHz(cpu), UINT16_MAX));
+        busy[at] = static_cast<uint16_t>(telemetry.getBusyPercent(cpu));
+        temperature[at] = static_cast<int16_t>(telemetry.getTemperatureC(cpu));
+    }
+    column<uint32_t>(packagePowerOffset)[i] = telemetry.getPackagePowerMilliwatts();
+    column<uint32_t>(corePowerOffset)[i] = telemetry.getCorePowerMilliwatts();
+    column<int16_t>(packageTemperatureOffset)[i] = static_cast<int16_t>(telemetry.getPackageTemperatureC());
+    column<uint16_t>(throttleOffset)[i] = telemetry.getThrottleReasons();
+
+    blockHeader->samples = i + 1;
+    if (blockHeader->samples == blockSamples) {
+        flush();
+    }
+}
+
+errno_t TelemetryLog::flush() {
+    if (!block || err || header()->samples == 0) {
+        return err;
+    }
+    const off_t offset = sizeof(TelemetryLogHeader) + static_cast<off_t>(sequence) * blockBytes;
+    err = writeBytesToFile(path, block, blockBytes, offset);
+    if (err) {
+        LOG("stop logging telemetry to %s, error %d", path, err);
+        return err;
+    }
+    sequence++;
+    memset(block, 0, blockBytes);
+    return 0;
+}
@@ -0,0 +1,124 @@
+//
+//  TelemetryLog.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef TelemetryLog_hpp
+#define TelemetryLog_hpp
+
+#include "Telemetry.hpp"
+
+/**
+ *  Log file layout: one TelemetryLogHeader followed by blocks of blockBytes
+ *  each, all little endian, so block n starts at sizeof(header) + n * blockBytes
+ *  and the file can be mapped and indexed directly. A block holds up to
+ *  blockSamples samples stored column by column, every column is blockSamples
+ *  entries long (unused entries of the last block are zero):
+ *
+ *      TelemetryLogBlock                            16 bytes
+ *      uint64_t timestampNs[blockSamples]           since the log started
+ *      uint16_t frequencyMHz[cpus][blockSamples]
+ *      uint16_t busyPercent[cpus][blockSamples]
+ *      int16_t  temperatureC[cpus][blockSamples]    0 without thermal sensor
+ *      uint32_t packagePowerMW[blockSamples]
+ *      uint32_t corePowerMW[blockSamples]
+ *      int16_t  packageTemperatureC[blockSamples]   0 without package sensor
+ *      uint16_t throttleReasons[blockSamples]       0 without limit reasons
+ *
+ *  blockSamples is a multiple of 8, which keeps every column 16 byte aligned.
+ */
+struct TelemetryLogHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t cpus;
+    uint32_t blockSamples;
+    uint32_t blockBytes;
+    uint32_t intervalMs;
+    uint32_t flags;
+    uint32_t reserved;
+} PACKED;
+
+struct TelemetryLogBlock {
+    uint32_t samples;
+    uint32_t sequence;
+    uint64_t startNs;
+} PACKED;
+
+static_assert(sizeof(TelemetryLogHeader) == 32, "TelemetryLogHeader is part of the log file format");
+static_assert(sizeof(TelemetryLogBlock) == 16, "TelemetryLogBlock is part of the log file format");
+
+/**
+ *  Appends telemetry samples to a columnar log file. Samples are collected in
+ *  a block buffer allocated once by init() and the block is appended to the
+ *  file whenever it is full, so the log grows one write per blockSamples ticks
+ *  and a crash loses at most the current block.
+ */
+class TelemetryLog {
+public:
+    ~TelemetryLog();
+
+    static constexpr uint32_t kLogMagic = 0x4C545043; // "CPTL"
+    static constexpr uint16_t kLogVersion = 1;
+
+    // header flags, set for the columns backed by hardware
+    static constexpr uint32_t kFlagTemperature = bit(0);
+    static constexpr uint32_t kFlagPackageTemperature = bit(1);
+    static constexpr uint32_t kFlagThrottleReasons = bit(2);
+    static constexpr uint32_t kFlagRAPL = bit(3);
+
+    /**
+     *  Allocate the block buffer and write the file header
+     *
+     *  @param path          log file, truncated
+     *  @param telemetry     initialised telemetry the samples are taken from
+     *  @param blockSamples  samples per block, rounded up to a multiple of 8
+     *  @param intervalMs    nominal sample interval stored in the header
+     *
+     *  @return true on success
+     */
+    bool init(const char *path, const Telemetry &telemetry, const uint32_t blockSamples, const uint32_t intervalMs);
+
+    void free(void);
+
+    /**
+     *  Append the current telemetry sample, writing the block once it is full
+     */
+    void append(const Telemetry &telemetry);
+
+    /**
+     *  Write the partially filled block, if any
+     *
+     *  @return 0 on success or errno on error
+     */
+    errno_t flush(void);
+
+private:
+    const char *path = nullptr;
+    uint8_t *block = nullptr;
+    uint32_t cpus = 0;
+    uint32_t blockSamples = 0;
+    uint32_t blockBytes = 0;
+    uint32_t sequence = 0;
+    uint64_t startTime = 0;
+    errno_t err = 0;
+
+    // column offsets into block
+    size_t timestampOffset = 0;
+    size_t frequencyOffset = 0;
+    size_t busyOffset = 0;
+    size_t temperatureOffset = 0;
+    size_t packagePowerOffset = 0;
+    size_t corePowerOffset = 0;
+    size_t packageTemperatureOffset = 0;
+    size_t throttleOffset = 0;
+
+    TelemetryLogBlock *header(void) const { return reinterpret_cast<TelemetryLogBlock *>(block); }
+
+    template <typename T>
+    T *column(const size_t offset) const { return reinterpret_cast<T *>(block + offset); }
+};
+
+#endif /* TelemetryLog_hpp */
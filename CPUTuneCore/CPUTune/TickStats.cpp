@@ -0,0 +1,56 @@
+//
+//  TickStats.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "TickStats.hpp"
+#include <kern/clock.h>
+
+constexpr const char *TickStats::kCounterNames[kCounterCount];
+
+bool TickStats::init() {
+    dict = OSDictionary::withCapacity(kCounterCount);
+    if (!dict) {
+        return false;
+    }
+    for (size_t i = 0; i < kCounterCount; i++) {
+        numbers[i] = OSNumber::withNumber(0ULL, 64);
+        if (!numbers[i] || !dict->setObject(kCounterNames[i], numbers[i])) {
+            free();
+            return false;
+        }
+    }
+    return true;
+}
+
+void TickStats::free() {
+    for (size_t i = 0; i < kCounterCount; i++) {
+        OSSafeReleaseNULL(numbers[i]);
+    }
+    OSSafeReleaseNULL(dict);
+}
+
+void TickStats::endTick(const uint32_t changed, const uint32_t unchanged) {
+    uint64_t ns = 0;
+    absolutetime_to_nanoseconds(mach_absolute_time() - tickStart, &ns);
+
+    ticks++;
+    totalNs += ns;
+    minNs = min(minNs, ns);
+    maxNs = max(maxNs, ns);
+    changedTotal += changed;
+    unchangedTotal += unchanged;
+
+    if (!dict) {
+        return;
+    }
+    numbers[kTicks]->setValue(ticks);
+    numbers[kLastTickNs]->setValue(ns);
+    numbers[kMinTickNs]->setValue(minNs);
+    numbers[kMaxTickNs]->setValue(maxNs);
+    numbers[kMeanTickNs]->setValue(totalNs / ticks);
+    numbers[kSourcesChanged]->setValue(changedTotal);
+    numbers[kSourcesUnchanged]->setValue(unchangedTotal);
+}
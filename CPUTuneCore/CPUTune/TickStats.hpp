@@ -0,0 +1,80 @@
+//
+//  TickStats.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef TickStats_hpp
+#define TickStats_hpp
+
+#include "kern_util.hpp"
+
+/**
+ *  Cost of readConfigAtRuntime() per tick, published as the "TickStats"
+ *  dictionary in the IORegistry (ioreg -a -r -c CPUTune -k TickStats).
+ *  The OSNumber objects are created once and updated in place, so
+ *  recording a tick never allocates.
+ */
+class TickStats {
+public:
+    /**
+     *  Create the published dictionary
+     *
+     *  @return true on success
+     */
+    bool init(void);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    void beginTick(void) { tickStart = mach_absolute_time(); }
+
+    uint64_t getTicks(void) const { return ticks; }
+
+    uint64_t getTickStart(void) const { return tickStart; }
+
+    /**
+     *  Account the tick started by beginTick()
+     *
+     *  @param changed    config sources whose content changed this tick
+     *  @param unchanged  config sources served from their cached content
+     */
+    void endTick(const uint32_t changed, const uint32_t unchanged);
+
+private:
+    enum Counter {
+        kTicks,
+        kLastTickNs,
+        kMinTickNs,
+        kMaxTickNs,
+        kMeanTickNs,
+        kSourcesChanged,
+        kSourcesUnchanged,
+        kCounterCount
+    };
+
+    static constexpr const char *kCounterNames[kCounterCount] {
+        "Ticks",
+        "LastTickNs",
+        "MinTickNs",
+        "MaxTickNs",
+        "MeanTickNs",
+        "ConfigSourcesChanged",
+        "ConfigSourcesUnchanged",
+    };
+
+    OSDictionary *dict = nullptr;
+    OSNumber *numbers[kCounterCount] {};
+
+    uint64_t tickStart = 0;
+    uint64_t ticks = 0;
+    uint64_t totalNs = 0;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t maxNs = 0;
+    uint64_t changedTotal = 0;
+    uint64_t unchangedTotal = 0;
+};
+
+#endif /* TickStats_hpp */
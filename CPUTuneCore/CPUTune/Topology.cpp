@@ -0,0 +1,90 @@
+//
+//  Topology.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "Topology.hpp"
+#include <kern/cpu_number.h>
+
+/**
+ *  Runs action on every cpu with interrupts disabled, missing from headers
+ */
+extern "C" void mp_rendezvous_no_intrs(void (*action_func)(void *), void *arg);
+
+struct APICIDContext {
+    uint32_t *ids;
+    uint32_t cpus;
+    bool extended;
+};
+
+static void readAPICIDAction(void *arg) {
+    auto ctx = static_cast<APICIDContext *>(arg);
+    const uint32_t cpu = static_cast<uint32_t>(cpu_number());
+    if (cpu >= ctx->cpus) {
+        return;
+    }
+    uint32_t cpuid_reg[4];
+    if (ctx->extended) {
+        // x2APIC ID of this cpu
+        do_cpuid(0x0000000B, cpuid_reg);
+        ctx->ids[cpu] = cpuid_reg[edx];
+    } else {
+        // initial APIC ID
+        do_cpuid(0x00000001, cpuid_reg);
+        ctx->ids[cpu] = bitfield32(cpuid_reg[ebx], 31, 24);
+    }
+}
+
+bool Topology::init(const CPUInfo &info) {
+    cpus = info.threadCount < kMaxCPUs ? info.threadCount : kMaxCPUs;
+    cores = 0;
+    if (cpus == 0) {
+        return false;
+    }
+
+    uint32_t cpuid_reg[4];
+    do_cpuid(0x00000000, cpuid_reg);
+    bool extended = false;
+    if (cpuid_reg[eax] >= 0x0B) {
+        // subleaf 0 is the SMT level, a leaf without levels reports no logical processors
+        do_cpuid(0x0000000B, cpuid_reg);
+        extended = bitfield32(cpuid_reg[ebx], 15, 0) != 0;
+        smtShift = static_cast<uint8_t>(bitfield32(cpuid_reg[eax], 4, 0));
+    }
+    if (!extended) {
+        // threads per core rounded up to a power of two
+        const uint32_t threadsPerCore = info.coreCount ? (info.threadCount + info.coreCount - 1) / info.coreCount : 1;
+        smtShift = 0;
+        while ((1U << smtShift) < threadsPerCore) {
+            smtShift++;
+        }
+    }
+    APICIDContext ctx {apicIDs, cpus, extended};
+    mp_rendezvous_no_intrs(readAPICIDAction, &ctx);
+
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        uint32_t core = 0;
+        while (core < cores && (apicIDs[__builtin_ctzll(coreCPUs[core])] >> smtShift) != (apicIDs[cpu] >> smtShift)) {
+            core++;
+        }
+        if (core == cores) {
+            coreCPUs[cores++] = 0;
+        }
+        coreCPUs[core] |= 1ULL << cpu;
+        coreOf[cpu] = static_cast<uint8_t>(core);
+    }
+    LOG("topology: %u cpus on %u cores, SMT shift %u (%s)", cpus, cores, smtShift, extended ? "CPUID.0BH" : "CPUID.01H");
+    return true;
+}
+
+uint64_t Topology::withSiblings(const uint64_t cpus) const {
+    uint64_t all = cpus;
+    for (uint32_t cpu = 0; cpu < this->cpus; cpu++) {
+        if (cpus & (1ULL << cpu)) {
+            all |= coreCPUs[coreOf[cpu]];
+        }
+    }
+    return all;
+}
@@ -0,0 +1,67 @@
+//
+//  Topology.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef Topology_hpp
+#define Topology_hpp
+
+#include "CPUInfo.hpp"
+
+/**
+ *  Which logical cpus are SMT siblings of one core, from the APIC ID every
+ *  cpu reports about itself: siblings share all APIC ID bits above the SMT
+ *  field (CPUID.0BH, or CPUID.01H with the thread and core count of
+ *  MSR_CORE_THREAD_COUNT on cpus without the leaf).
+ */
+class Topology {
+public:
+    static constexpr uint32_t kMaxCPUs = 64;
+
+    /**
+     *  Read the APIC ID on every cpu and group the cpus into cores
+     *
+     *  @param info  detected cpu information
+     *
+     *  @return true on success
+     */
+    bool init(const CPUInfo &info);
+
+    uint32_t getCPUCount(void) const { return cpus; }
+
+    uint32_t getCoreCount(void) const { return cores; }
+
+    /**
+     *  @return true if a core runs more than one logical cpu
+     */
+    bool hasSMT(void) const { return cores < cpus; }
+
+    uint32_t getAPICID(const uint32_t cpu) const { return cpu < cpus ? apicIDs[cpu] : 0; }
+
+    /**
+     *  @return index of the core of cpu, cores are numbered by their first cpu
+     */
+    uint32_t getCore(const uint32_t cpu) const { return cpu < cpus ? coreOf[cpu] : 0; }
+
+    /**
+     *  @return cpus of a core, bit n for cpu n
+     */
+    uint64_t getCoreCPUs(const uint32_t core) const { return core < cores ? coreCPUs[core] : 0; }
+
+    /**
+     *  @return cpus plus all their siblings
+     */
+    uint64_t withSiblings(const uint64_t cpus) const;
+
+private:
+    uint32_t cpus = 0;
+    uint32_t cores = 0;
+    uint8_t smtShift = 0;
+    uint32_t apicIDs[kMaxCPUs] {};
+    uint8_t coreOf[kMaxCPUs] {};
+    uint64_t coreCPUs[kMaxCPUs] {};
+};
+
+#endif /* Topology_hpp */
@@ -0,0 +1,241 @@
+//
+//  Transaction.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "Transaction.hpp"
+
+constexpr const char *Transaction::kKnobNames[kKnobCount];
+constexpr const char *Transaction::kStatusNames[kStatusCount];
+
+static_assert(Transaction::kMaxOperations <= 32, "one bit per knob in the given mask of parse()");
+
+/**
+ *  Whether [begin, end) of str spells name
+ */
+static bool tokenEquals(const char *str, const size_t begin, const size_t end, const char *name) {
+    size_t k = 0;
+    while (begin + k < end && name[k] == str[begin + k]) {
+        k++;
+    }
+    return begin + k == end && name[k] == '\0';
+}
+
+bool Transaction::isReservedName(const char *name, const size_t length) {
+    if (tokenEquals(name, 0, length, "seq")) {
+        return true;
+    }
+    for (size_t knob = 0; knob < kKnobCount; knob++) {
+        if (tokenEquals(name, 0, length, kKnobNames[knob])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Transaction::init(const KnobTable *knobs) {
+    this->knobs = knobs;
+    dict = OSDictionary::withCapacity(6);
+    noDetailString = OSString::withCString("");
+    statusKey = OSSymbol::withCString("Status");
+    detailKey = OSSymbol::withCString("Detail");
+    if (!dict || !noDetailString || !statusKey || !detailKey) {
+        free();
+        return false;
+    }
+    sequenceNumber = addNumberToDictionary(dict, "Sequence");
+    lineNumber = addNumberToDictionary(dict, "Line");
+    operationsNumber = addNumberToDictionary(dict, "Operations");
+    transactionsNumber = addNumberToDictionary(dict, "Transactions");
+    bool ok = sequenceNumber && lineNumber && operationsNumber && transactionsNumber;
+    for (size_t i = 0; ok && i < kStatusCount; i++) {
+        statusStrings[i] = OSString::withCString(kStatusNames[i]);
+        ok = statusStrings[i] != nullptr;
+    }
+    for (size_t i = 0; ok && i < kParseStatusCount; i++) {
+        parseStrings[i] = OSString::withCString(parseStatusToString(static_cast<ParseStatus>(i)));
+        ok = parseStrings[i] != nullptr;
+    }
+    for (size_t i = 0; ok && i < kValidateStatusCount; i++) {
+        validateStrings[i] = OSString::withCString(validateStatusToString(static_cast<ValidateStatus>(i)));
+        ok = validateStrings[i] != nullptr;
+    }
+    // nothing applied yet
+    ok = ok && dict->setObject(statusKey, statusStrings[kEmpty]) && dict->setObject(detailKey, noDetailString);
+    if (!ok) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+void Transaction::free() {
+    for (size_t i = 0; i < kStatusCount; i++) {
+        OSSafeReleaseNULL(statusStrings[i]);
+    }
+    for (size_t i = 0; i < kParseStatusCount; i++) {
+        OSSafeReleaseNULL(parseStrings[i]);
+    }
+    for (size_t i = 0; i < kValidateStatusCount; i++) {
+        OSSafeReleaseNULL(validateStrings[i]);
+    }
+    OSSafeReleaseNULL(noDetailString);
+    OSSafeReleaseNULL(statusKey);
+    OSSafeReleaseNULL(detailKey);
+    OSSafeReleaseNULL(dict);
+}
+
+bool Transaction::parse(const char *content, const size_t length, const bool truncated) {
+    operationCount = 0;
+    sequence = 0;
+    if (truncated) {
+        reject(0, kTooLong);
+        return false;
+    }
+
+    uint16_t line = 0;
+    uint32_t given = 0;
+    size_t i = 0;
+    while (i < length) {
+        line++;
+        size_t end = i;
+        while (end < length && content[end] != '\n') {
+            end++;
+        }
+        const size_t next = end + 1;
+        // knob name
+        while (i < end && (content[i] == ' ' || content[i] == '\t' || content[i] == '\r')) {
+            i++;
+        }
+        if (i == end || content[i] == '#') {
+            i = next;
+            continue;
+        }
+        const size_t nameBegin = i;
+        while (i < end && content[i] != ' ' && content[i] != '\t' && content[i] != '\r') {
+            i++;
+        }
+
+        if (tokenEquals(content, nameBegin, i, "seq")) {
+            const ParseResult result = parseUInt64(content + i, end - i, 10, &sequence);
+            if (result.status != kParseOK) {
+                reject(line, kParseError, result.status);
+                return false;
+            }
+            i = next;
+            continue;
+        }
+
+        // resolved into a local, the array is full once every knob was given
+        Operation op {};
+        if (!lookup(content + nameBegin, i - nameBegin, &op)) {
+            reject(line, kUnknownKnob);
+            return false;
+        }
+        // declared knobs follow the built-in ones in the given bits
+        const size_t bit = op.knob == kGenericKnob ? kKnobCount + op.index : op.knob;
+        if (given & (1U << bit)) {
+            reject(line, kDuplicateKnob);
+            return false;
+        }
+        given |= 1U << bit;
+
+        op.line = line;
+        const ParseResult result = parseValue(content + i, end - i, &op);
+        if (result.status != kParseOK) {
+            reject(line, kParseError, result.status);
+            return false;
+        }
+        operations[operationCount++] = op;
+        i = next;
+    }
+
+    if (operationCount == 0) {
+        reject(0, kEmpty);
+        return false;
+    }
+    return true;
+}
+
+bool Transaction::lookup(const char *name, const size_t length, Operation *op) const {
+    size_t knob = 0;
+    while (knob < kKnobCount && !tokenEquals(name, 0, length, kKnobNames[knob])) {
+        knob++;
+    }
+    int index = -1;
+    if (knob == kKnobCount) {
+        index = knobs ? knobs->find(name, length) : -1;
+        if (index < 0) {
+            return false;
+        }
+    }
+    op->knob = static_cast<Knob>(knob);
+    op->index = index < 0 ? 0 : static_cast<uint8_t>(index);
+    return true;
+}
+
+ParseResult Transaction::parseValue(const char *str, const size_t length, Operation *op) {
+    ParseResult result {};
+    switch (op->knob) {
+        case kHWPRequest:
+            result = parseRegisterConfig(str, length, kHWPRequestFields, arrsize(kHWPRequestFields), &op->value, &op->mask);
+            break;
+        case kTurboRatioLimit:
+            result = parseRegisterConfig(str, length, kTurboRatioLimitFields, arrsize(kTurboRatioLimitFields), &op->value, &op->mask);
+            break;
+        case kGenericKnob:
+            // field value, the declared range is checked by the caller
+            result = parseUInt64(str, length, 10, &op->value);
+            op->mask = ~0ULL;
+            break;
+        default:
+            result = parseUInt64(str, length, 10, &op->value);
+            if (result.status == kParseOK && op->value > 1) {
+                result.status = kParseInvalidDigit;
+            }
+            op->mask = 1;
+            break;
+    }
+    return result;
+}
+
+void Transaction::load(const Operation *ops, const size_t count, const uint64_t sequence) {
+    operationCount = count < kMaxOperations ? count : kMaxOperations;
+    for (size_t i = 0; i < operationCount; i++) {
+        operations[i] = ops[i];
+    }
+    this->sequence = sequence;
+}
+
+void Transaction::commit() {
+    publish(0, kApplied, noDetailString);
+    LOG("applied transaction %llu with %lu knobs", sequence, operationCount);
+}
+
+void Transaction::reject(const uint16_t line, const Status status, const uint8_t detail) {
+    OSString *detailString = noDetailString;
+    if (status == kParseError && detail < kParseStatusCount) {
+        detailString = parseStrings[detail];
+    } else if (status == kInvalidValue && detail < kValidateStatusCount) {
+        detailString = validateStrings[detail];
+    }
+    publish(line, status, detailString);
+    LOG("refuse transaction %llu at line %u: %s %s", sequence, line,
+        kStatusNames[status], detailString ? detailString->getCStringNoCopy() : "");
+}
+
+void Transaction::publish(const uint16_t line, const Status status, OSString *detail) {
+    transactions++;
+    if (!dict) {
+        return;
+    }
+    // the keys exist, replacing their objects does not allocate
+    dict->setObject(statusKey, statusStrings[status]);
+    dict->setObject(detailKey, detail);
+    sequenceNumber->setValue(sequence);
+    lineNumber->setValue(line);
+    operationsNumber->setValue(status == kApplied ? operationCount : 0);
+    transactionsNumber->setValue(transactions);
+}
@@ -0,0 +1,194 @@
+//
+//  Transaction.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef Transaction_hpp
+#define Transaction_hpp
+
+#include "kern_util.hpp"
+#include "ConfigParser.hpp"
+#include "ConfigValidator.hpp"
+#include "KnobTable.hpp"
+
+/**
+ *  A batch of settings from one config file (e.g. /tmp/CPUTune.conf), one
+ *  knob per line:
+ *
+ *      seq 42
+ *      turbo 1
+ *      hwp min=8 max=48 epp=128
+ *      trl 0x2b2c2d2f3030
+ *      uncore_max 30
+ *
+ *  Every line is parsed and validated before anything is written, so either
+ *  all knobs are applied or none. The outcome is published as the "LastApply"
+ *  dictionary in the IORegistry together with the sequence number of the
+ *  batch, which lets a writer match the result to its request. Names that are
+ *  not built in are looked up in the knob table declared in Info.plist. All published
+ *  objects are created by init(), reporting an outcome never allocates.
+ */
+class Transaction {
+public:
+    enum Knob : uint8_t {
+        kTurboBoost,
+        kProcHot,
+        kSpeedShift,
+        kHWPRequest,
+        kTurboRatioLimit,
+        kKnobCount,
+        // a knob of the KnobTable, Operation::index selects it
+        kGenericKnob = kKnobCount
+    };
+
+    static constexpr size_t kMaxOperations = kKnobCount + KnobTable::kMaxKnobs;
+
+    enum Status : uint8_t {
+        kApplied,
+        kEmpty,             // no knob given
+        kTooLong,           // file exceeds the config buffer
+        kUnknownKnob,
+        kDuplicateKnob,
+        kParseError,        // detail is a ParseStatus
+        kInvalidValue,      // detail is a ValidateStatus
+        kUnsupported,       // knob not available on this cpu
+        kStatusCount
+    };
+
+    struct Operation {
+        Knob knob;
+        // KnobTable index of a kGenericKnob
+        uint8_t index;
+        uint16_t line;
+        // switch state, or the given bits of a register
+        uint64_t value;
+        // bits of the register given, all ones for a whole value
+        uint64_t mask;
+    };
+
+    /**
+     *  Create the published dictionary
+     *
+     *  @param knobs  declared knobs accepted besides the built-in ones, may be nullptr
+     *
+     *  @return true on success
+     */
+    bool init(const KnobTable *knobs = nullptr);
+
+    void free(void);
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    /**
+     *  Parse a batch, a failure is published right away
+     *
+     *  @param content    file content
+     *  @param length     length of content
+     *  @param truncated  file is longer than content
+     *
+     *  @return true if every line parsed
+     */
+    bool parse(const char *content, const size_t length, const bool truncated);
+
+    /**
+     *  Resolve a knob name
+     *
+     *  @param name    name, not terminated
+     *  @param length  length of name
+     *  @param op      receives knob and index
+     *
+     *  @return false if the name is unknown
+     */
+    bool lookup(const char *name, const size_t length, Operation *op) const;
+
+    /**
+     *  Parse the value of a resolved knob into value and mask of op
+     *
+     *  @param str     value, need not be null terminated
+     *  @param length  length of str
+     *  @param op      operation with knob set by lookup()
+     *
+     *  @return parse result
+     */
+    static ParseResult parseValue(const char *str, const size_t length, Operation *op);
+
+    /**
+     *  Take a batch that was resolved elsewhere (e.g. a profile) instead of parsing one
+     *
+     *  @param ops       operations, every knob at most once
+     *  @param count     number of operations
+     *  @param sequence  sequence number to publish with the outcome
+     */
+    void load(const Operation *ops, const size_t count, const uint64_t sequence);
+
+    size_t getOperationCount(void) const { return operationCount; }
+
+    const Operation &getOperation(const size_t i) const { return operations[i]; }
+
+    /**
+     *  Publish that every operation was applied
+     */
+    void commit(void);
+
+    /**
+     *  Publish that the batch was refused, nothing was written
+     *
+     *  @param line    1-based line of the failing knob, 0 for the whole file
+     *  @param status  reason
+     *  @param detail  ParseStatus or ValidateStatus for kParseError and kInvalidValue
+     */
+    void reject(const uint16_t line, const Status status, const uint8_t detail = 0);
+
+    /**
+     *  Whether name is a built-in knob or keyword
+     *
+     *  @param name    name, not terminated
+     *  @param length  length of name
+     */
+    static bool isReservedName(const char *name, const size_t length);
+
+private:
+    static constexpr const char *kKnobNames[kKnobCount] {
+        "turbo",
+        "prochot",
+        "speedshift",
+        "hwp",
+        "trl",
+    };
+
+    static constexpr const char *kStatusNames[kStatusCount] {
+        "applied",
+        "empty",
+        "too long",
+        "unknown knob",
+        "duplicate knob",
+        "parse error",
+        "invalid value",
+        "unsupported",
+    };
+
+    const KnobTable *knobs = nullptr;
+    Operation operations[kMaxOperations] {};
+    size_t operationCount = 0;
+    uint64_t sequence = 0;
+    uint64_t transactions = 0;
+
+    OSDictionary *dict = nullptr;
+    OSNumber *sequenceNumber = nullptr;
+    OSNumber *lineNumber = nullptr;
+    OSNumber *operationsNumber = nullptr;
+    OSNumber *transactionsNumber = nullptr;
+    // every string that can be published, created once
+    OSString *statusStrings[kStatusCount] {};
+    OSString *parseStrings[kParseStatusCount] {};
+    OSString *validateStrings[kValidateStatusCount] {};
+    OSString *noDetailString = nullptr;
+    const OSSymbol *statusKey = nullptr;
+    const OSSymbol *detailKey = nullptr;
+
+    void publish(const uint16_t line, const Status status, OSString *detail);
+};
+
+#endif /* Transaction_hpp */
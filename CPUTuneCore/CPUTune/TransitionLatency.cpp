@@ -0,0 +1,146 @@
+//
+//  TransitionLatency.cpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#include "TransitionLatency.hpp"
+#include <i386/proc_reg.h>
+#include <kern/clock.h>
+
+/**
+ *  Current ratio of this cpu, IA32_PERF_STATUS[15:8]
+ */
+static inline uint8_t currentRatio(void) {
+    // Polled directly: thousands of reads per measurement would flood an MSR trace
+    return static_cast<uint8_t>(rdmsr64(MSR_IA32_PERF_STS) >> 8);
+}
+
+bool TransitionLatency::init(const uint32_t timeoutUs) {
+    nanoseconds_to_absolutetime(static_cast<uint64_t>(min(timeoutUs, kMaxTimeoutUs)) * 1000, &timeoutAbs);
+
+    dict = OSDictionary::withCapacity(3);
+    measurements = OSArray::withCapacity(kMaxEPPValues * kDirectionCount);
+    if (!dict || !measurements || !dict->setObject("Measurements", measurements)) {
+        free();
+        return false;
+    }
+    timeoutsNumber = addNumberToDictionary(dict, "Timeouts");
+    overflowsNumber = addNumberToDictionary(dict, "UntrackedEPP");
+    bool ok = timeoutsNumber && overflowsNumber;
+
+    for (size_t i = 0; ok && i < kMaxEPPValues * kDirectionCount; i++) {
+        Slot &slot = slots[i];
+        slot.minUs = UINT64_MAX;
+        slot.dict = OSDictionary::withCapacity(7);
+        OSArray *histogram = OSArray::withCapacity(kBuckets);
+        const char *direction = (i % kDirectionCount == kRampUp) ? "up" : "down";
+        OSString *directionString = OSString::withCString(direction);
+        ok = slot.dict && histogram && directionString &&
+             slot.dict->setObject("Direction", directionString) &&
+             slot.dict->setObject("HistogramLog2Us", histogram);
+        if (ok) {
+            slot.eppNumber = addNumberToDictionary(slot.dict, "EPP");
+            slot.countNumber = addNumberToDictionary(slot.dict, "Count");
+            slot.meanNumber = addNumberToDictionary(slot.dict, "MeanUs");
+            slot.minNumber = addNumberToDictionary(slot.dict, "MinUs");
+            slot.maxNumber = addNumberToDictionary(slot.dict, "MaxUs");
+            ok = slot.eppNumber && slot.countNumber && slot.meanNumber && slot.minNumber && slot.maxNumber;
+        }
+        for (size_t b = 0; ok && b < kBuckets; b++) {
+            OSNumber *number = OSNumber::withNumber(0ULL, 64);
+            ok = number && histogram->setObject(number);
+            // owned by the histogram array
+            slot.histogram[b] = ok ? number : nullptr;
+            OSSafeReleaseNULL(number);
+        }
+        OSSafeReleaseNULL(histogram);
+        OSSafeReleaseNULL(directionString);
+    }
+    if (!ok) {
+        free();
+        return false;
+    }
+    return true;
+}
+
+void TransitionLatency::free() {
+    for (size_t i = 0; i < kMaxEPPValues * kDirectionCount; i++) {
+        OSSafeReleaseNULL(slots[i].dict);
+        slots[i] = Slot {};
+    }
+    OSSafeReleaseNULL(measurements);
+    OSSafeReleaseNULL(dict);
+}
+
+TransitionLatency::Slot *TransitionLatency::getSlot(const uint8_t epp, const Direction direction) {
+    for (size_t i = direction; i < kMaxEPPValues * kDirectionCount; i += kDirectionCount) {
+        Slot &slot = slots[i];
+        if (!slot.used) {
+            // measurements has room for every slot, adding one does not allocate
+            slot.used = true;
+            slot.epp = epp;
+            slot.eppNumber->setValue(epp);
+            measurements->setObject(slot.dict);
+            return &slot;
+        }
+        if (slot.epp == epp) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void TransitionLatency::account(Slot *slot, const uint64_t us) {
+    size_t bucket = 0;
+    while (bucket + 1 < kBuckets && (1ULL << bucket) <= us) {
+        bucket++;
+    }
+    slot->count++;
+    slot->totalUs += us;
+    slot->minUs = min(slot->minUs, us);
+    slot->maxUs = max(slot->maxUs, us);
+    slot->countNumber->setValue(slot->count);
+    slot->meanNumber->setValue(slot->totalUs / slot->count);
+    slot->minNumber->setValue(slot->minUs);
+    slot->maxNumber->setValue(slot->maxUs);
+    slot->histogram[bucket]->setValue(slot->histogram[bucket]->unsigned64BitValue() + 1);
+}
+
+void TransitionLatency::writeAndMeasure(MSRBackend *backend, const uint32_t msr, const uint64_t value, const uint8_t epp) {
+    if (!dict) {
+        backend->write(msr, value);
+        return;
+    }
+
+    // stay on this cpu for the write and the whole busy loop
+    const boolean_t interrupts = ml_set_interrupts_enabled(FALSE);
+    const uint8_t before = currentRatio();
+    const uint64_t start = mach_absolute_time();
+    backend->write(msr, value);
+    uint8_t after = before;
+    uint64_t now = start;
+    while (after == before && now - start < timeoutAbs) {
+        after = currentRatio();
+        now = mach_absolute_time();
+    }
+    ml_set_interrupts_enabled(interrupts);
+
+    if (after == before) {
+        timeouts++;
+        timeoutsNumber->setValue(timeouts);
+        return;
+    }
+
+    uint64_t ns = 0;
+    absolutetime_to_nanoseconds(now - start, &ns);
+    Slot *slot = getSlot(epp, after > before ? kRampUp : kRampDown);
+    if (!slot) {
+        overflows++;
+        overflowsNumber->setValue(overflows);
+        return;
+    }
+    account(slot, ns / 1000);
+    DBGLOG("ratio %u -> %u took %llu ns after writing 0x%llx to MSR(0x%x)", before, after, ns, value, msr);
+}
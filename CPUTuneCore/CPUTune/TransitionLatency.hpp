@@ -0,0 +1,93 @@
+//
+//  TransitionLatency.hpp
+//  CPUTune
+//
+//  Copyright (c) 2018 syscl. All rights reserved.
+//
+
+#ifndef TransitionLatency_hpp
+#define TransitionLatency_hpp
+
+#include "MSRBackend.hpp"
+
+/**
+ *  Measures how long the current cpu takes to leave its ratio after a new
+ *  performance request (IA32_HWP_REQUEST or IA32_PERF_CTL) is written.
+ *  The write is issued with interrupts disabled and IA32_PERF_STATUS is polled
+ *  in a busy loop on the same cpu until the ratio moves or the timeout expires.
+ *  Results are bucketed by EPP and direction and published as the
+ *  "TransitionLatency" dictionary in the IORegistry.
+ */
+class TransitionLatency {
+public:
+    // longest busy wait with interrupts disabled
+    static constexpr uint32_t kMaxTimeoutUs = 10000;
+
+    /**
+     *  Preallocate the published statistics
+     *
+     *  @param timeoutUs  longest busy wait per measurement in microseconds, at most kMaxTimeoutUs
+     *
+     *  @return true on success
+     */
+    bool init(const uint32_t timeoutUs);
+
+    void free(void);
+
+    bool isEnabled(void) const { return dict != nullptr; }
+
+    OSDictionary *getDictionary(void) const { return dict; }
+
+    /**
+     *  Write a performance request and measure the resulting ratio change
+     *
+     *  @param backend  MSR backend the request is written through
+     *  @param msr      IA32_HWP_REQUEST or IA32_PERF_CTL
+     *  @param value    value to write
+     *  @param epp      energy performance preference in effect (0 without HWP)
+     */
+    void writeAndMeasure(MSRBackend *backend, const uint32_t msr, const uint64_t value, const uint8_t epp);
+
+private:
+    // distinct EPP values tracked, each one has a ramp up and a ramp down slot
+    static constexpr size_t kMaxEPPValues = 8;
+    // log2 microsecond buckets: [0,1) [1,2) [2,4) ... [512,1024) [1024,inf)
+    static constexpr size_t kBuckets = 12;
+
+    enum Direction : uint8_t {
+        kRampUp,
+        kRampDown,
+        kDirectionCount
+    };
+
+    struct Slot {
+        bool used;
+        uint8_t epp;
+        uint64_t count;
+        uint64_t totalUs;
+        uint64_t minUs;
+        uint64_t maxUs;
+        OSDictionary *dict;
+        OSNumber *eppNumber;
+        OSNumber *countNumber;
+        OSNumber *meanNumber;
+        OSNumber *minNumber;
+        OSNumber *maxNumber;
+        OSNumber *histogram[kBuckets];
+    };
+
+    Slot slots[kMaxEPPValues * kDirectionCount] {};
+    uint64_t timeoutAbs = 0;
+    uint64_t timeouts = 0;
+    uint64_t overflows = 0;
+
+    OSDictionary *dict = nullptr;
+    OSArray *measurements = nullptr;
+    OSNumber *timeoutsNumber = nullptr;
+    OSNumber *overflowsNumber = nullptr;
+
+    Slot *getSlot(const uint8_t epp, const Direction direction);
+    void account(Slot *slot, const uint64_t us);
+};
+
+#endif /* TransitionLatency_hpp */
@@ -51,6 +51,42 @@ errno_t writeBufferToFile(const char *path, char *buffer) {
     return err;
 }
 
+errno_t writeBytesToFile(const char *path, const void *buffer, size_t length, off_t off) {
+    errno_t err = 0;
+    vnode_t vp = NULLVP;
+    vfs_context_t ctxt = vfs_context_create(nullptr);
+    
+    int fmode = O_CREAT | FWRITE | O_NOFOLLOW | (off == 0 ? O_TRUNC : 0);
+    int cmode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH;
+    
+    if (ctxt) {
+        if ((err = vnode_open(path, fmode, cmode, VNODE_LOOKUP_NOFOLLOW, &vp, ctxt))) {
+            LOG("vnode_open(%s) failed with error %d!", path, err);
+        } else {
+            if (vnode_isreg(vp)) {
+                if ((err = vn_rdwr(UIO_WRITE, vp, static_cast<char *>(const_cast<void *>(buffer)), static_cast<int>(length), off, UIO_SYSSPACE, IO_NOCACHE|IO_NODELOCKED|IO_UNIT, vfs_context_ucred(ctxt), (int *) 0, vfs_context_proc(ctxt)))) {
+                    LOG("vn_rdwr(%s) failed with error %d!", path, err);
+                }
+            } else {
+                LOG("%s is not a regular file!", path);
+                err = EINVAL;
+            }
+            
+            errno_t closeErr = vnode_close(vp, FWASWRITTEN, ctxt);
+            if (closeErr) {
+                LOG("vnode_close(%s) failed with error %d!", path, closeErr);
+                err = err ? err : closeErr;
+            }
+        }
+        vfs_context_rele(ctxt);
+    } else {
+        LOG("cannot obtain ctxt!");
+        err = 0xFFFF;
+    }
+    
+    return err;
+}
+
 int readFileData(void *buffer, off_t off, size_t size, vnode_t vnode, vfs_context_t ctxt) {
     uio_t uio = uio_create(1, off, UIO_SYSSPACE, UIO_READ);
     if (!uio) {
@@ -60,20 +96,16 @@ int readFileData(void *buffer, off_t off, size_t size, vnode_t vnode, vfs_contex
     
     // imitate the kernel and read a single page from the file
     int error = uio_addiov(uio, CAST_USER_ADDR_T(buffer), size);
-    if (error) {
-        // LOG("readFileData: uio_addiov returned error %d!", error);
-        return error;
-    }
-    
-    if ((error = VNOP_READ(vnode, uio, 0, ctxt))) {
-        return error;
+    if (!error) {
+        error = VNOP_READ(vnode, uio, 0, ctxt);
     }
     
-    if (uio_resid(uio)) {
+    if (!error && uio_resid(uio)) {
         // uio_resid returned non-null
-        return EINVAL;
+        error = EINVAL;
     }
     
+    uio_free(uio);
     return error;
 }
 
@@ -117,6 +149,69 @@ uint8_t *readFileAsBytes(const char* path, off_t off, size_t bytes) {
     return buffer;
 }
 
+errno_t getFileStamp(const char *path, FileStamp *stamp) {
+    vnode_t vnode = NULLVP;
+    vfs_context_t ctx = vfs_context_create(nullptr);
+    if (!ctx) {
+        return ENOMEM;
+    }
+    
+    errno_t err = vnode_lookup(path, 0, &vnode, ctx);
+    if (!err) {
+        vnode_attr va;
+        VATTR_INIT(&va);
+        VATTR_WANTED(&va, va_data_size);
+        VATTR_WANTED(&va, va_modify_time);
+        if (!(err = vnode_getattr(vnode, &va, ctx))) {
+            stamp->modifySeconds = va.va_modify_time.tv_sec;
+            stamp->modifyNanoseconds = va.va_modify_time.tv_nsec;
+            stamp->size = va.va_data_size;
+        }
+        vnode_put(vnode);
+    }
+    
+    vfs_context_rele(ctx);
+    return err;
+}
+
+size_t readFileToBuffer(const char *path, off_t off, uint8_t *buffer, size_t bytes) {
+    vnode_t vnode = NULLVP;
+    vfs_context_t ctx = vfs_context_create(nullptr);
+    if (!ctx) {
+        return 0;
+    }
+    
+    size_t length = 0;
+    if (!vnode_lookup(path, 0, &vnode, ctx)) {
+        vnode_attr va;
+        VATTR_INIT(&va);
+        VATTR_WANTED(&va, va_data_size);
+        size_t size = vnode_getattr(vnode, &va, ctx) ? 0 : va.va_data_size;
+        
+        bytes = min(bytes, size > static_cast<size_t>(off) ? size - off : 0);
+        if (bytes > 0 && !readFileData(buffer, off, bytes, vnode, ctx)) {
+            length = bytes;
+        }
+        vnode_put(vnode);
+    }
+    
+    // gurantee null termination
+    buffer[length] = 0;
+    vfs_context_rele(ctx);
+    return length;
+}
+
+OSNumber *addNumberToDictionary(OSDictionary *dict, const char *key) {
+    OSNumber *number = OSNumber::withNumber(0ULL, 64);
+    if (number) {
+        bool added = dict->setObject(key, number);
+        number->release();
+        if (!added) {
+            number = nullptr;
+        }
+    }
+    return number;
+}
 
 void cputune_os_log(const char *format, ...) {
     char tmp[1024];
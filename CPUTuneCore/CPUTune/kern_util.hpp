@@ -10,6 +10,8 @@
 
 #include <IOKit/IOLib.h>
 #include <libkern/version.h>
+#include <libkern/c++/OSDictionary.h>
+#include <libkern/c++/OSNumber.h>
 
 #define xStringify(a) Stringify(a)
 #define Stringify(a) #a
@@ -95,6 +97,8 @@ EXPORT extern "C" void cputune_os_log(const char *format, ...);
  */
 static constexpr const char *bootargOff  {"-cputoff"};          // Disable the kext
 static constexpr const char *bootargBeta {"-cputbeta"};         // Force enable the kext on unsupported os
+static constexpr const char *bootargDryRun {"-cputdry"};        // Never write MSRs, keep the writes in a shadow register file
+static constexpr const char *bootargSimulate {"-cputsim"};      // Run against a simulated processor instead of the MSRs
 
 extern kmod_info_t kmod_info;
 
@@ -171,21 +175,11 @@ constexpr size_t parseModuleVersion(const char *version) {
 }
 
 /**
- *  Convert a hexicimal string to a long integer
- *
- *  @param hex string literal representing the hex value
- *
- *  @return long integer base 10
+ *  Number of elements of a fixed size array
  */
-inline long hexToInt(const char *hex) {
-    int base = 16;
-    for (const char *c = hex; *c != '\0'; c++) {
-        if (*c == 'x' || *c== 'X') {
-            base = 0;
-            break;
-        }
-    }
-    return strtol(hex, NULL, base);
+template <typename T, size_t N>
+constexpr size_t arrsize(const T (&)[N]) {
+    return N;
 }
 
 /**
@@ -261,5 +255,59 @@ static const char kextVersion[] {
  */
 EXPORT uint8_t *readFileAsBytes(const char* path, off_t off, size_t bytes);
 
+/**
+ *  Modification stamp of a file
+ */
+struct FileStamp {
+    int64_t modifySeconds;
+    int64_t modifyNanoseconds;
+    uint64_t size;
+};
+
+/**
+ *  Obtains the modification stamp of file at path
+ *
+ *  @param path full file path
+ *  @param stamp filled in on success
+ *
+ *  @return 0 on success or errno on error
+ */
+EXPORT errno_t getFileStamp(const char *path, FileStamp *stamp);
+
+/**
+ *  Reads file data at path into a caller owned buffer without allocating
+ *
+ *  @param path full file path
+ *  @param off offset of a file
+ *  @param buffer destination, must hold at least bytes + 1 bytes
+ *  @param bytes maximum bytes read
+ *
+ *  @return number of bytes read, buffer is always null terminated
+ */
+EXPORT size_t readFileToBuffer(const char *path, off_t off, uint8_t *buffer, size_t bytes);
+
+/**
+ *  Writes raw bytes to file at path, the file is created if it does not exist
+ *
+ *  @param path full file path
+ *  @param buffer bytes to write
+ *  @param length number of bytes to write
+ *  @param off offset of a file, the file is truncated first when off is 0
+ *
+ *  @return 0 on success or errno on error
+ */
+EXPORT errno_t writeBytesToFile(const char *path, const void *buffer, size_t length, off_t off);
+
+
+/**
+ *  Create a zero 64-bit OSNumber and store it under key. Published statistics
+ *  keep the returned pointer and update it in place with setValue().
+ *
+ *  @param dict dictionary that owns the number
+ *  @param key key of the number
+ *
+ *  @return the number on success or nullptr on error
+ */
+EXPORT OSNumber *addNumberToDictionary(OSDictionary *dict, const char *key);
 
 #endif /* kern_util_hpp */